@@ -10,10 +10,23 @@
 
 
 #include <string>
+#include <cstring>
 #include <exception> 
+#include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <limits>
 #include <iostream>
+#include <fstream>
 #include <system_error>
 #include <sys/mman.h>
+#include <signal.h>
+#include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -28,6 +41,128 @@ using namespace std::literals;
 
 namespace arr {
 
+  /// Byte range, relative to the address returned by an allocator,
+  /// that was written to since the last flush. 'Vector' marks the
+  /// elements it writes, so that a flush only needs to cover the
+  /// pages that changed. Marks come from the interpreter thread and
+  /// the range is taken by whoever flushes, possibly the background
+  /// flusher, hence the (very short) spin lock.
+  struct DirtyRange {
+    DirtyRange() : from(NONE), to(0) { }
+
+    inline void mark(size_t from_p, size_t to_p) {
+      while (busy.test_and_set(std::memory_order_acquire)) ;
+      from = std::min(from, from_p);
+      to   = std::max(to, to_p);
+      busy.clear(std::memory_order_release);
+    }
+
+    /// Get the range and reset it. Returns false if nothing is dirty.
+    inline bool take(size_t& from_p, size_t& to_p) {
+      while (busy.test_and_set(std::memory_order_acquire)) ;
+      from_p = from;
+      to_p   = to;
+      from = NONE;
+      to   = 0;
+      busy.clear(std::memory_order_release);
+      return from_p < to_p;
+    }
+
+  private:
+    static const size_t NONE = std::numeric_limits<size_t>::max();
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    size_t from;
+    size_t to;
+  };
+
+
+  /// Synchronize the first page of the mapping [m, m+len), which
+  /// holds the 'RawVector' header, and the pages in the dirty range,
+  /// whose offsets are relative to 'm + delta'. The range is put back
+  /// if the 'msync' fails.
+  inline void msyncDirty(char* m, size_t len, size_t delta, DirtyRange& dirty, int flags) {
+    static const size_t pagesz = sysconf(_SC_PAGESIZE);
+    size_t from, to;
+    bool any = dirty.take(from, to);
+    size_t mfrom = 0, mto = 0;
+    if (any) {
+      mfrom = std::min(from + delta, len) / pagesz * pagesz;
+      mto   = std::min(to + delta, len);
+    }
+    const size_t hdrend = std::min(pagesz, len);
+    int res;
+    if (mfrom >= mto) {
+      res = ::msync(m, hdrend, flags);
+    }
+    else if (mfrom <= hdrend) {
+      res = ::msync(m, std::max(mto, hdrend), flags);
+    }
+    else {
+      res = ::msync(m, hdrend, flags);
+      if (res != -1) {
+        res = ::msync(m + mfrom, mto - mfrom, flags);
+      }
+    }
+    if (res == -1) {
+      if (any) {
+        dirty.mark(from, to);   // try again next time
+      }
+      throw std::system_error(std::error_code(errno, std::system_category()), "msync");
+    }
+  }
+
+
+  /// Allocation counters summed over all the allocators. Updated from
+  /// the interpreter and from the background flusher.
+  struct AllocCounters {
+    static inline AllocCounters& instance() {
+      static AllocCounters counters;
+      return counters;
+    }
+
+    std::atomic<int64_t>  bytes;     ///< bytes currently allocated or mapped
+    std::atomic<uint64_t> nbRealloc; ///< calls to 'reallocate'
+    std::atomic<uint64_t> nbRemap;   ///< reallocations that moved data or resized a mapping
+    std::atomic<uint64_t> nbMsync;
+    std::atomic<uint64_t> msyncNs;   ///< time spent in 'msync'
+
+  private:
+    AllocCounters() : bytes(0), nbRealloc(0), nbRemap(0), nbMsync(0), msyncNs(0) { }
+  };
+
+
+  /// Memory usage of a set of vectors, typically all the vectors of
+  /// a variable.
+  struct MemUsage {
+    size_t nbVectors     = 0;
+    size_t bytesUsed     = 0;   ///< header and elements
+    size_t bytesReserved = 0;   ///< allocated or mapped
+    size_t bytesResident = 0;   ///< in memory, sampled with 'mincore' for mappings
+    uint64_t nbRealloc   = 0;
+    uint64_t nbRemap     = 0;
+    uint64_t nbMsync     = 0;
+    uint64_t msyncNs     = 0;
+    uint64_t nbFaults    = 0;   ///< faults served by the allocator, see 'FaultPager'
+  };
+
+
+  /// Number of bytes of the mapping [t, t+n) that are in memory.
+  inline size_t residentBytes(const void* t, size_t n) {
+    static const size_t pagesz = sysconf(_SC_PAGESIZE);
+    if (!t || !n) {
+      return 0;
+    }
+    auto start = reinterpret_cast<uintptr_t>(t) / pagesz * pagesz;
+    auto len = reinterpret_cast<uintptr_t>(t) + n - start;
+    std::vector<unsigned char> pages((len + pagesz - 1) / pagesz);
+    if (mincore(reinterpret_cast<void*>(start), len, pages.data()) == -1) {
+      return 0;
+    }
+    return std::count_if(pages.begin(), pages.end(), [](unsigned char c) { return c & 1; })
+      * pagesz;
+  }
+
+
   struct baseallocator {
     virtual void* allocate(size_t sz) = 0;
     virtual void  deallocate(void* t, size_t n) = 0;
@@ -37,32 +172,423 @@ namespace arr {
     inline virtual void msync(bool async) const {
       throw std::range_error("msync not defined for allocator type");
     }
-    virtual ~baseallocator() noexcept(false) { }
+    /// The dirty range tracker of the allocator; null if writes don't
+    /// need to be tracked.
+    inline virtual DirtyRange* getDirtyRange() { return nullptr; }
+    /// Synchronously flush the dirty range; called by the background
+    /// flusher.
+    inline virtual void flushDirty() { }
+    /// True if small vectors should get exactly the space they need
+    /// rather than room for 'VECTOR_INITIAL_ALLOC' elements; growing
+    /// them is then a bit more costly, but scalars stay small.
+    inline virtual bool allocatesToSize() const { return false; }
+    /// Bytes of the allocation that are in memory.
+    inline virtual size_t resident() const { return stats.bytes; }
+    /// If the allocation is a shared mapping of a file, give the file
+    /// and the offset in it of the start of the allocation, so that it
+    /// can be read from the page cache without going through memory.
+    inline virtual bool getFileRange(int& fd_p, off_t& off_p) const { return false; }
+    /// True if the pages of the allocation are only brought in when
+    /// accessed from user space (see 'zallocator'); such memory can't
+    /// be handed to a system call, which would fail with 'EFAULT'.
+    inline virtual bool isPaged() const { return false; }
+    /// Serve a fault at 'addr' if it is in a page that the allocator
+    /// makes accessible on demand, see 'FaultPager'.
+    inline virtual bool onFault(const char* addr) { return false; }
+    /// Serve a fault with 'onFault', counting it if it was ours. Only
+    /// these faults can be told apart per allocator: those the kernel
+    /// serves for plain mappings are only known for the whole process.
+    inline bool serveFault(const char* addr) {
+      if (!onFault(addr)) {
+        return false;
+      }
+      ++stats.nbFaults;
+      return true;
+    }
+    /// For a time index, narrow the elements [from, to) to those that
+    /// can hold the first time at or after 'tm' (after 'tm' if
+    /// 'upper'), if the allocator knows the time range of parts of it.
+    inline virtual void findTimeRows(int64_t tm, bool upper, size_t& from, size_t& to) const { }
+    /// True if the allocation is mapped read-only: it can't be
+    /// written to, not even its header.
+    inline virtual bool isReadOnly() const { return false; }
+
+    /// Add the counters of this allocator to 'u'.
+    inline void addMemUsage(MemUsage& u) const {
+      u.bytesReserved += stats.bytes;
+      u.bytesResident += resident();
+      u.nbRealloc     += stats.nbRealloc;
+      u.nbRemap       += stats.nbRemap;
+      u.nbMsync       += stats.nbMsync;
+      u.msyncNs       += stats.msyncNs;
+      u.nbFaults      += stats.nbFaults;
+    }
+
+    virtual ~baseallocator() noexcept(false) {
+      AllocCounters::instance().bytes -= stats.bytes;
+    }
+
+  protected:
+    struct Stats {
+      size_t   bytes     = 0;
+      uint64_t nbRealloc = 0;
+      uint64_t nbRemap   = 0;
+      mutable std::atomic<uint64_t> nbMsync{0}; // 'msync' is const and also called by the flusher
+      mutable std::atomic<uint64_t> msyncNs{0};
+      std::atomic<uint64_t> nbFaults{0};        // incremented in the signal handler
+    } stats;
+
+    /// Record that 'n' bytes are now allocated or mapped.
+    inline void setBytes(size_t n) {
+      AllocCounters::instance().bytes += static_cast<int64_t>(n) - static_cast<int64_t>(stats.bytes);
+      stats.bytes = n;
+    }
+
+    inline void countRealloc(bool remap) {
+      auto& g = AllocCounters::instance();
+      ++stats.nbRealloc;
+      ++g.nbRealloc;
+      if (remap) {
+        ++stats.nbRemap;
+        ++g.nbRemap;
+      }
+    }
+
+    /// Counts an 'msync' and the time spent in it, for the duration
+    /// of the scope.
+    struct MsyncTimer {
+      MsyncTimer(const baseallocator& a_p) : a(a_p), start(std::chrono::steady_clock::now()) { }
+      ~MsyncTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+          (std::chrono::steady_clock::now() - start).count();
+        auto& g = AllocCounters::instance();
+        ++a.stats.nbMsync;
+        ++g.nbMsync;
+        a.stats.msyncNs += ns;
+        g.msyncNs += ns;
+      }
+    private:
+      const baseallocator& a;
+      const std::chrono::steady_clock::time_point start;
+    };
+  };
+
+
+  /// Registry of the allocators with dirty ranges, and background
+  /// flush of these ranges every 'interval'. The flush is a
+  /// synchronous 'msync', but done outside of the interpreter thread,
+  /// so that an explicit 'msync' from the language usually finds
+  /// little left to do.
+  struct MsyncFlusher {
+    static inline MsyncFlusher& instance() {
+      static MsyncFlusher flusher;
+      return flusher;
+    }
+
+    inline void add(baseallocator* a) {
+      std::lock_guard<std::mutex> guard(mx);
+      allocs.insert(a);
+    }
+
+    /// Once this returns, the flusher is guaranteed not to be
+    /// flushing 'a'.
+    inline void remove(baseallocator* a) {
+      std::lock_guard<std::mutex> guard(mx);
+      allocs.erase(a);
+    }
+
+    inline void flushAll() {
+      std::lock_guard<std::mutex> guard(mx);
+      for (auto a : allocs) {
+        try {
+          a->flushDirty();
+        }
+        catch (...) {
+          // the range was put back, it will be tried again
+        }
+      }
+    }
+
+    /// Run until 'stop' becomes true; meant to be the body of a
+    /// dedicated thread.
+    inline void run(std::chrono::milliseconds interval, volatile bool& stop) {
+      const auto slice = std::min(interval, std::chrono::milliseconds(100));
+      auto next = std::chrono::steady_clock::now() + interval;
+      while (!stop) {
+        std::this_thread::sleep_for(slice); // so 'stop' is seen quickly
+        if (std::chrono::steady_clock::now() >= next) {
+          flushAll();
+          next = std::chrono::steady_clock::now() + interval;
+        }
+      }
+    }
+
+  private:
+    MsyncFlusher() { }
+    std::mutex mx;
+    std::set<baseallocator*> allocs;
+  };
+
+
+  /// Registry of the allocators whose pages are made accessible on
+  /// demand, and the 'SIGSEGV' handler that hands them the faults.
+  /// The faults are synchronous, so an allocator serves them in the
+  /// context of the access and may allocate and lock. The allocators
+  /// hold 'mutex' while they change their pages; it is recursive as
+  /// an allocator can fault on its own pages while holding it.
+  struct FaultPager {
+    static inline FaultPager& instance() {
+      static FaultPager pager;
+      return pager;
+    }
+
+    inline void add(baseallocator* a) {
+      std::lock_guard<std::recursive_mutex> guard(mx);
+      allocs.insert(a);
+    }
+
+    inline void remove(baseallocator* a) {
+      std::lock_guard<std::recursive_mutex> guard(mx);
+      allocs.erase(a);
+    }
+
+    inline std::recursive_mutex& mutex() { return mx; }
+
+  private:
+    FaultPager() {
+      struct sigaction sa;
+      memset(&sa, 0, sizeof(sa));
+      sa.sa_sigaction = onSignal;
+      sa.sa_flags = SA_SIGINFO;
+      sigemptyset(&sa.sa_mask);
+      if (sigaction(SIGSEGV, &sa, &previous) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "sigaction");
+      }
+    }
+
+    static void onSignal(int sig, siginfo_t* si, void* ctx) {
+      auto& pager = instance();
+      {
+        std::lock_guard<std::recursive_mutex> guard(pager.mx);
+        for (auto a : pager.allocs) {
+          if (a->serveFault(static_cast<const char*>(si->si_addr))) {
+            return;
+          }
+        }
+      }
+      // not ours, hand it over to whoever was there before:
+      if (pager.previous.sa_flags & SA_SIGINFO) {
+        pager.previous.sa_sigaction(sig, si, ctx);
+      }
+      else if (pager.previous.sa_handler != SIG_DFL && pager.previous.sa_handler != SIG_IGN) {
+        pager.previous.sa_handler(sig);
+      }
+      else {
+        signal(sig, SIG_DFL);   // the access faults again and is fatal
+      }
+    }
+
+    std::recursive_mutex mx;
+    std::set<baseallocator*> allocs;
+    struct sigaction previous;
+  };
+
+
+  /// Huge page policy for large mappings, and accounting of the
+  /// bytes it applies to. With 'HUGETLB', anonymous mappings of at
+  /// least 'threshold' bytes are first attempted with 'MAP_HUGETLB',
+  /// which needs pages reserved by the administrator; when that fails
+  /// or with 'MADVISE', transparent huge pages are requested with
+  /// 'madvise(MADV_HUGEPAGE)'.
+  struct HugePages {
+    enum Mode { OFF, MADVISE, HUGETLB };
+
+    static inline HugePages& instance() {
+      static HugePages hp;
+      return hp;
+    }
+
+    static inline Mode from_string(const std::string& s) {
+      if (s == "off")     return OFF;
+      if (s == "madvise") return MADVISE;
+      if (s == "hugetlb") return HUGETLB;
+      throw std::range_error("invalid huge pages mode: " + s);
+    }
+
+    inline void configure(Mode mode_p, size_t threshold_p) {
+      mode = mode_p;
+      threshold = threshold_p;
+    }
+
+    inline bool useHugetlb(size_t sz) const { return mode == HUGETLB && sz >= threshold; }
+    inline bool useMadvise(size_t sz) const { return mode != OFF     && sz >= threshold; }
+
+    /// Size of the default huge page, from '/proc/meminfo'.
+    inline size_t pageSize() const { return hugepagesz; }
+
+    /// Try to advise [t, t+n) for transparent huge pages. Returns true
+    /// on success, in which case the bytes are accounted for.
+    inline bool advise(void* t, size_t n) {
+      if (useMadvise(n) && madvise(t, n, MADV_HUGEPAGE) == 0) {
+        bytesAdvised += n;
+        return true;
+      }
+      return false;
+    }
+
+    std::atomic<size_t> bytesHugetlb;  ///< bytes mapped with 'MAP_HUGETLB'
+    std::atomic<size_t> bytesAdvised;  ///< bytes advised with 'MADV_HUGEPAGE'
+    std::atomic<size_t> nbFallback;    ///< 'MAP_HUGETLB' failures
+
+  private:
+    HugePages() : bytesHugetlb(0), bytesAdvised(0), nbFallback(0),
+                  mode(MADVISE), threshold(32 << 20), hugepagesz(2 << 20) {
+      std::ifstream meminfo("/proc/meminfo");
+      std::string key;
+      size_t kb;
+      while (meminfo >> key) {
+        if (key == "Hugepagesize:" && meminfo >> kb) {
+          hugepagesz = kb << 10;
+          break;
+        }
+        meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+      }
+    }
+    std::atomic<Mode> mode;
+    std::atomic<size_t> threshold;
+    size_t hugepagesz;
+  };
+
+
+  /// Thread-local free lists of small blocks, in size classes of 32
+  /// to 512 bytes. The interpreter creates and destroys a great many
+  /// small vectors (scalars in particular), and this keeps them off
+  /// 'malloc'. Each list is bounded, so that blocks allocated by one
+  /// thread and freed by another can't pile up.
+  struct SmallBlocks {
+    static const size_t NB_CLASSES = 5;
+    static const size_t MIN_SIZE   = 32;
+    static const size_t MAX_SIZE   = MIN_SIZE << (NB_CLASSES - 1);
+    static const size_t MAX_CACHED = 1024; ///< per size class
+
+    /// The smallest size class holding 'n' bytes, 'n <= MAX_SIZE'.
+    static inline size_t sizeClass(size_t n) {
+      size_t k = 0;
+      while ((MIN_SIZE << k) < n) ++k;
+      return k;
+    }
+    static inline size_t classSize(size_t k) { return MIN_SIZE << k; }
+
+    static inline void* get(size_t k) {
+      if (!destroyed()) {
+        auto& b = instance();
+        if (b.heads[k]) {
+          auto p = b.heads[k];
+          b.heads[k] = p->next;
+          --b.counts[k];
+          return p;
+        }
+      }
+      auto p = malloc(classSize(k));
+      if (p == nullptr) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "malloc");
+      }
+      return p;
+    }
+
+    static inline void put(size_t k, void* p) {
+      if (!destroyed()) {
+        auto& b = instance();
+        if (b.counts[k] < MAX_CACHED) {
+          auto f = static_cast<Free*>(p);
+          f->next = b.heads[k];
+          b.heads[k] = f;
+          ++b.counts[k];
+          return;
+        }
+      }
+      free(p);
+    }
+
+    ~SmallBlocks() {
+      destroyed() = true;       // vectors outliving the thread's lists just use 'free'
+      for (size_t k=0; k<NB_CLASSES; ++k) {
+        while (heads[k]) {
+          auto p = heads[k];
+          heads[k] = p->next;
+          free(p);
+        }
+      }
+    }
+
+  private:
+    struct Free { Free* next; };
+    Free* heads[NB_CLASSES] = { };
+    size_t counts[NB_CLASSES] = { };
+
+    SmallBlocks() { }
+
+    static inline SmallBlocks& instance() {
+      static thread_local SmallBlocks blocks;
+      return blocks;
+    }
+    /// Trivially destructible, so usable after 'blocks' is gone.
+    static inline bool& destroyed() {
+      static thread_local bool d = false;
+      return d;
+    }
   };
 
 
   struct memallocator : baseallocator {
-    memallocator() : t(nullptr) { }
+    memallocator() : t(nullptr), k(NONE) { }
     inline void* allocate(size_t n) {
+      if (n <= SmallBlocks::MAX_SIZE) {
+        k = SmallBlocks::sizeClass(n);
+        t = SmallBlocks::get(k);
+        setBytes(SmallBlocks::classSize(k));
+        return t;
+      }
       t = malloc(n); 
       if (t == nullptr) {
         throw std::system_error(std::error_code(errno, std::system_category()), "malloc");
       }
+      k = NONE;
+      setBytes(n);
       return t;
     }
     inline void deallocate(void* address, size_t n) { 
-      free(t); 
-      t = nullptr;
+      release();
     }
     inline void* reallocate(void* old_address, size_t n) { 
       if (old_address != t) {
         throw std::out_of_range("memallocator can't reallocate at an offset");
       }
+      if (k != NONE) {
+        countRealloc(n > SmallBlocks::classSize(k));
+        if (n <= SmallBlocks::classSize(k)) {
+          return t;
+        }
+        // usually growing out of the small blocks to 'VECTOR_INITIAL_ALLOC':
+        const auto newk = n <= SmallBlocks::MAX_SIZE ? SmallBlocks::sizeClass(n) : NONE;
+        void* new_t = newk != NONE ? SmallBlocks::get(newk) : malloc(n);
+        if (new_t == nullptr) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "malloc");
+        }
+        memcpy(new_t, t, SmallBlocks::classSize(k));
+        SmallBlocks::put(k, t);
+        t = new_t;
+        k = newk;
+        setBytes(k != NONE ? SmallBlocks::classSize(k) : n);
+        return t;
+      }
       void* new_t = realloc(old_address, n); 
       if (new_t == nullptr) {
         throw std::system_error(std::error_code(errno, std::system_category()), "realloc");
       }
+      countRealloc(new_t != t);
       t = new_t;
+      setBytes(n);
       return t;
     }
     inline void* initialize() {
@@ -71,32 +597,51 @@ namespace arr {
     inline size_t size() const {
       throw std::out_of_range("memallocator does not provide size");
     }
-    ~memallocator() { if (t) free(t); }
+    inline virtual bool allocatesToSize() const { return true; }
+    ~memallocator() { release(); }
   private:
+    static const size_t NONE = std::numeric_limits<size_t>::max();
     void* t;
+    size_t k;                   ///< size class if 't' is a small block, else 'NONE'
+
+    inline void release() {
+      if (t) {
+        if (k != NONE) {
+          SmallBlocks::put(k, t);
+        }
+        else {
+          free(t);
+        }
+      }
+      t = nullptr;
+      k = NONE;
+      setBytes(0);
+    }
   };
 
 
   struct flexallocator : baseallocator {
-    flexallocator() : offset(0), t(nullptr), n(0), pagesz(sysconf(_SC_PAGESIZE)) { }
+    flexallocator() : offset(0), t(nullptr), n(0),
+                      syspagesz(sysconf(_SC_PAGESIZE)), pagesz(syspagesz), huge(NONE),
+                      triedHugetlb(false) { }
   
     inline void* allocate(size_t n_p) {
-      size_t pages = n_p / pagesz;
-      if (n_p % pagesz) {
-        ++pages;
-      }
-      n = pages * pagesz;
-      t = mmap(NULL, n, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
-      if (t == (void *)-1) {
-        throw std::system_error(std::error_code(errno, std::system_category()), "mmap (PRIVATE|ANON)");
-      }
+      map(n_p);
       return t;
     }
 
     inline virtual void deallocate(void* t_p, size_t n_p) { 
-      if (munmap(t_p, n_p) == -1) {
-        throw std::system_error(std::error_code(errno, std::system_category()), "munmap");
-      } 
+      // the mapping is ours in full, whatever the offset:
+      if (t) {
+        if (munmap(t, n) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "munmap");
+        }
+        unaccount(n);
+        t = nullptr;
+        n = 0;
+        offset = 0;
+        setBytes(0);
+      }
     };
 
     inline virtual void* reallocate(void* t_p, size_t n_p) {
@@ -105,17 +650,36 @@ namespace arr {
         throw std::out_of_range("can't reallocate with an address before start of mapping");
       }
       else if (t_p == (char*)t + offset) { // the outside world is oblivious of the offset...
-        size_t pages = (n_p + offset) / pagesz;
-        if ((n_p + offset) % pagesz) {
-          ++pages;
+        auto& hp = HugePages::instance();
+        if (huge != HUGETLB && !triedHugetlb && hp.useHugetlb(n_p + offset)) {
+          moveToHugetlb(n_p + offset); // copy once, then grow with 'mremap'
         }
-        n_p = pages * pagesz;
-        if (n != n_p) {
-          t = mremap(t, n, n_p, MREMAP_MAYMOVE);
-          if (t == (void *)-1) {
+        size_t len = roundup(n_p + offset);
+        countRealloc(n != len);
+        if (n != len) {
+          auto new_t = mremap(t, n, len, MREMAP_MAYMOVE);
+          if (new_t == (void *)-1) {
+            // older kernels can't 'mremap' 'MAP_HUGETLB' mappings:
+            if (huge == HUGETLB && errno == EINVAL && moveToHugetlb(len)) {
+              return (char*)t + offset;
+            }
             throw std::system_error(std::error_code(errno, std::system_category()), "mremap");
           }
-          n = n_p;
+          else {
+            unaccount(n);
+            t = new_t;
+            n = len;
+            setBytes(n);
+            if (huge == ADVISED) {
+              hp.bytesAdvised += n;
+            }
+            else if (huge == HUGETLB) {
+              hp.bytesHugetlb += n;
+            }
+            else if (hp.advise(t, n)) {
+              huge = ADVISED;
+            }
+          }
         }
         return (char*)t + offset;
       }
@@ -124,7 +688,7 @@ namespace arr {
           throw std::out_of_range("can't reallocate with an address beyond end of mapping");
         }
         
-        size_t sz = (char*)t_p - ((char*)t + offset);
+        size_t sz = (char*)t_p - (char*)t;
         size_t pages = sz / pagesz;
         offset       = sz % pagesz;
 
@@ -132,9 +696,10 @@ namespace arr {
           if (munmap(t, pages * pagesz) == -1) {
             throw std::system_error(std::error_code(errno, std::system_category()), "munmap");
           }
-
+          unaccount(pages * pagesz);
           t = (char*)t + pages * pagesz;
           n -= pages * pagesz;
+          setBytes(n);
         }
 
         return reallocate((char*)t + offset, n_p + offset); 
@@ -149,21 +714,118 @@ namespace arr {
       throw std::out_of_range("flexallocator does not provide size");
     }
 
-    ~flexallocator() { munmap(t, n); }
+    /// True if the mapping is backed by 'MAP_HUGETLB' pages.
+    inline bool isHugetlb() const { return huge == HUGETLB; }
+    /// True if the mapping was advised for transparent huge pages.
+    inline bool isAdvised() const { return huge == ADVISED; }
+
+    inline virtual size_t resident() const { return residentBytes(t, n); }
+
+    ~flexallocator() {
+      if (t) {
+        munmap(t, n);
+        unaccount(n);
+      }
+    }
 
   private:  
+    enum Huge { NONE, ADVISED, HUGETLB };
+
     size_t offset;
     void* t;
     size_t n;
-    const size_t pagesz;
+    const size_t syspagesz;
+    size_t pagesz;              ///< unit of the mapping, 'syspagesz' or the huge page size
+    Huge huge;
+    bool triedHugetlb;
+
+    inline size_t roundup(size_t sz) const { return (sz + pagesz - 1) / pagesz * pagesz; }
+
+    inline void unaccount(size_t sz) {
+      if (huge == ADVISED) {
+        HugePages::instance().bytesAdvised -= sz;
+      }
+      else if (huge == HUGETLB) {
+        HugePages::instance().bytesHugetlb -= sz;
+      }
+    }
+
+    /// Create a new mapping of at least 'sz' bytes in 't', using huge
+    /// pages if the policy says so.
+    inline void map(size_t sz) {
+      auto& hp = HugePages::instance();
+      if (hp.useHugetlb(sz)) {
+        size_t len = sz;
+        auto m = mapHugetlb(len);
+        if (m) {
+          t = m;
+          n = len;
+          pagesz = hp.pageSize();
+          huge = HUGETLB;
+          setBytes(n);
+          return;
+        }
+      }
+      pagesz = syspagesz;
+      n = roundup(sz);
+      t = mmap(NULL, n, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+      if (t == (void *)-1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mmap (PRIVATE|ANON)");
+      }
+      huge = hp.advise(t, n) ? ADVISED : NONE;
+      setBytes(n);
+    }
+
+    /// Map at least 'len' bytes with 'MAP_HUGETLB'; 'len' is updated
+    /// to the mapped length. Returns nullptr if no huge pages could be
+    /// had, which is remembered so that growing doesn't try again.
+    inline void* mapHugetlb(size_t& len) {
+      auto& hp = HugePages::instance();
+      triedHugetlb = true;
+      const size_t hpsz = hp.pageSize();
+      len = (len + hpsz - 1) / hpsz * hpsz;
+      auto m = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1, 0);
+      if (m == (void *)-1) {
+        ++hp.nbFallback;
+        return nullptr;
+      }
+      hp.bytesHugetlb += len;
+      return m;
+    }
+
+    /// Move the content to a new 'MAP_HUGETLB' mapping of at least
+    /// 'sz' bytes; the offset is preserved. Returns false, leaving the
+    /// mapping as it was, if no huge pages could be had.
+    inline bool moveToHugetlb(size_t sz) {
+      auto m = mapHugetlb(sz);
+      if (!m) {
+        return false;
+      }
+      memcpy(m, t, std::min(n, sz));
+      munmap(t, n);
+      unaccount(n);
+      t = m;
+      n = sz;
+      pagesz = HugePages::instance().pageSize();
+      huge = HUGETLB;
+      setBytes(n);
+      countRealloc(true);
+      return true;
+    }
   };
 
 
   struct mmapallocator : baseallocator {
-    mmapallocator(const fsys::path& filename_p) : t(nullptr), n(0), fd(-1), filename(filename_p) { }
+    /// With 'readonly_p' the existing file is opened and mapped
+    /// read-only, so that several processes can share its pages
+    /// without risk of modifying it; 'advice_p' is an 'madvise' access
+    /// pattern hint.
+    mmapallocator(const fsys::path& filename_p, bool readonly_p=false, int advice_p=MADV_NORMAL)
+      : t(nullptr), n(0), fd(-1), filename(filename_p), advised(0),
+        readonly(readonly_p), advice(advice_p) { }
 
     inline void* initialize() {
-      int fd = open(filename.c_str(), O_RDWR);
+      fd = open(filename.c_str(), readonly ? O_RDONLY : O_RDWR);
       if (fd == -1) {
         throw std::system_error(std::error_code(errno, std::system_category()), 
                                 "cannot open "s + filename.c_str());      
@@ -172,20 +834,35 @@ namespace arr {
       off_t sz = lseek(fd, 0L, SEEK_END);
       if (sz == -1) {
         close(fd);
+        fd = -1;
         throw std::system_error(std::error_code(errno, std::system_category()), "lseek");
       }   
-      t = static_cast<void*>(mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+      // 'Vector' doesn't write to a read-only allocation (see
+      // 'Vector::readonly'):
+      t = static_cast<void*>(mmap(NULL, sz, readonly ? PROT_READ : PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, fd, 0));
       if (t == MAP_FAILED) {
+        t = nullptr;
         close(fd);
+        fd = -1;
         throw std::system_error(std::error_code(errno, std::system_category()), "mmap");
       }
       n = sz;
+      setBytes(n);
+      advise();
+      if (advice != MADV_NORMAL) {
+        ::madvise(t, n, advice);  // only a hint, so ignore failures
+      }
+      if (!readonly) {
+        MsyncFlusher::instance().add(this);
+      }
       return t;                   // nullptr if the file didn't exist
     }
 
     inline size_t size() const { return n; }
 
     inline void* allocate(size_t sz) {
+      checkWritable();
       fd = open(filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
       if (fd == -1) {
         throw std::system_error(std::error_code(errno, std::system_category()), "open");
@@ -201,17 +878,28 @@ namespace arr {
       }
       // close(fd);                  // file descriptor can be closed now
       n = sz;
+      setBytes(n);
+      advise();
+      dirty.mark(0, n);         // whatever the constructor writes
+      MsyncFlusher::instance().add(this);
       return t;
     }
 
     inline void deallocate(void* address, size_t n) {
+      checkWritable();
       if (t) {
+        MsyncFlusher::instance().remove(this);
+        std::lock_guard<std::mutex> guard(mx);
         // unmap and delete the file
-        if (munmap(address, n) == -1) {
+        if (munmap(t, this->n) == -1) {
           throw std::system_error(std::error_code(errno, std::system_category()), "munmap");    
         }
         t = nullptr;
-        n = 0;
+        this->n = 0;
+        setBytes(0);
+        advise();
+        size_t from, to;
+        dirty.take(from, to);
         if (remove(filename.c_str()) != 0) {
           throw std::system_error(std::error_code(errno, std::system_category()), 
                                   "can't remove "s + filename.c_str());    
@@ -223,42 +911,67 @@ namespace arr {
       if (old_address != t) {
         throw std::out_of_range("mmapallocator can't reallocate at an offset");
       }
+      checkWritable();
+      std::lock_guard<std::mutex> guard(mx); // the flusher can't use 't' and 'n' now
       if (lseek(fd, new_size, SEEK_SET) == -1) {
         throw std::system_error(std::error_code(errno, std::system_category()), "lseek");
       }
       if (write(fd, "", 1) != 1) {
-        close(fd);
         throw std::system_error(std::error_code(errno, std::system_category()), "write");
       }
       void *new_t = mremap(t, n, new_size, MREMAP_MAYMOVE);
       if (new_t == MAP_FAILED) {
         throw std::system_error(std::error_code(errno, std::system_category()), "mremap");
       }
+      countRealloc(true);
       n = new_size;
       t = new_t;
+      setBytes(n);
+      advise();
       return t;
     }
 
+    /// Flush the header page and the pages written to since the last
+    /// flush.
     inline virtual void msync(bool async) const {
-      if (async) {
-        if (::msync(t, n, MS_SYNC) == -1) {
-          throw std::system_error(std::error_code(errno, std::system_category()), "msync");    
-        }
-      }
-      else {
-        if (::msync(t, n, MS_ASYNC) == -1) {
-          throw std::system_error(std::error_code(errno, std::system_category()), "msync");    
-        }
+      if (readonly) {
+        return;
       }
+      std::lock_guard<std::mutex> guard(mx);
+      syncDirty(async ? MS_ASYNC : MS_SYNC);
     }          
+
+    inline virtual DirtyRange* getDirtyRange() { return readonly ? nullptr : &dirty; }
+
+    inline virtual bool isReadOnly() const { return readonly; }
+
+    inline virtual size_t resident() const { return residentBytes(t, n); }
+
+    inline virtual bool getFileRange(int& fd_p, off_t& off_p) const {
+      if (!t || fd == -1) {
+        return false;
+      }
+      fd_p  = fd;
+      off_p = 0;
+      return true;
+    }
+
+    inline virtual void flushDirty() {
+      std::lock_guard<std::mutex> guard(mx);
+      syncDirty(MS_SYNC);
+    }
         
     virtual ~mmapallocator() {
+      if (t && !readonly) {
+        MsyncFlusher::instance().remove(this);
+      }
       if (fd != -1) {
         close(fd);                // we can close
       }
       if (t) {
+        HugePages::instance().bytesAdvised -= advised;
         // std::cout << filename << " msync" << std::endl;
-        if (::msync(t, n, MS_SYNC) == -1) {
+        if (!readonly && ::msync(t, n, MS_SYNC) == -1) {
           munmap(t, n);
           throw std::system_error(std::error_code(errno, std::system_category()), "msync");    
         }
@@ -274,6 +987,34 @@ namespace arr {
     size_t n;
     int fd;
     const fsys::path filename;
+    mutable DirtyRange dirty;
+    mutable std::mutex mx;      ///< protects the mapping against the flusher
+    size_t advised;             ///< bytes advised for transparent huge pages
+    const bool readonly;
+    const int advice;
+
+    inline void checkWritable() const {
+      if (readonly) {
+        throw std::range_error(filename.string() + " is mapped read-only");
+      }
+    }
+
+    /// (Re)advise the mapping for transparent huge pages. Only
+    /// 'tmpfs' and file systems supporting large folios will honour
+    /// it, but it costs nothing elsewhere.
+    inline void advise() {
+      auto& hp = HugePages::instance();
+      hp.bytesAdvised -= advised;
+      advised = t && hp.advise(t, n) ? n : 0;
+    }
+
+    /// To be called with 'mx' held.
+    inline void syncDirty(int flags) const {
+      if (t) {
+        MsyncTimer timer(*this);
+        msyncDirty(static_cast<char*>(t), n, 0, dirty, flags);
+      }
+    }
   };
 
 
@@ -22,8 +22,12 @@
 
 #include <memory>
 #include <string>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include "allocator.hpp"
+#include "compressed_allocator.hpp"
+#include "segmented_allocator.hpp"
+#include "container_allocator.hpp"
 
 
 namespace fsys = boost::filesystem;
@@ -67,7 +71,11 @@ namespace arr {
   };
 
   struct MmapAllocFactory : public AllocFactory {
-    MmapAllocFactory(const fsys::path& dirname_p, bool expectExists) : dirname(dirname_p) {
+    /// 'readonly_p' and 'advice_p' are passed on to the allocators,
+    /// see 'mmapallocator'.
+    MmapAllocFactory(const fsys::path& dirname_p, bool expectExists,
+                     bool readonly_p=false, int advice_p=MADV_NORMAL)
+      : dirname(dirname_p), readonly(readonly_p), advice(advice_p) {
       struct stat st = {0};
       if (stat(dirname.c_str(), &st) == 0) {
         if (!expectExists) {
@@ -88,22 +96,140 @@ namespace arr {
     }
 
     inline std::unique_ptr<baseallocator> get(const std::string& name) const {
-      return std::make_unique<mmapallocator>(dirname / fsys::path(name));
+      return std::make_unique<mmapallocator>(dirname / fsys::path(name), readonly, advice);
     }
     inline std::unique_ptr<baseallocator> get(size_t nb) const {
-      return std::make_unique<mmapallocator>(dirname / fsys::path(std::to_string(nb)));
+      return std::make_unique<mmapallocator>(dirname / fsys::path(std::to_string(nb)),
+                                             readonly, advice);
     }
 
     inline std::string to_string() const {
-      return "mmap file = "s + dirname.c_str();
+      return (readonly ? "read-only mmap file = "s : "mmap file = "s) + dirname.c_str();
     }
 
     inline virtual fsys::path getDirname() const { return dirname; }
 
     inline virtual bool isPersistent() const { return true; }
 
+    inline bool isReadOnly() const { return readonly; }
+    inline int getAdvice() const { return advice; }
+
   private:
     const fsys::path dirname;
+    const bool readonly;
+    const int advice;
+  };
+
+  /// Same as 'MmapAllocFactory' but the data columns are stored
+  /// compressed (see 'zallocator'). The dimension and name vectors
+  /// are small and stay plain mmapped files.
+  struct ZMmapAllocFactory : public MmapAllocFactory {
+    ZMmapAllocFactory(const fsys::path& dirname_p, bool expectExists,
+                      bool readonly_p=false, int advice_p=MADV_NORMAL)
+      : MmapAllocFactory(dirname_p, expectExists, readonly_p, advice_p) { }
+
+    inline std::unique_ptr<baseallocator> get(const std::string& name) const {
+      if (isColumnName(name)) {
+        return std::make_unique<zallocator>(getDirname() / fsys::path(name), isReadOnly());
+      }
+      return MmapAllocFactory::get(name);
+    }
+    inline std::unique_ptr<baseallocator> get(size_t nb) const {
+      return std::make_unique<zallocator>(getDirname() / fsys::path(std::to_string(nb)),
+                                          isReadOnly());
+    }
+
+    inline std::string to_string() const {
+      return "compressed mmap file = "s + getDirname().c_str();
+    }
+
+  private:
+    static inline bool isColumnName(const std::string& name) {
+      return name.size() && std::all_of(name.begin(), name.end(), ::isdigit);
+    }
+  };
+
+  /// Same as 'MmapAllocFactory' but the data columns are stored in
+  /// fixed-size segments of 'segsz' bytes (see 'segallocator'), so
+  /// that appends only ever touch the tail segment. When loading an
+  /// existing directory the segment size is taken from the manifest
+  /// of each column.
+  struct SegAllocFactory : public MmapAllocFactory {
+    SegAllocFactory(const fsys::path& dirname_p, bool expectExists, size_t segsz_p,
+                    bool readonly_p=false, int advice_p=MADV_NORMAL)
+      : MmapAllocFactory(dirname_p, expectExists, readonly_p, advice_p), segsz(segsz_p) { }
+
+    inline std::unique_ptr<baseallocator> get(const std::string& name) const {
+      if (name.size() && std::all_of(name.begin(), name.end(), ::isdigit)) {
+        return std::make_unique<segallocator>(getDirname() / fsys::path(name), segsz,
+                                              isReadOnly(), getAdvice());
+      }
+      return MmapAllocFactory::get(name);
+    }
+    inline std::unique_ptr<baseallocator> get(size_t nb) const {
+      return std::make_unique<segallocator>(getDirname() / fsys::path(std::to_string(nb)), segsz,
+                                            isReadOnly(), getAdvice());
+    }
+
+    inline std::string to_string() const {
+      return "segmented mmap file = "s + getDirname().c_str();
+    }
+
+  private:
+    const size_t segsz;
+  };
+
+  /// Allocator factory for the single-file container 'filename_p'
+  /// (see 'Container'): each vector is an extent named after what
+  /// would have been its file name in a directory.
+  struct ContainerAllocFactory : public AllocFactory {
+    ContainerAllocFactory(const fsys::path& filename_p, bool expectExists,
+                          bool readonly=false, int advice_p=MADV_NORMAL)
+      : advice(advice_p) {
+      struct stat st = {0};
+      if (stat(filename_p.c_str(), &st) == 0) {
+        if (!expectExists) {
+          throw std::range_error(filename_p.c_str() + " already exists"s);
+        }
+      }
+      else if (expectExists) {
+        throw std::range_error(filename_p.c_str() + " does not exist"s);
+      }
+      cont = std::make_shared<Container>(filename_p, !expectExists, readonly);
+    }
+
+    /// The vectors of 'parent' whose names are prefixed with
+    /// 'subname/', for instance the index of a 'zts'.
+    ContainerAllocFactory(const ContainerAllocFactory& parent, const std::string& subname)
+      : cont(parent.cont), prefix(parent.prefix + subname + "/"), advice(parent.advice) { }
+
+    inline std::unique_ptr<baseallocator> get(const std::string& name) const {
+      return std::make_unique<containerallocator>(cont, prefix + name, advice);
+    }
+    inline std::unique_ptr<baseallocator> get(size_t nb) const {
+      return get(std::to_string(nb));
+    }
+
+    inline std::string to_string() const {
+      return (cont->isReadOnly() ? "read-only container file = "s : "container file = "s)
+        + getDirname().c_str();
+    }
+
+    inline virtual fsys::path getDirname() const {
+      return prefix.empty() ? cont->getPath() : cont->getPath() / prefix.substr(0, prefix.size() - 1);
+    }
+
+    inline virtual bool isPersistent() const { return true; }
+
+    inline bool has(const std::string& name) const { return cont->has(prefix + name); }
+    inline RawVector<uint64_t> readHeader(const std::string& name) const {
+      return cont->readHeader(prefix + name);
+    }
+
+  private:
+    std::shared_ptr<Container> cont;
+    const std::string prefix;
+    const int advice;
   };
 
 } // end namespace arr
@@ -66,6 +66,127 @@ void anf::convertToANF(El* el, bool doBndVar) {
 }
 
 
+namespace {
+
+  struct Resolver {
+    Resolver(Function* f_p) : f(f_p) { }
+
+    void local(Symbol* s) {
+      if (f->localMap.emplace(s->data, f->locals.size()).second) {
+        f->locals.push_back(s->data);
+      }
+      symbols.push_back(s);
+    }
+
+    void walk(E* e) {
+      switch (e->etype) {
+      case etsymbol:
+        symbols.push_back(static_cast<Symbol*>(e));
+        break;
+      case etunop:
+        walk(static_cast<Unop*>(e)->e);
+        break;
+      case etbinop: {
+        auto b = static_cast<Binop*>(e);
+        walk(b->left);
+        walk(b->right);
+        walk(b->attrib);
+        break;
+      }
+      case etexprlist:
+        for (auto eln = static_cast<El*>(e)->begin; eln; eln = eln->next) {
+          walk(eln->e);
+        }
+        break;
+      case etwhile: {
+        auto w = static_cast<While*>(e);
+        walk(w->e1);
+        walk(w->e2);
+        break;
+      }
+      case etifelse: {
+        auto ie = static_cast<IfElse*>(e);
+        walk(ie->e1);
+        walk(ie->e2);
+        walk(ie->e3);
+        break;
+      }
+      case etfor:
+        walk(static_cast<For*>(e)->forloop);
+        break;
+      case etleftassign: {
+        auto la = static_cast<LeftAssign*>(e);
+        if (la->e1->etype == etsymbol) {
+          local(static_cast<Symbol*>(la->e1));
+        }
+        walk(la->e2);
+        break;
+      }
+      case etspecialassign: {
+        // '<<-' targets are never local, but the symbol is read back
+        // as the value of the assignment:
+        auto sa = static_cast<SpecialAssign*>(e);
+        walk(sa->e1);
+        walk(sa->e2);
+        break;
+      }
+      case etrequest:
+        // the request body is evaluated on the remote side:
+        walk(static_cast<Request*>(e)->e1);
+        break;
+      case ettaggedexpr:        // the tag is an argument name, not a variable
+        walk(static_cast<TaggedExpr*>(e)->e);
+        break;
+      case etarg:
+        walk(static_cast<Arg*>(e)->e);
+        break;
+      case etfuncall: {
+        auto fc = static_cast<Funcall*>(e);
+        walk(fc->e);
+        if (fc->el) walk(fc->el);
+        break;
+      }
+      case etcode:
+        walk(static_cast<Code*>(e)->e);
+        break;
+      default:                  // constants, bound variables and nested functions
+        break;
+      }
+    }
+
+    Function* f;
+    std::vector<Symbol*> symbols;
+  };
+
+} // end anonymous namespace
+
+
+void anf::resolveSlots(Function* f) {
+  Resolver res(f);
+  if (f->formlist) {
+    for (auto eln = f->formlist->begin; eln; eln = eln->next) {
+      if (eln->e->etype == etsymbol) {
+        res.local(static_cast<Symbol*>(eln->e));
+      }
+      else if (eln->e->etype == ettaggedexpr) {
+        auto te = static_cast<TaggedExpr*>(eln->e);
+        res.local(te->symb);
+        res.walk(te->e);
+      }
+    }
+  }
+  res.walk(f->body);
+
+  for (auto s : res.symbols) {
+    auto idx = f->localMap.find(s->data);
+    if (idx != f->localMap.end()) {
+      s->slot  = idx->second;
+      s->scope = f;
+    }
+  }
+}
+
+
 static void normTerm(E*& e, El* top, ElNode*& topn, bool doBndVar) {
 #ifdef DEBUG
   cout << "normTerm(" << to_string(*e) << ")" << endl;
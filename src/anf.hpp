@@ -26,6 +26,12 @@
 namespace anf {   
   /// Transform expression 'e' into an ANF (A-normal form) expression.
   void convertToANF(El* el, bool doBndVar=true);
+
+  /// Assign a frame slot to each local variable of the ANF function
+  /// 'f' (formals, targets of '<-' and ANF temporaries) and annotate
+  /// the symbols of its body that refer to them. Nested functions are
+  /// left alone: they are resolved when their own closure is built.
+  void resolveSlots(Function* f);
 }
 
 
@@ -0,0 +1,225 @@
+// (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef APPEND_LOG_HPP
+#define APPEND_LOG_HPP
+
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include "globals.hpp"
+
+
+/// Write-ahead log for the APPEND and APPEND_VECTOR messages. Each
+/// append is recorded with the message payload before it is applied,
+/// so that it can be applied again on startup if the mmapped arrays
+/// didn't make it to disk. Records are written as they come and
+/// synced in groups, either when 'syncBytes' are unsynced or when
+/// 'syncInterval' has elapsed since the last sync, which makes the
+/// cost of durability a fraction of the cost of an 'msync' per
+/// append.
+///
+/// Each record stores the length of the target before the append,
+/// so that a replay can bring the target back to that length and
+/// never applies an append twice.
+///
+/// Record layout:
+///
+///   RecordHeader | payload (padded to 8 bytes)
+
+
+namespace zcore {
+
+  struct AppendLog {
+
+    struct RecordHeader {
+      uint64_t magic;
+      uint64_t type;            ///< Global::MsgType
+      uint64_t len;             ///< payload length
+      uint64_t prelen;          ///< length of the target before the append
+      uint64_t hash;            ///< hash of the above and of the payload
+    };
+
+    static const uint64_t RECORD_MAGIC = 0x5a54534442574131ULL; // "ZTSDBWA1"
+
+    AppendLog(const std::string& filename_p,
+              size_t syncBytes_p,
+              std::chrono::milliseconds syncInterval_p) :
+      filename(filename_p), syncBytes(syncBytes_p), syncInterval(syncInterval_p),
+      fsize(0), unsynced(0), lastSync(std::chrono::steady_clock::now())
+    {
+      fd = open(filename.c_str(), O_RDWR|O_CREAT, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+      if (fd == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot open " + filename);
+      }
+      auto end = lseek(fd, 0, SEEK_END);
+      if (end == -1) {
+        close(fd);
+        throw std::system_error(std::error_code(errno, std::system_category()), "lseek");
+      }
+      fsize = end;
+    }
+
+    AppendLog(const AppendLog&) = delete;
+    AppendLog& operator=(const AppendLog&) = delete;
+
+    ~AppendLog() {
+      try {
+        flush(true);
+      }
+      catch (...) { }
+      close(fd);
+    }
+
+    /// Record an append; to be called before the append is applied.
+    /// The record is written right away and synced when the group
+    /// commit conditions are met.
+    inline void append(Global::MsgType mt, const char* buf, size_t len, uint64_t prelen) {
+      RecordHeader h{RECORD_MAGIC, static_cast<uint64_t>(mt), len, prelen, 0};
+      h.hash = hash(h, buf, len);
+      record.assign(sizeof(h) + pad(len), 0);
+      memcpy(record.data(), &h, sizeof(h));
+      memcpy(record.data() + sizeof(h), buf, len);
+      size_t done = 0;
+      while (done < record.size()) {
+        auto res = pwrite(fd, record.data() + done, record.size() - done, fsize + done);
+        if (res == -1) {
+          if (errno == EINTR) continue;
+          throw std::system_error(std::error_code(errno, std::system_category()), "pwrite");
+        }
+        done += res;
+      }
+      fsize += record.size();
+      unsynced += record.size();
+      if (unsynced >= syncBytes || syncDue()) {
+        flush(true);
+      }
+    }
+
+    /// If 'sync', make the written records durable.
+    inline void flush(bool sync) {
+      if (sync && unsynced) {
+        if (fdatasync(fd) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "fdatasync");
+        }
+        unsynced = 0;
+        lastSync = std::chrono::steady_clock::now();
+      }
+    }
+
+    /// True if there is something not yet durable and the sync
+    /// interval has elapsed.
+    inline bool syncDue() const {
+      return unsynced && std::chrono::steady_clock::now() - lastSync >= syncInterval;
+    }
+
+    /// Size of the log.
+    inline size_t size() const { return fsize; }
+
+    inline std::chrono::milliseconds getSyncInterval() const { return syncInterval; }
+
+    /// Discard the log; to be called once all the appends it contains
+    /// have been synced to their targets.
+    inline void truncate() {
+      if (ftruncate(fd, 0) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "ftruncate");
+      }
+      if (fdatasync(fd) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "fdatasync");
+      }
+      fsize = 0;
+      unsynced = 0;
+    }
+
+    /// Call 'f(mt, buf, len, prelen)' for each valid record in the
+    /// log. Reading stops at the first record that is truncated, has
+    /// an impossible length or fails its hash, i.e. a record that was
+    /// being written during a crash; the log is cut there so that new
+    /// records follow the last valid one. Returns the number of
+    /// records read.
+    template <typename F>
+    size_t replay(F f) {
+      size_t nb = 0;
+      off_t off = 0;
+      std::vector<char> payload;
+      while (static_cast<size_t>(off) + sizeof(RecordHeader) <= fsize) {
+        RecordHeader h;
+        // check 'len' before padding it, which could overflow:
+        if (pread(fd, &h, sizeof(h), off) != sizeof(h) || h.magic != RECORD_MAGIC ||
+            h.len > fsize - off - sizeof(h) || off + sizeof(h) + pad(h.len) > fsize) {
+          break;
+        }
+        payload.resize(h.len);
+        if (pread(fd, payload.data(), h.len, off + sizeof(h)) != static_cast<ssize_t>(h.len)) {
+          break;
+        }
+        auto expected = h.hash;
+        h.hash = 0;
+        if (hash(h, payload.data(), h.len) != expected) {
+          break;
+        }
+        f(static_cast<Global::MsgType>(h.type), payload.data(), h.len, h.prelen);
+        off += sizeof(h) + pad(h.len);
+        ++nb;
+      }
+      if (static_cast<size_t>(off) != fsize) {
+        if (ftruncate(fd, off) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "ftruncate");
+        }
+        fsize = off;
+      }
+      return nb;
+    }
+
+  private:
+    const std::string filename;
+    const size_t syncBytes;
+    const std::chrono::milliseconds syncInterval;
+    int fd;
+    size_t fsize;               ///< bytes written to the file
+    size_t unsynced;            ///< written bytes not yet synced
+    std::chrono::steady_clock::time_point lastSync;
+    std::vector<char> record;   ///< buffer for the record being written
+
+    static inline size_t pad(size_t len) { return (len + 7) & ~static_cast<size_t>(7); }
+
+    static inline uint64_t hash(const RecordHeader& h, const char* p, size_t len) {
+      uint64_t res = 0xcbf29ce484222325ULL; // FNV-1a
+      auto mix = [&res](const char* q, size_t n) {
+        for (size_t i=0; i<n; ++i) {
+          res ^= static_cast<unsigned char>(q[i]);
+          res *= 0x100000001b3ULL;
+        }
+      };
+      mix(reinterpret_cast<const char*>(&h), offsetof(RecordHeader, hash));
+      mix(p, len);
+      return res;
+    }
+  };
+
+} // end namespace zcore
+
+
+#endif
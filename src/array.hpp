@@ -33,6 +33,7 @@
 #include "juice/variant.hpp"
 #include "allocator_factory.hpp"
 #include "vector.hpp"
+#include "columns.hpp"
 #include "string.hpp"
 #include "misc.hpp"
 #include "globals.hpp"
@@ -184,7 +185,8 @@ namespace arr {
     
     
     /// Construct an array from file. Note that the data must have
-    /// been tested to determine typename 'T'.
+    /// been tested to determine typename 'T'. The data vectors are
+    /// only mapped when first accessed, see 'ColumnCache'.
     Array(std::unique_ptr<AllocFactory>&& allocf_p)
       : allocf(std::move(allocf_p))
     {
@@ -193,8 +195,13 @@ namespace arr {
       // grab the data vectors
       auto ncols = dim.size() ? 
         accumulate(dim.begin()+1, dim.end(), 1.0, std::multiplies<idx_type>()) : 0;
-      for (idx_type j=0; j<ncols; ++j) {
-        v.emplace_back(make_unique<Vector<T,O>>(allocf->get(j)));
+      if (ColumnCache::instance().isLazy()) {
+        v.setLazy(allocf.get(), ncols);
+      }
+      else {
+        for (idx_type j=0; j<ncols; ++j) {
+          v.emplace_back(make_unique<Vector<T,O>>(allocf->get(j)));
+        }
       }
       // grab the name vector:
       for (idx_type j=0; j<dim.size(); ++j) {
@@ -866,6 +873,20 @@ namespace arr {
     inline fsys::path getAllocfDirname() const { return allocf->getDirname(); }
     inline bool isPersistent() const { return allocf->isPersistent(); }
 
+    /// Add the memory usage of the vectors of this array to 'u';
+    /// columns that are not mapped are not counted.
+    void addMemUsage(MemUsage& u) const {
+      dim.addMemUsage(u);
+      for (size_t j=0; j<v.size(); ++j) {
+        if (v.isMapped(j)) {
+          v[j]->addMemUsage(u);
+        }
+      }
+      for (auto& nm : names) {
+        nm->names.addMemUsage(u);
+      }
+    }
+
     void msync(bool async) const {
       dim.getAllocator()->msync(async);
       for (auto& col : v) {
@@ -1051,7 +1072,7 @@ namespace arr {
           if (needSwap) {
             // move the columns: 
             for (idx_type k=0; k < cols; ++k) {
-              std::swap(v[srcoff--], v[destoff--]);
+              v.swap(srcoff--, destoff--);
             }
           }
         }
@@ -1117,8 +1138,66 @@ namespace arr {
     }
 
 
+    /// Append the arrays encoded in 'bufs', like 'append' does for
+    /// one, but growing each column only once. Either all the arrays
+    /// are appended or none is. 'offsets' receives the number of bytes
+    /// read from each buffer and 'rows' the number of rows of each.
+    Array& appendBatch(const std::vector<Global::bufptr_pair>& bufs,
+                       std::vector<size_t>& offsets,
+                       std::vector<idx_type>& rows) {
+      if (dim.size() == 0) {
+        throw out_of_range("append on null array not implemented");        
+      }
+      rows.clear();
+      idx_type total = 0;
+      for (const auto& b : bufs) {
+        auto adim = Vector<idx_type>(const_cast<char*>(b.first), b.second);
+        if (!checkdims(dim, adim, 0)) {
+          throw out_of_range("incorrect dimensions for append");
+        }
+        rows.push_back(adim[0]);
+        total += adim[0];
+      }
+
+      offsets.clear();
+      try {
+        for (size_t i=0; i<v.size(); ++i) {
+          v[i]->reserve(dim[0] + total);
+        }
+        for (const auto& b : bufs) {
+          auto adim = Vector<idx_type>(const_cast<char*>(b.first), b.second);
+          size_t offset = sizeof(RawVector<idx_type>) + sizeof(idx_type)*adim.size();
+          for (size_t i=0; i<v.size(); ++i) {
+            offset += v[i]->append(b.first + offset, b.second - offset);
+          }
+          offsets.push_back(offset);
+        }
+      }
+      catch (...) {
+        for (size_t i=0; i<v.size(); ++i) {
+          v[i]->resize(dim[0]);    // stay in a coherent state!
+        }
+        throw;
+      }
+
+      // dimension update at the end, see 'append':
+      names[0]->addafter(Dname(total));
+      setv(dim, 0, dim[0] + total);
+      return *this;
+    }
+
+
+    /// Append the elements of the vector encoded in 'buf', which are
+    /// in column order. Each column is copied in one block and grows
+    /// at most once; either all the columns are appended or none is.
     Array& appendVector(const char* buf, size_t buflen) {
-      auto data = Vector<T,O>(const_cast<char*>(buf), buflen);
+      if (buflen < sizeof(RawVector<T>)) {
+        throw out_of_range("invalid append buffer: too short");
+      }
+      const auto data = Vector<T,O>(const_cast<char*>(buf), buflen);
+      if (buflen < data.getBufferSize()) {
+        throw out_of_range("missing data");
+      }
       // the data has to be a multiple of the number of columns:
       if (v.size() == 0) {
         // figure out if we want to support that...
@@ -1129,10 +1208,16 @@ namespace arr {
         throw out_of_range("appendVector: incorrect vector size");        
       }
       idx_type nrows = data.size() / v.size();
-      idx_type i = 0, j=0;
-      for (auto e : data) {
-        v[i]->push_back(e);
-        if (++j == nrows) { j = 0; ++i; }
+      try {
+        for (size_t i=0; i<v.size(); ++i) {
+          v[i]->append(data.c_ptr() + i*nrows, nrows);
+        }
+      }
+      catch (...) {
+        for (size_t i=0; i<v.size(); ++i) {
+          v[i]->resize(dim[0]);    // stay in a coherent state!
+        }
+        throw;
       }
 
       names[0]->addafter(Dname(nrows));
@@ -1272,7 +1357,7 @@ namespace arr {
     Vector<idx_type> dim;
     // we use unique_ptr below to avoid the copying of 'Vector' or
     // 'Dname' that would otherwise occur on 'vector' resize:
-    vector<unique_ptr<Vector<T,O>>> v;        //! v is a set of cols, v[0], v[1] are the cols
+    Columns<T,O> v;                           //! v is a set of cols, v[0], v[1] are the cols
     vector<unique_ptr<Dname>> names;
 
     std::unique_ptr<AllocFactory> allocf;
@@ -118,18 +118,25 @@ using Invoke     = SElt<etinvoke>;
 using Boundvar   = SElt<etboundvar>;
 
 
+struct Function;
+
 struct Symbol : E {
   Symbol(const string& s, const loc_t& l, bool ref_p=false) : 
-    E(etsymbol, l), data(s), ref(ref_p) { }
+    E(etsymbol, l), data(s), ref(ref_p), slot(-1), scope(nullptr) { }
 
   string data;
   const bool ref;               // is it a reference?
 
+  /// Frame slot of the symbol when it is a local of function 'scope'
+  /// (see 'anf::resolveSlots'); -1 when it must be looked up by name.
+  int slot;
+  const Function* scope;
+
   virtual Symbol* clone() const { return new Symbol(*this); }
   virtual bool operator==(const Symbol& s) const { return data == s.data; }
   ~Symbol() { }
 private:
-  Symbol(const Symbol& e) : E(etsymbol, e.loc), data(e.data), ref(e.ref)  { }
+  Symbol(const Symbol& e) : E(etsymbol, e.loc), data(e.data), ref(e.ref), slot(-1), scope(nullptr) { }
 };
 
 
@@ -458,6 +465,12 @@ struct Function : E {
   El* formlist;
   E* body;
 
+  /// Names of the local variables (formals, '<-' targets and ANF
+  /// temporaries) indexed by frame slot; filled in by
+  /// 'anf::resolveSlots' and not copied by 'clone'.
+  vector<string> locals;
+  map<string, unsigned> localMap;
+
   void processFormlist(map<string, int>& argMap, int& ellipsisPos) {
     ellipsisPos = -1;
     if (formlist) {
@@ -81,6 +81,7 @@ namespace funcs {
   val::Value zts_data(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic);
   val::Value zts_resize(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic);
   val::Value zts_truncate(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic);
+  val::Value zts_reorder(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic);
   val::Value make_vector(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
   val::Value make_matrix(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
   val::Value make_array(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
@@ -138,6 +139,7 @@ namespace funcs {
   val::Value stats_net(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
   val::Value stats_msg(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
   val::Value stats_ctx(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
+  val::Value stats_mem(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
   val::Value info_net(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
   val::Value info_msg(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
   val::Value info_ctx(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic); 
@@ -23,6 +23,7 @@
 #include "valuevar.hpp"
 #include "conversion_funcs.hpp"
 #include "display.hpp"
+#include "config.hpp"
 
 
 // #define DEBUG_BFA
@@ -775,8 +776,20 @@ val::Value funcs::cbind(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic)
 }
 
 
-static std::unique_ptr<arr::AllocFactory> getAllocFactoryZts(const fsys::path& filename) {
+static std::unique_ptr<arr::AllocFactory> getAllocFactoryZts(const fsys::path& filename,
+                                                              bool compress,
+                                                              bool segmented) {
   if (filename.string().size()) {
+    if (compress) {
+      return std::make_unique<arr::ZMmapAllocFactory>(filename, false);
+    }
+    if (segmented) {
+      const auto segsz = get<int64_t>(cfg::cfgmap.get("zts.segment.size"));
+      if (segsz <= 0) {
+        throw std::range_error("zts.segment.size must be positive");
+      }
+      return std::make_unique<arr::SegAllocFactory>(filename, false, segsz);
+    }
     return std::make_unique<arr::MmapAllocFactory>(filename, false);
   }
   else {
@@ -786,16 +799,38 @@ static std::unique_ptr<arr::AllocFactory> getAllocFactoryZts(const fsys::path& f
 
 
 val::Value funcs::make_zts(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic) {
-  enum { IDX, DATA, FILE };
+  enum { IDX, DATA, FILE, COMPRESS, SEGMENTED, CONTAINER };
 
   const auto& tidx = get<val::SpVADT>(val::getVal(v[IDX]));
   const auto& data = get<val::SpVAD>(val::getVal(v[DATA]));
   const auto& filename = fsys::path(std::string(val::get_scalar<arr::zstring>(val::getVal(v[FILE]))));
   const auto& filename_idx = filename.string().size() ? filename / "idx" : filename;
+  const auto compress = val::get_scalar<bool>(val::getVal(v[COMPRESS]));
+  const auto segmented = val::get_scalar<bool>(val::getVal(v[SEGMENTED]));
+  const auto container = val::get_scalar<bool>(val::getVal(v[CONTAINER]));
+  if (compress && segmented) {
+    throw interp::EvalException("'compress' and 'segmented' are mutually exclusive",
+                                val::getLoc(v[SEGMENTED]));
+  }
+  if (container && (compress || segmented)) {
+    throw interp::EvalException("'container' can't be combined with 'compress' or 'segmented'",
+                                val::getLoc(v[CONTAINER]));
+  }
+  if (container && filename.string().empty()) {
+    throw interp::EvalException("container requires a file", val::getLoc(v[CONTAINER]));
+  }
   try {
     unsigned flags = filename.string().size() ? arr::LOCKED: arr::NOFLAGS; // with TMP instead of 0, avoid a copy? LLL
-    auto allocf = getAllocFactoryZts(filename);
-    auto allocf_idx = getAllocFactoryZts(filename_idx);
+    std::unique_ptr<arr::AllocFactory> allocf, allocf_idx;
+    if (container) {
+      auto callocf = std::make_unique<arr::ContainerAllocFactory>(filename, false);
+      allocf_idx = std::make_unique<arr::ContainerAllocFactory>(*callocf, "idx");
+      allocf = std::move(callocf);
+    }
+    else {
+      allocf = getAllocFactoryZts(filename, compress, segmented);
+      allocf_idx = getAllocFactoryZts(filename_idx, compress, segmented);
+    }
     return arr::make_cow<arr::zts>(flags, 
                                    *tidx, 
                                    *data, 
@@ -830,14 +865,84 @@ val::Value funcs::zts_data(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& i
 
 
 
+/// Pick the allocator factory matching the way the columns in
+/// 'dirname' were stored.
+static std::unique_ptr<arr::AllocFactory> getLoadAllocFactory(const fsys::path& dirname,
+                                                              bool readonly,
+                                                              int advice) {
+  if (arr::isCompressedColumn(dirname / "0")) {
+    return std::make_unique<arr::ZMmapAllocFactory>(dirname, true, readonly, advice);
+  }
+  if (arr::isSegmentedColumn(dirname / "0")) {
+    return std::make_unique<arr::SegAllocFactory>(dirname, true, 0, readonly, advice);
+  }
+  return std::make_unique<arr::MmapAllocFactory>(dirname, true, readonly, advice);
+}
+
+
+/// Construct the array of type 'typenumber' stored in 'allocf'.
+static val::Value makeLoadedArray(unsigned typenumber,
+                                  unsigned flags,
+                                  std::unique_ptr<arr::AllocFactory>&& allocf) {
+  // switch on the type number we have to determine which type of array to construct:
+  switch (typenumber) {
+  case TypeNumber<double>::n:
+    return arr::make_cow<val::VArrayD>(flags, std::move(allocf));
+  case TypeNumber<bool>::n:
+    return arr::make_cow<val::VArrayB>(flags, std::move(allocf));
+  case TypeNumber<Global::dtime>::n:
+    return arr::make_cow<val::VArrayDT>(flags, std::move(allocf));
+  case TypeNumber<Global::duration>::n:
+    return arr::make_cow<val::VArrayDUR>(flags, std::move(allocf));
+  case TypeNumber<tz::interval>::n:
+    return arr::make_cow<val::VArrayIVL>(flags, std::move(allocf));
+  case TypeNumber<arr::zstring>::n:
+    return arr::make_cow<val::VArrayS>(flags, std::move(allocf));
+  case TypeNumber<tz::period>::n:
+    return arr::make_cow<val::VArrayPRD>(flags, std::move(allocf));
+  default:
+    throw std::domain_error("unknown type number: " + std::to_string(typenumber));
+  }
+}
+
+
+static int getMadvise(const std::string& advice) {
+  if (advice == "normal")     return MADV_NORMAL;
+  if (advice == "sequential") return MADV_SEQUENTIAL;
+  if (advice == "random")     return MADV_RANDOM;
+  if (advice == "willneed")   return MADV_WILLNEED;
+  return -1;
+}
+
+
 val::Value funcs::load(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic) {
-  const string dirname = val::get_scalar<arr::zstring>(val::getVal(v[0]));
+  enum { FILE, READONLY, ADVICE };
+  const string dirname = val::get_scalar<arr::zstring>(val::getVal(v[FILE]));
+  const auto readonly = val::get_scalar<bool>(val::getVal(v[READONLY]));
+  const auto advice = getMadvise(val::get_scalar<arr::zstring>(val::getVal(v[ADVICE])));
+  if (advice == -1) {
+    throw interp::EvalException("'advice' must be one of \"normal\", \"sequential\", "
+                                "\"random\" or \"willneed\"", val::getLoc(v[ADVICE]));
+  }
+  const unsigned flags = readonly ? arr::READONLY : arr::NOFLAGS;
+  if (arr::isContainer(dirname)) {
+    auto allocf = std::make_unique<arr::ContainerAllocFactory>(dirname, true, readonly, advice);
+    if (allocf->has("idx/0")) {
+      auto allocfidx = std::make_unique<arr::ContainerAllocFactory>(*allocf, "idx");
+      return arr::make_cow<arr::zts>(flags, std::move(allocf), std::move(allocfidx));
+    }
+    if (!allocf->has("0")) {
+      throw range_error("no data in container " + dirname);
+    }
+    const auto typenumber = allocf->readHeader("0").typenumber;
+    return makeLoadedArray(typenumber, flags, std::move(allocf));
+  }
   struct stat st = {0};
   if (stat((fsys::path(dirname) / "idx").c_str(), &st) == 0) {
     auto indexdir = fsys::path(dirname) / "idx";    
-    auto allocfidx = std::make_unique<MmapAllocFactory>(indexdir, true);
-    auto allocfdata = std::make_unique<MmapAllocFactory>(dirname, true);
-    return arr::make_cow<arr::zts>(false, std::move(allocfdata), std::move(allocfidx));
+    auto allocfidx = getLoadAllocFactory(indexdir, readonly, advice);
+    auto allocfdata = getLoadAllocFactory(dirname, readonly, advice);
+    return arr::make_cow<arr::zts>(flags, std::move(allocfdata), std::move(allocfidx));
   }
   // else it's an array:
   else {
@@ -845,41 +950,30 @@ val::Value funcs::load(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic) {
     if (stat(datafilename.c_str(), &st) != 0) {
       throw range_error("no data in directory " + dirname);
     }
-    auto file = fopen(datafilename.c_str(), "rb");
-    if (!file) {
-      throw std::system_error(std::error_code(errno, std::system_category()), 
-                              "cannot fopen "s + datafilename.string());
-    }
     RawVector<double> v;
-    auto res = fread(&v, sizeof(RawVector<double>), 1, file);
-    if (res < 1) {
-      fclose(file);
-      throw std::system_error(std::error_code(errno, std::system_category()), 
-                              "cannot fread "s + datafilename.string());
+    if (arr::isCompressedColumn(datafilename)) {
+      v.typenumber = arr::readCompressedHeader(datafilename).typenumber;
     }
-    fclose(file);
-
-    auto allocf = std::make_unique<MmapAllocFactory>(dirname, true);
-
-    // switch on the type number we have to determine which type of array to construct:
-    switch (v.typenumber) {
-    case TypeNumber<double>::n:
-      return arr::make_cow<val::VArrayD>(false, std::move(allocf));
-    case TypeNumber<bool>::n:
-      return arr::make_cow<val::VArrayB>(false, std::move(allocf));
-    case TypeNumber<Global::dtime>::n:
-      return arr::make_cow<val::VArrayDT>(false, std::move(allocf));
-    case TypeNumber<Global::duration>::n:
-      return arr::make_cow<val::VArrayDUR>(false, std::move(allocf));
-    case TypeNumber<tz::interval>::n:
-      return arr::make_cow<val::VArrayIVL>(false, std::move(allocf));
-    case TypeNumber<arr::zstring>::n:
-      return arr::make_cow<val::VArrayS>(false, std::move(allocf));
-    case TypeNumber<tz::period>::n:
-      return arr::make_cow<val::VArrayPRD>(false, std::move(allocf));
-    default:
-      throw std::domain_error("unknown type number: " + std::to_string(v.typenumber));
+    else if (arr::isSegmentedColumn(datafilename)) {
+      v.typenumber = arr::readSegmentedHeader(datafilename).typenumber;
+    }
+    else {
+      auto file = fopen(datafilename.c_str(), "rb");
+      if (!file) {
+        throw std::system_error(std::error_code(errno, std::system_category()), 
+                                "cannot fopen "s + datafilename.string());
+      }
+      auto res = fread(&v, sizeof(RawVector<double>), 1, file);
+      if (res < 1) {
+        fclose(file);
+        throw std::system_error(std::error_code(errno, std::system_category()), 
+                                "cannot fread "s + datafilename.string());
+      }
+      fclose(file);
     }
+
+    auto allocf = getLoadAllocFactory(dirname, readonly, advice);
+    return makeLoadedArray(v.typenumber, flags, std::move(allocf));
   }
 }
 
@@ -1196,6 +1290,29 @@ val::Value funcs::zts_resize(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
 }
 
 
+val::Value funcs::zts_reorder(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic) {
+  enum { X, WINDOW, LATE };
+  auto& x = get<val::SpZts>(val::getVal(v[X]));
+  const auto window = val::get_scalar<Global::duration>(val::getVal(v[WINDOW]));
+  const auto late = std::string(val::get_scalar<arr::zstring>(val::getVal(v[LATE])));
+  if (window < Global::duration::zero()) {
+    throw interp::EvalException("window cannot be negative", val::getLoc(v[WINDOW]));
+  }
+  arr::zts::LatePolicy policy;
+  if (late == "reject") {
+    policy = arr::zts::LATE_REJECT;
+  }
+  else if (late == "drop") {
+    policy = arr::zts::LATE_DROP;
+  }
+  else {
+    throw interp::EvalException("late must be \"reject\" or \"drop\"", val::getLoc(v[LATE]));
+  }
+  x.get()->setReorder(window, policy); // get() to avoid a copy!
+  return x;
+}
+
+
 val::Value funcs::zts_truncate(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic) {
   enum { X, END };
   auto x = get<val::SpZts>(val::getVal(v[X]));
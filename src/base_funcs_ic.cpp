@@ -17,6 +17,7 @@
 
 
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fstream>
 #include "base_funcs.hpp"
 #include "parser_ctx.hpp"
@@ -75,7 +76,7 @@ val::Value funcs::source(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic)
     static const Null null(yy::missing_loc());
     // 'next->next' below is to get beyond the sentinel Kont
     // introduced by 'applyBuiltin':
-    ic.s->k->next = make_shared<interp::Kont>(interp::Kont{nullptr, 
+    ic.s->k->next = make_pooled<interp::Kont>(interp::Kont{nullptr, 
           &null, 
           ic.s->k->next->next->r,
           buildElChain(el->begin, el->n, ic.s->k->next->next->r, ic.s->k->next->next),
@@ -225,7 +226,7 @@ val::Value funcs::tryCatch(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& i
   cout << "tryCatch: ic.s->k->r->up:" << ic.s->k->r->up << endl;
 #endif
 
-  ic.s->fstack.push_back(std::make_shared<ShadowFrame>(ic.s->k->r->up, nullptr, nullptr, nullptr));
+  ic.s->fstack.push_back(make_pooled<ShadowFrame>(ic.s->k->r->up, nullptr, nullptr, nullptr));
   auto r = ic.s->fstack.back();
 
   // we need to add a copy in the 'up' frame or else they will be
@@ -237,11 +238,11 @@ val::Value funcs::tryCatch(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& i
   // builtin function environment (of tryCatch); we set the escape
   // continuation to catchcode and set the next continuation to expr:
   // put a sentinel continuation to make sure fenv is cleared:
-  auto ksentinel = make_shared<Kont>(Kont{nullptr, nullptr, r, ic.s->k->next, Kont::END});
+  auto ksentinel = make_pooled<Kont>(Kont{nullptr, nullptr, r, ic.s->k->next, Kont::END});
   r->ec = 
-    make_shared<Kont>(Kont{nullptr, catchcode.expr.get(), r, ksentinel, Kont::NORMAL});
+    make_pooled<Kont>(Kont{nullptr, catchcode.expr.get(), r, ksentinel, Kont::NORMAL});
   ic.s->k->next = 
-    make_shared<Kont>(Kont{nullptr, expr.expr.get(), r, ksentinel, Kont::NORMAL});
+    make_pooled<Kont>(Kont{nullptr, expr.expr.get(), r, ksentinel, Kont::NORMAL});
 
   return val::VNull();
 } 
@@ -278,7 +279,7 @@ val::Value funcs::do_call(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic
                                                     "?function", yy::missing_loc()), 
                                          el);
   auto vf = val::VCode(f);
-  ic.s->k->next = make_shared<Kont>(Kont{nullptr, f.get(), ic.s->k->r, ic.s->k->next, Kont::NORMAL});
+  ic.s->k->next = make_pooled<Kont>(Kont{nullptr, f.get(), ic.s->k->r, ic.s->k->next, Kont::NORMAL});
 
   // we need to add 'f' to the next frame so that the expression list
   // gets properly destroyed:
@@ -654,7 +655,7 @@ val::Value funcs::stats_msg(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
   // create a vector with the obtained values:
   auto a = arr::make_cow<arr::Array<double>>
     (false,
-     arr::Vector<arr::idx_type>{12,1},
+     arr::Vector<arr::idx_type>{13,1},
      arr::Vector<double>{
        static_cast<double>(stats.bytesOutREQ),      
        static_cast<double>(stats.bytesOutRSP),      
@@ -667,7 +668,8 @@ val::Value funcs::stats_msg(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
        static_cast<double>(stats.nbAppend),         
        static_cast<double>(stats.nbAppendVector),   
        static_cast<double>(stats.nbAppendFail),         
-       static_cast<double>(stats.nbAppendVectorFail)   
+       static_cast<double>(stats.nbAppendVectorFail),
+       static_cast<double>(stats.nbAppendBatch)
      }, 
      std::vector<arr::Vector<arr::zstring>> {
        {
@@ -682,7 +684,8 @@ val::Value funcs::stats_msg(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
          "nb append", 
          "nb vector append",
          "nb append failed", 
-         "nb vector append failed"
+         "nb vector append failed",
+         "nb append batches"
        }, 
        {"value"}
      }
@@ -700,7 +703,7 @@ val::Value funcs::stats_net(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
   // create a vector with the obtained values:
   auto a = arr::make_cow<arr::Array<double>>
     (false,
-     arr::Vector<arr::idx_type>{13,1}, 
+     arr::Vector<arr::idx_type>{24,1}, 
      arr::Vector<double>{
        static_cast<double>(stats.nbInConn),       
        static_cast<double>(stats.nbOutConn),      
@@ -708,13 +711,25 @@ val::Value funcs::stats_net(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
        static_cast<double>(stats.nbCloseOutConn), 
        static_cast<double>(stats.nbOutBuffers),            
        static_cast<double>(stats.nbSendFail),            
+       static_cast<double>(stats.nbOutQueued),
+       static_cast<double>(stats.nbOutBlocked),
+       static_cast<double>(stats.nbOutDropped),
+       static_cast<double>(stats.nbOutOverflow),
+       static_cast<double>(stats.bytesOutZeroCopy),
+       static_cast<double>(stats.bytesOutSendfile),
        static_cast<double>(stats.nbInBuffers),
        static_cast<double>(stats.nbInBuffersDrop),
        static_cast<double>(stats.bytesTimedOut),  
        static_cast<double>(stats.nbFailInCtx),          
        static_cast<double>(stats.nbReadFail),           
        static_cast<double>(stats.nbInMalformed),
-       static_cast<double>(stats.readbuflistmax)
+       static_cast<double>(stats.readbuflistmax),
+       static_cast<double>(stats.nbDataSignals),
+       static_cast<double>(stats.nbBufPoolHits),
+       static_cast<double>(stats.nbBufPoolMisses),
+       stats.nbBufPoolHits + stats.nbBufPoolMisses == 0 ? 0.0 :
+         static_cast<double>(stats.nbBufPoolHits) / (stats.nbBufPoolHits + stats.nbBufPoolMisses),
+       static_cast<double>(stats.bytesInBufPool)
      }, 
      std::vector<arr::Vector<arr::zstring>> {
        {
@@ -724,13 +739,24 @@ val::Value funcs::stats_net(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
          "nb close outgoing connections",
          "nb outgoing buffers", 
          "nb send fail", 
+         "nb outgoing buffers queued",
+         "nb sends blocked on slow peer",
+         "nb outgoing buffers dropped",
+         "nb slow peers disconnected",
+         "nb bytes sent without copy",
+         "nb bytes sent from files",
          "nb incoming buffers",
          "nb incoming buffers dropped",
          "nb bytes timedout",  
          "nb context not found",
          "nb read fail",      
          "nb incoming segments malformed",
-         "max nb of queued buffers"
+         "max nb of queued buffers",
+         "nb data signals",
+         "nb pooled buffer hits",
+         "nb pooled buffer misses",
+         "pooled buffer hit rate",
+         "bytes in buffer pool"
        }, 
        {"value"}
      }
@@ -749,7 +775,7 @@ val::Value funcs::stats_ctx(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
   // create a vector with the obtained values:
   auto a = arr::make_cow<arr::Array<double>>
     (false,
-     arr::Vector<arr::idx_type>{12,1}, 
+     arr::Vector<arr::idx_type>{13,1}, 
      arr::Vector<double>{
        static_cast<double>(stats.nbOutREQ),         
        static_cast<double>(stats.nbOutRSP),         
@@ -762,7 +788,8 @@ val::Value funcs::stats_ctx(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
        static_cast<double>(stats.bytesInREQ),       
        static_cast<double>(stats.bytesInRSP),       
        static_cast<double>(stats.bytesAppend),      
-       static_cast<double>(stats.bytesAppendVector)
+       static_cast<double>(stats.bytesAppendVector),
+       static_cast<double>(stats.nbAppendCoalesced)
      },
      std::vector<arr::Vector<arr::zstring>> {
        {
@@ -777,7 +804,8 @@ val::Value funcs::stats_ctx(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
          "bytes incoming req",
          "bytes incoming rsp",
          "bytes append", 
-         "bytes vector append"
+         "bytes vector append",
+         "nb append coalesced"
        }, 
        {"value"}
      }
@@ -791,6 +819,152 @@ val::Value funcs::stats_ctx(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx&
 }
 
 
+/// Bytes of the process backed by transparent huge pages, as seen by
+/// the kernel; 0 if unknown.
+static size_t getAnonHugePages() {
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string key;
+  size_t kb;
+  while (smaps >> key) {
+    if (key == "AnonHugePages:" && smaps >> kb) {
+      return kb << 10;
+    }
+    smaps.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+
+/// Page faults of the process since the last reset. The kernel only
+/// counts them per process; per variable, 'stats.mem(x=)' can only
+/// give the faults served by the allocators themselves (compressed and
+/// segmented columns paged in on access).
+static std::pair<double, double> getFaults(bool reset) {
+  static long minbase = 0, majbase = 0;
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == -1) {
+    return {0, 0};
+  }
+  std::pair<double, double> res{ru.ru_minflt - minbase, ru.ru_majflt - majbase};
+  if (reset) {
+    minbase = ru.ru_minflt;
+    majbase = ru.ru_majflt;
+  }
+  return res;
+}
+
+
+template<typename T>
+struct memusage_wrapper {
+  static val::Value f(val::Value& val, const yy::location& loc) {
+    arr::MemUsage u;
+    get<T>(val)->addMemUsage(u);
+    return arr::make_cow<arr::Array<double>>
+      (false,
+       arr::Vector<arr::idx_type>{9,1},
+       arr::Vector<double>{
+         static_cast<double>(u.nbVectors),
+         static_cast<double>(u.bytesUsed),
+         static_cast<double>(u.bytesReserved),
+         static_cast<double>(u.bytesResident),
+         static_cast<double>(u.nbRealloc),
+         static_cast<double>(u.nbRemap),
+         static_cast<double>(u.nbMsync),
+         u.msyncNs / 1e9,
+         static_cast<double>(u.nbFaults)
+       },
+       std::vector<arr::Vector<arr::zstring>> {
+         {
+           "nb vectors",
+           "bytes used",
+           "bytes reserved",
+           "bytes resident",
+           "nb reallocations",
+           "nb remaps",
+           "nb msync",
+           "msync time (s)",
+           "nb faults served"
+         },
+         {"value"}
+       }
+       );
+  }
+};
+
+
+val::Value funcs::stats_mem(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic) {
+  enum { RESET, X };
+  auto reset = val::get_scalar<bool>(val::getVal(v[RESET]));
+  auto& x = val::getVal(v[X]);
+  if (x.which() != val::vt_null) {
+    // the counters of the vectors of 'x':
+    return apply_to_types<memusage_wrapper,
+                          val::vt_double,
+                          val::vt_bool,
+                          val::vt_time,
+                          val::vt_string,
+                          val::vt_duration,
+                          val::vt_zts,
+                          val::vt_interval,
+                          val::vt_period>(x, val::getLoc(v[X]));
+  }
+  auto& hp = arr::HugePages::instance();
+  auto& cc = arr::ColumnCache::instance();
+  auto& ac = arr::AllocCounters::instance();
+  const auto faults = getFaults(reset);
+  // create a vector with the obtained values:
+  auto a = arr::make_cow<arr::Array<double>>
+    (false,
+     arr::Vector<arr::idx_type>{14,1}, 
+     arr::Vector<double>{
+       static_cast<double>(ac.bytes),
+       static_cast<double>(ac.nbRealloc),
+       static_cast<double>(ac.nbRemap),
+       static_cast<double>(ac.nbMsync),
+       ac.msyncNs / 1e9,
+       faults.first,
+       faults.second,
+       static_cast<double>(hp.bytesHugetlb),
+       static_cast<double>(hp.bytesAdvised),
+       static_cast<double>(getAnonHugePages()),
+       static_cast<double>(hp.nbFallback),
+       static_cast<double>(cc.nbMapped),
+       static_cast<double>(cc.nbLoads),
+       static_cast<double>(cc.nbEvictions)
+     },
+     std::vector<arr::Vector<arr::zstring>> {
+       {
+         "bytes allocated",
+         "nb reallocations",
+         "nb remaps",
+         "nb msync",
+         "msync time (s)",
+         "nb minor faults",
+         "nb major faults",
+         "bytes hugetlb",
+         "bytes huge pages advised",
+         "bytes huge pages backed",
+         "nb hugetlb fallback",
+         "nb columns mapped",
+         "nb column loads",
+         "nb column evictions"
+       }, 
+       {"value"}
+     }
+     );
+  if (reset) {
+    ac.nbRealloc = 0;
+    ac.nbRemap = 0;
+    ac.nbMsync = 0;
+    ac.msyncNs = 0;
+    hp.nbFallback = 0;
+    cc.nbLoads = 0;
+    cc.nbEvictions = 0;
+  }
+  return a;
+}
+
+
 // provide a first approximation of the info (can be extended)
 val::Value funcs::info_net(vector<val::VBuiltinG::arg_t>& v, zcore::InterpCtx& ic) {
   // the info we have is:
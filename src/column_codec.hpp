@@ -0,0 +1,296 @@
+// (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef COLUMN_CODEC_HPP
+#define COLUMN_CODEC_HPP
+
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+
+/// Block encoders for the columns of compressed persistent
+/// arrays. Two codecs are provided, both working on 64-bit words:
+///
+/// 1. delta-of-delta, for time indices and durations, where
+///    consecutive deltas are most of the time identical.
+///
+/// 2. XOR of consecutive values (as described in the Gorilla paper),
+///    for doubles, where consecutive values share sign, exponent and
+///    high mantissa bits.
+///
+/// Each block is self contained (the first value is stored in full),
+/// so any block can be decoded without looking at the ones before it.
+
+
+namespace arr {
+
+  namespace codec {
+
+    enum Type : uint64_t { NONE = 0, DOD = 1, XOR = 2 };
+
+    /// Number of elements in a block. A block is the unit of
+    /// decoding and of rewrite on flush.
+    const size_t BLOCKSZ = 4096;
+
+    struct BitWriter {
+      BitWriter(std::vector<char>& buf_p) : buf(buf_p), acc(0), nacc(0) { }
+
+      inline void put(uint64_t bits, unsigned nb) {
+        while (nb) {
+          unsigned take = std::min(nb, 64 - nacc);
+          uint64_t chunk = take == 64 ? bits : (bits >> (nb - take)) & ((1ULL << take) - 1);
+          acc = take == 64 ? chunk : (acc << take) | chunk;
+          nacc += take;
+          nb   -= take;
+          if (nacc == 64) {
+            flushWord();
+          }
+        }
+      }
+
+      /// Write out the partially filled last word.
+      inline void finish() {
+        if (nacc) {
+          acc <<= 64 - nacc;
+          flushWord();
+        }
+      }
+
+    private:
+      inline void flushWord() {
+        auto off = buf.size();
+        buf.resize(off + sizeof(uint64_t));
+        memcpy(buf.data() + off, &acc, sizeof(uint64_t));
+        acc = 0;
+        nacc = 0;
+      }
+
+      std::vector<char>& buf;
+      uint64_t acc;
+      unsigned nacc;
+    };
+
+    struct BitReader {
+      BitReader(const char* p_p, size_t len_p) : p(p_p), len(len_p), pos(0), acc(0), nacc(0) { }
+
+      inline uint64_t get(unsigned nb) {
+        uint64_t res = 0;
+        while (nb) {
+          if (!nacc) {
+            if (pos + sizeof(uint64_t) > len) {
+              throw std::out_of_range("compressed block truncated");
+            }
+            memcpy(&acc, p + pos, sizeof(uint64_t));
+            pos += sizeof(uint64_t);
+            nacc = 64;
+          }
+          unsigned take = std::min(nb, nacc);
+          uint64_t chunk = take == 64 ? acc : (acc >> (64 - take));
+          acc = take == 64 ? 0 : acc << take;
+          nacc -= take;
+          res = take == 64 ? chunk : (res << take) | chunk;
+          nb -= take;
+        }
+        return res;
+      }
+
+    private:
+      const char* p;
+      size_t len;
+      size_t pos;
+      uint64_t acc;
+      unsigned nacc;
+    };
+
+    inline uint64_t zigzag(int64_t i)  { return (static_cast<uint64_t>(i) << 1) ^ (i >> 63); }
+    inline int64_t unzigzag(uint64_t u) { return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1); }
+
+    /// Delta-of-delta encoding of 'n' 64-bit integers. The buckets
+    /// are the ones of the Gorilla paper, except that the last one
+    /// holds a full word since we deal with nanosecond timestamps.
+    inline void encodeDod(const int64_t* v, size_t n, std::vector<char>& out) {
+      BitWriter w(out);
+      if (!n) { w.finish(); return; }
+      w.put(static_cast<uint64_t>(v[0]), 64);
+      int64_t prevdelta = 0;
+      for (size_t i=1; i<n; ++i) {
+        int64_t delta = v[i] - v[i-1];
+        uint64_t dod = zigzag(delta - prevdelta);
+        if (dod == 0) {
+          w.put(0x0, 1);
+        }
+        else if (dod < (1ULL << 7)) {
+          w.put(0x2, 2);  w.put(dod, 7);
+        }
+        else if (dod < (1ULL << 9)) {
+          w.put(0x6, 3);  w.put(dod, 9);
+        }
+        else if (dod < (1ULL << 12)) {
+          w.put(0xe, 4);  w.put(dod, 12);
+        }
+        else if (dod < (1ULL << 32)) {
+          w.put(0x1e, 5); w.put(dod, 32);
+        }
+        else {
+          w.put(0x1f, 5); w.put(dod, 64);
+        }
+        prevdelta = delta;
+      }
+      w.finish();
+    }
+
+    inline void decodeDod(const char* p, size_t len, int64_t* v, size_t n) {
+      if (!n) return;
+      BitReader r(p, len);
+      v[0] = static_cast<int64_t>(r.get(64));
+      int64_t prevdelta = 0;
+      for (size_t i=1; i<n; ++i) {
+        uint64_t dod = 0;
+        if (r.get(1) == 0) {
+          dod = 0;
+        }
+        else if (r.get(1) == 0) {
+          dod = r.get(7);
+        }
+        else if (r.get(1) == 0) {
+          dod = r.get(9);
+        }
+        else if (r.get(1) == 0) {
+          dod = r.get(12);
+        }
+        else if (r.get(1) == 0) {
+          dod = r.get(32);
+        }
+        else {
+          dod = r.get(64);
+        }
+        int64_t delta = prevdelta + unzigzag(dod);
+        v[i] = v[i-1] + delta;
+        prevdelta = delta;
+      }
+    }
+
+    inline unsigned clz64(uint64_t x) { return x ? __builtin_clzll(x) : 64; }
+    inline unsigned ctz64(uint64_t x) { return x ? __builtin_ctzll(x) : 64; }
+
+    /// XOR encoding of 'n' doubles, taken as 64-bit words.
+    inline void encodeXor(const uint64_t* v, size_t n, std::vector<char>& out) {
+      BitWriter w(out);
+      if (!n) { w.finish(); return; }
+      w.put(v[0], 64);
+      unsigned prevlead = 65, prevtrail = 0; // 65: no window defined yet
+      for (size_t i=1; i<n; ++i) {
+        uint64_t x = v[i] ^ v[i-1];
+        if (x == 0) {
+          w.put(0x0, 1);
+          continue;
+        }
+        unsigned lead  = std::min(clz64(x), 31u); // 5 bits to encode
+        unsigned trail = ctz64(x);
+        if (prevlead != 65 && lead >= prevlead && trail >= prevtrail) {
+          // reuse the previous window:
+          w.put(0x2, 2);
+          w.put(x >> prevtrail, 64 - prevlead - prevtrail);
+        }
+        else {
+          unsigned meaningful = 64 - lead - trail; // in [1, 64]
+          w.put(0x3, 2);
+          w.put(lead, 5);
+          w.put(meaningful - 1, 6);
+          w.put(x >> trail, meaningful);
+          prevlead  = lead;
+          prevtrail = trail;
+        }
+      }
+      w.finish();
+    }
+
+    inline void decodeXor(const char* p, size_t len, uint64_t* v, size_t n) {
+      if (!n) return;
+      BitReader r(p, len);
+      v[0] = r.get(64);
+      unsigned prevlead = 0, prevtrail = 0;
+      for (size_t i=1; i<n; ++i) {
+        if (r.get(1) == 0) {
+          v[i] = v[i-1];
+        }
+        else if (r.get(1) == 0) {
+          uint64_t x = r.get(64 - prevlead - prevtrail) << prevtrail;
+          v[i] = v[i-1] ^ x;
+        }
+        else {
+          unsigned lead = r.get(5);
+          unsigned meaningful = r.get(6) + 1;
+          unsigned trail = 64 - lead - meaningful;
+          uint64_t x = r.get(meaningful) << trail;
+          v[i] = v[i-1] ^ x;
+          prevlead  = lead;
+          prevtrail = trail;
+        }
+      }
+    }
+
+    /// Encode 'n' elements of size 'elemsz' starting at 'v' and
+    /// append the result to 'out'.
+    inline void encode(Type t, const void* v, size_t n, size_t elemsz, std::vector<char>& out) {
+      switch (t) {
+      case DOD:
+        encodeDod(static_cast<const int64_t*>(v), n, out);
+        break;
+      case XOR:
+        encodeXor(static_cast<const uint64_t*>(v), n, out);
+        break;
+      case NONE: {
+        auto off = out.size();
+        out.resize(off + n*elemsz);
+        memcpy(out.data() + off, v, n*elemsz);
+        break;
+      }
+      default:
+        throw std::domain_error("unknown codec: " + std::to_string(t));
+      }
+    }
+
+    inline void decode(Type t, const char* p, size_t len, void* v, size_t n, size_t elemsz) {
+      switch (t) {
+      case DOD:
+        decodeDod(p, len, static_cast<int64_t*>(v), n);
+        break;
+      case XOR:
+        decodeXor(p, len, static_cast<uint64_t*>(v), n);
+        break;
+      case NONE:
+        if (len < n*elemsz) {
+          throw std::out_of_range("compressed block truncated");
+        }
+        memcpy(v, p, n*elemsz);
+        break;
+      default:
+        throw std::domain_error("unknown codec: " + std::to_string(t));
+      }
+    }
+
+  } // end namespace codec
+
+} // end namespace arr
+
+
+#endif
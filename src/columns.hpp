@@ -0,0 +1,283 @@
+// (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef COLUMNS_HPP
+#define COLUMNS_HPP
+
+
+#include <set>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include "allocator_factory.hpp"
+#include "vector_base.hpp"
+
+
+/// Lazy mapping of the columns of persistent arrays. When an array is
+/// loaded from disk its columns are only mapped on first access, so
+/// that a 'load' costs the same whatever the number of columns and a
+/// query only pays for the columns it touches. The number of columns
+/// mapped at any one time is kept under a budget by unmapping the
+/// least recently used ones.
+///
+/// Unmapping a column destroys its 'Vector', so it can't be done while
+/// a reference to it might be held: 'ColumnCache::trim' is only called
+/// between two evaluation steps of the interpreter. Within a step the
+/// budget can be exceeded.
+
+
+namespace arr {
+
+  struct LazyColumnsBase {
+    typedef std::tuple<uint64_t, LazyColumnsBase*, size_t> Use; ///< last use, owner, column
+
+    virtual void getMapped(std::vector<Use>& uses) const = 0;
+    virtual void evict(size_t j) = 0;
+    virtual ~LazyColumnsBase() { }
+  };
+
+
+  /// Registry of the lazily mapped columns and LRU policy. Recency is
+  /// measured in epochs, an epoch being the time between two calls to
+  /// 'trim', which keeps the cost of an access to a single store.
+  struct ColumnCache {
+    static inline ColumnCache& instance() {
+      static ColumnCache cache;
+      return cache;
+    }
+
+    /// A budget of 0 disables lazy mapping altogether.
+    inline void configure(size_t budget_p) { budget = budget_p; }
+    inline bool isLazy() const { return budget > 0; }
+    inline size_t getBudget() const { return budget; }
+    inline uint64_t now() const { return epoch; }
+
+    inline void add(LazyColumnsBase* c)    { lazies.insert(c); }
+    inline void remove(LazyColumnsBase* c) { lazies.erase(c); }
+
+    /// Unmap the least recently used columns until the budget is
+    /// met, and start a new epoch.
+    inline void trim() {
+      ++epoch;
+      if (!budget || nbMapped <= budget) {
+        return;
+      }
+      std::vector<LazyColumnsBase::Use> uses;
+      uses.reserve(nbMapped);
+      for (auto c : lazies) {
+        c->getMapped(uses);
+      }
+      const size_t nb = uses.size() > budget ? uses.size() - budget : 0;
+      std::partial_sort(uses.begin(), uses.begin() + nb, uses.end());
+      for (size_t i=0; i<nb; ++i) {
+        std::get<1>(uses[i])->evict(std::get<2>(uses[i]));
+      }
+    }
+
+    size_t nbMapped;            ///< lazy columns currently mapped
+    size_t nbLoads;             ///< lazy columns mapped since start
+    size_t nbEvictions;         ///< lazy columns unmapped by 'trim'
+
+  private:
+    ColumnCache() : nbMapped(0), nbLoads(0), nbEvictions(0), budget(4096), epoch(0) { }
+    std::set<LazyColumnsBase*> lazies;
+    size_t budget;
+    uint64_t epoch;
+  };
+
+
+  /// The columns of an 'Array'. Behaves as a vector of
+  /// 'unique_ptr<Vector>', but if made lazy with 'setLazy' an element
+  /// is mapped from the allocator factory on access.
+  template <typename T, typename O>
+  struct Columns : LazyColumnsBase {
+    typedef std::unique_ptr<Vector<T,O>> value_type;
+    typedef typename std::vector<value_type>::iterator iterator;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+    Columns() : allocf(nullptr) { }
+
+    Columns(Columns&& o) : cols(std::move(o.cols)), lastUse(std::move(o.lastUse)),
+                           files(std::move(o.files)), allocf(o.allocf) {
+      if (allocf) {
+        ColumnCache::instance().remove(&o);
+        ColumnCache::instance().add(this);
+        o.allocf = nullptr;
+      }
+    }
+
+    Columns& operator=(Columns&& o) {
+      release();
+      cols = std::move(o.cols);
+      lastUse = std::move(o.lastUse);
+      files = std::move(o.files);
+      allocf = o.allocf;
+      if (allocf) {
+        ColumnCache::instance().remove(&o);
+        ColumnCache::instance().add(this);
+        o.allocf = nullptr;
+      }
+      return *this;
+    }
+
+    Columns(const Columns&) = delete;
+    Columns& operator=(const Columns&) = delete;
+
+    ~Columns() { release(); }
+
+    /// Have 'ncols' columns that are mapped from 'allocf_p' on first
+    /// access; 'allocf_p' must outlive this object, or the next call
+    /// to 'setLazy'.
+    void setLazy(const AllocFactory* allocf_p, size_t ncols) {
+      release();
+      cols.clear();
+      cols.resize(ncols);
+      lastUse.assign(ncols, 0);
+      files.resize(ncols);
+      std::iota(files.begin(), files.end(), 0);
+      allocf = allocf_p;
+      ColumnCache::instance().add(this);
+    }
+
+    inline value_type& operator[](size_t j) { return get(j); }
+    inline const value_type& operator[](size_t j) const { return get(j); }
+
+    inline size_t size() const { return cols.size(); }
+    inline bool empty() const { return cols.empty(); }
+    inline void reserve(size_t n) {
+      cols.reserve(n);
+      if (allocf) {
+        lastUse.reserve(n);
+        files.reserve(n);
+      }
+    }
+    inline void resize(size_t n) {
+      if (allocf) {
+        for (size_t j=n; j<cols.size(); ++j) {
+          if (cols[j]) --ColumnCache::instance().nbMapped;
+        }
+        lastUse.resize(n, 0);
+        for (size_t j=files.size(); j<n; ++j) {
+          files.push_back(j);
+        }
+        files.resize(n);
+      }
+      cols.resize(n);
+    }
+
+    /// Exchange columns 'i' and 'j'. A column that isn't mapped moves
+    /// with the allocation it is mapped from.
+    inline void swap(size_t i, size_t j) {
+      std::swap(cols[i], cols[j]);
+      if (allocf) {
+        std::swap(lastUse[i], lastUse[j]);
+        std::swap(files[i], files[j]);
+      }
+    }
+
+    inline void push_back(value_type&& e) {
+      cols.push_back(std::move(e));
+      added();
+    }
+    template <typename... Args>
+    inline void emplace_back(Args&&... args) {
+      cols.emplace_back(std::forward<Args>(args)...);
+      added();
+    }
+
+    inline value_type& back() { return get(cols.size() - 1); }
+    inline const value_type& back() const { return (*this)[cols.size() - 1]; }
+
+    // iterating maps all the columns:
+    inline iterator begin() { mapAll(); return cols.begin(); }
+    inline iterator end()   { return cols.end(); }
+    inline const_iterator begin() const { mapAll(); return cols.begin(); }
+    inline const_iterator end()   const { return cols.end(); }
+
+    inline bool isLazy() const { return allocf != nullptr; }
+    inline bool isMapped(size_t j) const { return cols[j] != nullptr; }
+
+    // LazyColumnsBase:
+    virtual void getMapped(std::vector<Use>& uses) const {
+      for (size_t j=0; j<cols.size(); ++j) {
+        if (cols[j]) uses.emplace_back(lastUse[j], const_cast<Columns*>(this), j);
+      }
+    }
+    virtual void evict(size_t j) {
+      if (cols[j]) {
+        cols[j].reset();
+        --ColumnCache::instance().nbMapped;
+        ++ColumnCache::instance().nbEvictions;
+      }
+    }
+
+  private:
+    // mutable as mapping a column of a const array is not a modification:
+    mutable std::vector<value_type> cols;
+    mutable std::vector<uint64_t> lastUse; ///< epoch of the last access, only when lazy
+    std::vector<size_t> files;             ///< allocation of each column in 'allocf', only when lazy
+    const AllocFactory* allocf;            ///< non null when lazy
+
+    inline value_type& get(size_t j) const {
+      if (allocf) {
+        auto& cache = ColumnCache::instance();
+        if (!cols[j]) {
+          cols[j] = std::make_unique<Vector<T,O>>(allocf->get(files[j]));
+          ++cache.nbMapped;
+          ++cache.nbLoads;
+        }
+        lastUse[j] = cache.now();
+      }
+      return cols[j];
+    }
+
+    inline void added() {
+      if (allocf) {
+        lastUse.push_back(ColumnCache::instance().now());
+        files.push_back(cols.size() - 1);
+        if (cols.back()) ++ColumnCache::instance().nbMapped;
+      }
+    }
+
+    inline void mapAll() const {
+      for (size_t j=0; j<cols.size(); ++j) {
+        get(j);
+      }
+    }
+
+    /// Stop being lazy; the columns stay as they are.
+    inline void release() {
+      if (allocf) {
+        auto& cache = ColumnCache::instance();
+        cache.remove(this);
+        for (auto& c : cols) {
+          if (c) --cache.nbMapped;
+        }
+        allocf = nullptr;
+        lastUse.clear();
+        files.clear();
+      }
+    }
+  };
+
+} // end namespace arr
+
+
+#endif
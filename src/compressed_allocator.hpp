@@ -0,0 +1,720 @@
+// (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef COMPRESSED_ALLOCATOR_HPP
+#define COMPRESSED_ALLOCATOR_HPP
+
+
+#include <vector>
+#include <algorithm>
+#include <list>
+#include <deque>
+#include "vector.hpp"
+#include "column_codec.hpp"
+
+
+/// Allocator for compressed persistent columns. The file holds the
+/// column encoded in blocks of 'codec::BLOCKSZ' elements, and an
+/// index of the blocks that is kept in memory. The column is handed
+/// out as an anonymous mapping with no access, so 'Vector' and
+/// everything above it is oblivious of the compression: the first
+/// access to a page faults, and the fault handler decodes the blocks
+/// the page overlaps (through a small cache of decoded blocks) and
+/// makes the page readable. A write to a readable page faults again
+/// and marks the page as written. Pages that were not written can be
+/// dropped again, so only 'maxResident' bytes of a column that is
+/// read are in memory at any time.
+///
+/// The blocks holding written pages, and the blocks whose number of
+/// elements changed, are encoded again on 'msync' and on destruction.
+/// A flush never overwrites what the header refers to: the blocks
+/// and a new index are appended to the file, synced, and only then
+/// is the header rewritten, so a crash leaves either the old or the
+/// new column. When more than half of the file is dead the live
+/// blocks are copied to a temporary file that is renamed over it.
+///
+/// File layout:
+///
+///   ZFileHeader | block | ... | index | block | ... | index
+///
+/// where the last index is the one 'ZFileHeader::indexoff' points to.
+
+
+namespace arr {
+
+  const uint64_t ZCOLUMN_MAGIC   = 0x5a54534442435a31ULL; // "ZTSDBCZ1"
+  const uint64_t ZCOLUMN_VERSION = 2;
+
+  /// Default bound on the bytes of a column that are in memory, not
+  /// counting the pages written since the last flush.
+  const size_t ZMAX_RESIDENT = 32 << 20;
+  /// Number of decoded blocks kept by a column.
+  const size_t ZBLOCK_CACHE = 8;
+  /// Dead bytes under which a column file is never compacted.
+  const size_t ZCOMPACT_MIN = 1 << 20;
+
+  struct ZFileHeader {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t codec;
+    uint64_t elemsz;
+    uint64_t typenumber;
+    uint64_t n;
+    uint64_t ordered;
+    uint64_t nblocks;
+    uint64_t indexoff;          ///< offset of the block index
+  };
+
+  /// Entry of the block index.
+  struct ZBlockEntry {
+    uint64_t off;               ///< offset of the encoded block
+    uint64_t nelts;
+    uint64_t nbytes;
+  };
+
+  /// Return the codec to use for a given vector type number, and its
+  /// element size. Throws for types that can't be stored in a
+  /// compressed column.
+  inline codec::Type getCodec(size_t typenumber, size_t& elemsz) {
+    switch (typenumber) {
+    case TypeNumber<double>::n:
+      elemsz = sizeof(double);
+      return codec::XOR;
+    case TypeNumber<Global::dtime>::n:
+      elemsz = sizeof(Global::dtime);
+      return codec::DOD;
+    case TypeNumber<Global::duration>::n:
+      elemsz = sizeof(Global::duration);
+      return codec::DOD;
+    case TypeNumber<bool>::n:
+      elemsz = sizeof(bool);
+      return codec::NONE;
+    default:
+      throw std::domain_error("type number " + std::to_string(typenumber) +
+                              " not supported in compressed column");
+    }
+  }
+
+  /// Check if a file holds a compressed column.
+  inline bool isCompressedColumn(const fsys::path& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return false;
+    }
+    uint64_t magic = 0;
+    auto res = read(fd, &magic, sizeof(magic));
+    close(fd);
+    return res == sizeof(magic) && magic == ZCOLUMN_MAGIC;
+  }
+
+  /// Read the header of a compressed column.
+  inline ZFileHeader readCompressedHeader(const fsys::path& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::system_error(std::error_code(errno, std::system_category()),
+                              "cannot open "s + filename.c_str());
+    }
+    ZFileHeader h;
+    auto res = pread(fd, &h, sizeof(h), 0);
+    close(fd);
+    if (res != sizeof(h) || h.magic != ZCOLUMN_MAGIC) {
+      throw std::range_error(filename.string() + " is not a compressed column");
+    }
+    return h;
+  }
+
+
+
+  struct zallocator : baseallocator {
+    /// With 'readonly_p' the column is never written back.
+    zallocator(const fsys::path& filename_p, bool readonly_p=false,
+               size_t maxResident=ZMAX_RESIDENT)
+      : t(nullptr), n(0), reserved(0), fd(-1), filename(filename_p),
+        pagesz(sysconf(_SC_PAGESIZE)), readonly(readonly_p),
+        maxPages(std::max(maxResident / pagesz, size_t(2))), npresent(0), pinned(false),
+        ctype(codec::NONE), elemsz(1), filen(0), fileEnd(sizeof(ZFileHeader)),
+        committed(false) { }
+
+    inline void* initialize() {
+      std::lock_guard<std::recursive_mutex> lock(FaultPager::instance().mutex());
+      fd = open(filename.c_str(), readonly ? O_RDONLY : O_RDWR);
+      if (fd == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot open "s + filename.c_str());
+      }
+      try {
+        auto h = readIndex();
+        reserve(HDR + h.n * h.elemsz);
+        FaultPager::instance().add(this);
+        materialise(0);
+        if (!readonly) {
+          makeWritten(0, 1);
+        }
+        auto raw = static_cast<RawVector<uint64_t>*>(t);
+        raw->typenumber = h.typenumber;
+        raw->n = h.n;
+        raw->ordered = h.ordered;
+        page0.assign(static_cast<char*>(t), static_cast<char*>(t) + pagesz);
+        if (readonly && mprotect(t, pagesz, PROT_READ) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "mprotect");
+        }
+      }
+      catch (...) {
+        // don't let the destructor flush a column that isn't there:
+        release();
+        close(fd);
+        fd = -1;
+        throw;
+      }
+      return t;
+    }
+
+    inline size_t size() const { return n; }
+
+    inline void* allocate(size_t sz) {
+      std::lock_guard<std::recursive_mutex> lock(FaultPager::instance().mutex());
+      checkWritable();
+      fd = open(filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+      if (fd == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "open");
+      }
+      reserve(sz);
+      FaultPager::instance().add(this);
+      makeWritten(0, state.size());
+      return t;
+    }
+
+    inline void deallocate(void* address, size_t) {
+      std::lock_guard<std::recursive_mutex> lock(FaultPager::instance().mutex());
+      checkWritable();
+      if (t) {
+        release();
+        if (remove(filename.c_str()) != 0) {
+          throw std::system_error(std::error_code(errno, std::system_category()),
+                                  "can't remove "s + filename.c_str());
+        }
+      }
+    }
+
+    inline void* reallocate(void* old_address, size_t new_size) {
+      std::lock_guard<std::recursive_mutex> lock(FaultPager::instance().mutex());
+      if (old_address != t) {
+        throw std::out_of_range("zallocator can't reallocate at an offset");
+      }
+      checkWritable();
+      size_t new_n = roundToPage(new_size);
+      countRealloc(new_n != n);
+      if (new_n > reserved) {
+        relocate(std::max(new_n, 2 * reserved));
+      }
+      if (new_n > n) {
+        const size_t from = state.size();
+        state.resize(new_n / pagesz, ABSENT);
+        makeWritten(from, state.size());
+      }
+      else if (new_n < n) {
+        for (size_t i=new_n / pagesz; i<state.size(); ++i) {
+          if (state[i] != ABSENT) {
+            --npresent;
+          }
+        }
+        auto p = static_cast<char*>(t) + new_n;
+        madvise(p, n - new_n, MADV_DONTNEED);
+        if (mprotect(p, n - new_n, PROT_NONE) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "mprotect");
+        }
+        state.resize(new_n / pagesz);
+      }
+      n = new_n;
+      setBytes(n);
+      return t;
+    }
+
+    inline virtual void msync(bool async) const {
+      if (readonly) {
+        return;
+      }
+      MsyncTimer timer(*this);
+      const_cast<zallocator*>(this)->flush(!async);
+    }
+
+    inline virtual size_t resident() const { return residentBytes(t, n); }
+
+    inline virtual bool isPaged() const { return true; }
+
+    inline virtual bool isReadOnly() const { return readonly; }
+
+    virtual ~zallocator() {
+      std::lock_guard<std::recursive_mutex> lock(FaultPager::instance().mutex());
+      if (t && !readonly) {
+        try {
+          flush(true);
+        }
+        catch (...) {
+          release();
+          close(fd);
+          throw;
+        }
+      }
+      release();
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+
+    /// Bring the page in, or record that it is written to.
+    inline virtual bool onFault(const char* addr) {
+      auto base = static_cast<const char*>(t);
+      if (!t || addr < base || addr >= base + n) {
+        return false;
+      }
+      const size_t i = (addr - base) / pagesz;
+      try {
+        if (state[i] == ABSENT) {
+          materialise(i);
+          return true;
+        }
+        if (state[i] == CLEAN && !readonly) {
+          makeWritten(i, i + 1);
+          return true;
+        }
+      }
+      catch (...) {
+        // nothing can be thrown from here; the access faults again
+        // and the process gets the default action.
+      }
+      return false;
+    }
+
+  private:
+    enum PageState : char { ABSENT, CLEAN, WRITTEN };
+
+    /// Size of the 'RawVector' header that precedes the elements.
+    static const size_t HDR = sizeof(RawVector<uint64_t>);
+
+    void* t;
+    size_t n;                   ///< bytes the column can use
+    size_t reserved;            ///< bytes of address space reserved at 't'
+    int fd;
+    const fsys::path filename;
+    const size_t pagesz;
+    const bool readonly;
+    const size_t maxPages;      ///< bound on the pages in memory
+    size_t npresent;            ///< pages in memory
+    bool pinned;                ///< no page is dropped while set
+    std::vector<char> state;    ///< 'PageState' of each page of [t, t+n)
+    std::vector<size_t> written;///< pages made writable since the last flush
+    std::deque<size_t> fifo;    ///< pages in memory, in order of arrival
+    std::vector<char> page0;    ///< first page as of the last flush
+
+    codec::Type ctype;
+    size_t elemsz;
+    std::vector<ZBlockEntry> blocks; ///< index of the blocks in the file
+    size_t filen;               ///< number of elements in the file
+    off_t fileEnd;              ///< end of the last index in the file
+    bool committed;             ///< the file has a valid header
+    std::list<std::pair<size_t, std::vector<char>>> cache; ///< decoded blocks, most recent first
+
+    inline void checkWritable() const {
+      if (readonly) {
+        throw std::range_error(filename.string() + " is mapped read-only");
+      }
+    }
+
+    inline char* data() const { return static_cast<char*>(t) + HDR; }
+
+    inline size_t roundToPage(size_t sz) const {
+      return sz ? (sz + pagesz - 1) / pagesz * pagesz : pagesz;
+    }
+
+    /// Read and check the header and the block index.
+    ZFileHeader readIndex() {
+      ZFileHeader h;
+      struct stat st;
+      if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != ZCOLUMN_MAGIC ||
+          fstat(fd, &st) == -1) {
+        throw std::range_error(filename.string() + " is not a compressed column");
+      }
+      if (h.version != ZCOLUMN_VERSION) {
+        throw std::range_error(filename.string() + ": unsupported compressed column version");
+      }
+      size_t es;
+      ctype = getCodec(h.typenumber, es);
+      const uint64_t fsize = st.st_size;
+      if (ctype != h.codec || es != h.elemsz || h.indexoff < sizeof(h) || h.indexoff > fsize ||
+          h.nblocks > (fsize - h.indexoff) / sizeof(ZBlockEntry)) {
+        throw std::range_error(filename.string() + ": corrupted compressed column");
+      }
+      elemsz = es;
+      blocks.resize(h.nblocks);
+      const size_t len = h.nblocks * sizeof(ZBlockEntry);
+      if (pread(fd, blocks.data(), len, h.indexoff) != static_cast<ssize_t>(len)) {
+        throw std::range_error(filename.string() + ": corrupted compressed column");
+      }
+      uint64_t rows = 0;
+      for (size_t k=0; k<blocks.size(); ++k) {
+        const auto& b = blocks[k];
+        if (b.off < sizeof(h) || b.off > h.indexoff || b.nbytes > h.indexoff - b.off ||
+            b.nelts > codec::BLOCKSZ || (b.nelts != codec::BLOCKSZ && k + 1 != blocks.size())) {
+          throw std::range_error(filename.string() + ": corrupted compressed column");
+        }
+        rows += b.nelts;
+      }
+      if (rows != h.n) {
+        throw std::range_error(filename.string() + ": corrupted compressed column");
+      }
+      filen = h.n;
+      fileEnd = h.indexoff + len;
+      committed = true;
+      return h;
+    }
+
+    /// Reserve address space for at least 'sz' bytes, none of which
+    /// is accessible yet.
+    inline void reserve(size_t sz) {
+      n = roundToPage(sz);
+      reserved = std::max(2 * n, size_t(1) << 30);
+      t = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+      if (t == MAP_FAILED) {
+        t = nullptr;
+        throw std::system_error(std::error_code(errno, std::system_category()), "mmap (PRIVATE|ANON)");
+      }
+      state.assign(n / pagesz, ABSENT);
+      setBytes(n);
+    }
+
+    /// Move the pages to a larger reservation.
+    void relocate(size_t new_reserved) {
+      auto new_t = mmap(NULL, new_reserved, PROT_NONE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+      if (new_t == MAP_FAILED) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mmap (PRIVATE|ANON)");
+      }
+      for (size_t i=0; i<state.size(); ++i) {
+        if (state[i] != ABSENT &&
+            mremap(static_cast<char*>(t) + i*pagesz, pagesz, pagesz, MREMAP_MAYMOVE|MREMAP_FIXED,
+                   static_cast<char*>(new_t) + i*pagesz) == MAP_FAILED) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "mremap");
+        }
+      }
+      munmap(t, reserved);
+      t = new_t;
+      reserved = new_reserved;
+    }
+
+    /// Unmap the column and forget its pages.
+    void release() {
+      FaultPager::instance().remove(this);
+      if (t) {
+        munmap(t, reserved);
+      }
+      t = nullptr;
+      n = reserved = npresent = 0;
+      state.clear();
+      written.clear();
+      fifo.clear();
+      cache.clear();
+      setBytes(0);
+    }
+
+    /// Give write access to the pages [from, to).
+    void makeWritten(size_t from, size_t to) {
+      if (from == to) {
+        return;
+      }
+      if (mprotect(static_cast<char*>(t) + from*pagesz, (to - from)*pagesz, PROT_READ|PROT_WRITE) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mprotect");
+      }
+      for (size_t i=from; i<to; ++i) {
+        if (state[i] == ABSENT) {
+          ++npresent;
+          fifo.push_back(i);
+        }
+        state[i] = WRITTEN;
+        written.push_back(i);
+      }
+    }
+
+    /// Bring page 'i' in from the blocks it overlaps. A page with no
+    /// element from the file is given write access right away.
+    void materialise(size_t i) {
+      auto p = static_cast<char*>(t) + i*pagesz;
+      const size_t lo = std::max(i*pagesz, HDR);
+      const size_t hi = std::min((i + 1)*pagesz, HDR + filen*elemsz);
+      if (lo >= hi && i != 0 && !readonly) {
+        makeWritten(i, i + 1);
+        evict(i);
+        return;
+      }
+      if (mprotect(p, pagesz, PROT_READ|PROT_WRITE) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mprotect");
+      }
+      const size_t blockbytes = codec::BLOCKSZ * elemsz;
+      for (size_t k = lo < hi ? (lo - HDR) / blockbytes : blocks.size();
+           k < blocks.size() && HDR + k*blockbytes < hi; ++k) {
+        const auto& b = decoded(k);
+        const size_t blo  = HDR + k*blockbytes;
+        const size_t from = std::max(lo, blo);
+        const size_t to   = std::min(hi, blo + b.size());
+        if (from < to) {
+          memcpy(static_cast<char*>(t) + from, b.data() + (from - blo), to - from);
+        }
+      }
+      // the header of a read-only column is protected once it is set,
+      // see 'initialize':
+      if ((i != 0 || !readonly) && mprotect(p, pagesz, PROT_READ) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mprotect");
+      }
+      state[i] = CLEAN;
+      ++npresent;
+      fifo.push_back(i);
+      evict(i);
+    }
+
+    /// Bring in the pages of the bytes [from, to).
+    void materialiseRange(size_t from, size_t to) {
+      for (size_t i=from / pagesz; i*pagesz < to; ++i) {
+        if (state[i] == ABSENT) {
+          materialise(i);
+        }
+      }
+    }
+
+    /// Drop the oldest pages that weren't written until at most
+    /// 'maxPages' are in memory, keeping the first page and 'keep'.
+    void evict(size_t keep) {
+      if (pinned) {
+        return;
+      }
+      for (size_t tries=fifo.size(); npresent > maxPages && tries; --tries) {
+        const size_t i = fifo.front();
+        fifo.pop_front();
+        if (i >= state.size() || state[i] == ABSENT) {
+          continue;
+        }
+        if (i == 0 || i == keep || state[i] == WRITTEN) {
+          fifo.push_back(i);
+          continue;
+        }
+        auto p = static_cast<char*>(t) + i*pagesz;
+        if (madvise(p, pagesz, MADV_DONTNEED) == 0 && mprotect(p, pagesz, PROT_NONE) == 0) {
+          state[i] = ABSENT;
+          --npresent;
+        }
+      }
+    }
+
+    /// Decoded elements of block 'k' of the file.
+    const std::vector<char>& decoded(size_t k) {
+      for (auto it=cache.begin(); it!=cache.end(); ++it) {
+        if (it->first == k) {
+          cache.splice(cache.begin(), cache, it);
+          return cache.front().second;
+        }
+      }
+      const auto& b = blocks[k];
+      std::vector<char> payload(b.nbytes);
+      if (pread(fd, payload.data(), b.nbytes, b.off) != static_cast<ssize_t>(b.nbytes)) {
+        throw std::range_error(filename.string() + ": corrupted compressed column");
+      }
+      std::vector<char> elts(b.nelts * elemsz);
+      codec::decode(ctype, payload.data(), b.nbytes, elts.data(), b.nelts, elemsz);
+      if (cache.size() >= ZBLOCK_CACHE) {
+        cache.pop_back();
+      }
+      cache.emplace_front(k, std::move(elts));
+      return cache.front().second;
+    }
+
+    /// Append the blocks that changed since the last flush and a new
+    /// index to the file, then commit them by rewriting the header.
+    void flush(bool sync) {
+      std::lock_guard<std::recursive_mutex> lock(FaultPager::instance().mutex());
+      auto raw = static_cast<const RawVector<uint64_t>*>(t);
+      size_t es;
+      const auto ct = getCodec(raw->typenumber, es);
+      if (committed && (ct != ctype || es != elemsz)) {
+        throw std::range_error(filename.string() + ": compressed column changed type");
+      }
+      ctype = ct;
+      elemsz = es;
+      const size_t nrows = raw->n;
+      const size_t nb = (nrows + codec::BLOCKSZ - 1) / codec::BLOCKSZ;
+      auto nelts = [&](size_t k) { return std::min(codec::BLOCKSZ, nrows - k*codec::BLOCKSZ); };
+
+      // the blocks overlapping a written page, ignoring a first page
+      // where only the header changed:
+      std::vector<size_t> todo;
+      const bool page0Written = page0.size() != pagesz ||
+        memcmp(data(), page0.data() + HDR, pagesz - HDR) != 0;
+      for (auto i : written) {
+        if (i >= state.size() || state[i] != WRITTEN || (i == 0 && !page0Written)) {
+          continue;
+        }
+        const size_t r0 = (std::max(i*pagesz, HDR) - HDR) / elemsz;
+        const size_t r1 = std::min(((i + 1)*pagesz - HDR + elemsz - 1) / elemsz, nrows);
+        for (size_t k=r0 / codec::BLOCKSZ; k*codec::BLOCKSZ < r1; ++k) {
+          todo.push_back(k);
+        }
+      }
+      // and the blocks whose number of elements changed:
+      const size_t nkept = std::min(blocks.size(), nb);
+      for (size_t k = nkept ? nkept - 1 : 0; k < nb; ++k) {
+        if (k >= blocks.size() || blocks[k].nelts != nelts(k)) {
+          todo.push_back(k);
+        }
+      }
+      std::sort(todo.begin(), todo.end());
+      todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+
+      if (committed && todo.empty() && nb == blocks.size() &&
+          page0.size() == pagesz && memcmp(t, page0.data(), HDR) == 0) {
+        cleanWritten();
+        return;
+      }
+
+      struct Pin {
+        Pin(bool& p_) : p(p_) { p = true; }
+        ~Pin() { p = false; }
+        bool& p;
+      } pin(pinned);
+
+      std::vector<ZBlockEntry> index(blocks.begin(), blocks.begin() + nkept);
+      index.resize(nb);
+      off_t off = fileEnd;
+      std::vector<char> buf;
+      for (auto k : todo) {
+        const size_t r0 = k*codec::BLOCKSZ;
+        materialiseRange(HDR + r0*elemsz, HDR + (r0 + nelts(k))*elemsz);
+        buf.clear();
+        codec::encode(ctype, data() + r0*elemsz, nelts(k), elemsz, buf);
+        writeAt(fd, buf.data(), buf.size(), off);
+        index[k] = ZBlockEntry{static_cast<uint64_t>(off), nelts(k), buf.size()};
+        off += buf.size();
+      }
+      const off_t indexoff = off;
+      writeAt(fd, reinterpret_cast<const char*>(index.data()), nb*sizeof(ZBlockEntry), off);
+      off += nb*sizeof(ZBlockEntry);
+      // the header must not reach the disk before what it refers to:
+      if (fdatasync(fd) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "fdatasync");
+      }
+      ZFileHeader h{ZCOLUMN_MAGIC, ZCOLUMN_VERSION, ctype, elemsz, raw->typenumber,
+                    nrows, raw->ordered, nb, static_cast<uint64_t>(indexoff)};
+      writeAt(fd, reinterpret_cast<const char*>(&h), sizeof(h), 0);
+      if (sync && fdatasync(fd) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "fdatasync");
+      }
+
+      blocks.swap(index);
+      filen = nrows;
+      fileEnd = off;
+      committed = true;
+      cache.remove_if([&](const std::pair<size_t, std::vector<char>>& e) {
+          return e.first >= nb || std::binary_search(todo.begin(), todo.end(), e.first);
+        });
+      cleanWritten();
+
+      uint64_t live = sizeof(ZFileHeader) + nb*sizeof(ZBlockEntry);
+      for (const auto& b : blocks) {
+        live += b.nbytes;
+      }
+      if (static_cast<uint64_t>(fileEnd) - live > std::max(live, static_cast<uint64_t>(ZCOMPACT_MIN))) {
+        compact(h);
+      }
+    }
+
+    /// Take write access away from the pages written since the last
+    /// flush, so that the next write to them is seen.
+    void cleanWritten() {
+      for (auto i : written) {
+        if (i < state.size() && state[i] == WRITTEN &&
+            mprotect(static_cast<char*>(t) + i*pagesz, pagesz, PROT_READ) == 0) {
+          state[i] = CLEAN;
+        }
+      }
+      written.clear();
+      page0.assign(static_cast<char*>(t), static_cast<char*>(t) + pagesz);
+    }
+
+    /// Copy the live blocks to a new file that replaces the column file.
+    void compact(ZFileHeader h) {
+      auto tmp = filename;
+      tmp += ".tmp";
+      int nfd = open(tmp.c_str(), O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+      if (nfd == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "open");
+      }
+      try {
+        auto index = blocks;
+        off_t off = sizeof(ZFileHeader);
+        std::vector<char> buf;
+        for (auto& b : index) {
+          buf.resize(b.nbytes);
+          if (pread(fd, buf.data(), b.nbytes, b.off) != static_cast<ssize_t>(b.nbytes)) {
+            throw std::range_error(filename.string() + ": corrupted compressed column");
+          }
+          writeAt(nfd, buf.data(), buf.size(), off);
+          b.off = off;
+          off += b.nbytes;
+        }
+        h.indexoff = off;
+        writeAt(nfd, reinterpret_cast<const char*>(index.data()), index.size()*sizeof(ZBlockEntry), off);
+        off += index.size()*sizeof(ZBlockEntry);
+        writeAt(nfd, reinterpret_cast<const char*>(&h), sizeof(h), 0);
+        if (fdatasync(nfd) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "fdatasync");
+        }
+        if (rename(tmp.c_str(), filename.c_str()) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "rename");
+        }
+        close(fd);
+        fd = nfd;
+        blocks.swap(index);
+        fileEnd = off;
+      }
+      catch (...) {
+        close(nfd);
+        unlink(tmp.c_str());
+        throw;
+      }
+      // make the rename durable:
+      int dfd = open(filename.parent_path().c_str(), O_RDONLY|O_DIRECTORY);
+      if (dfd != -1) {
+        fsync(dfd);
+        close(dfd);
+      }
+    }
+
+    static inline void writeAt(int wfd, const char* p, size_t len, off_t off) {
+      while (len) {
+        auto res = pwrite(wfd, p, len, off);
+        if (res == -1) {
+          if (errno == EINTR) continue;
+          throw std::system_error(std::error_code(errno, std::system_category()), "pwrite");
+        }
+        p   += res;
+        len -= res;
+        off += res;
+      }
+    }
+  };
+
+} // end namespace arr
+
+
+#endif
@@ -48,8 +48,25 @@ cfg::CfgMap::CfgMap() :
      { "data.q.size"s,         100000L                  },  
      { "sig.q.size"s,          50L                      },  
      { "commbuf.ttl.secs"s,    60L                      },  
+     { "commbuf.pool.bytes"s,  33554432L                },
      { "in.req.ttl.secs"s,     180L                     },  
-     { "in.rsp.ttl.secs"s,     180L                     }  
+     { "in.rsp.ttl.secs"s,     180L                     },
+     { "net.threads"s,         1L                       },
+     { "net.out.high.bytes"s,  67108864L                },
+     { "net.out.low.bytes"s,   16777216L                },
+     { "net.out.policy"s,      "block"s                 },
+     { "net.unix.path"s,       ""s                      },
+                              
+     { "zts.segment.size"s,    67108864L                },
+     { "msync.flusher.ms"s,    1000L                    },
+     { "hugepages"s,           "madvise"s               },
+     { "hugepages.threshold"s, 33554432L                },
+     { "columns.mapped.max"s,  4096L                    },
+
+     { "wal.path"s,            ""s                      },
+     { "wal.sync.ms"s,         10L                      },
+     { "wal.sync.bytes"s,      1048576L                 },
+     { "wal.checkpoint.bytes"s, 268435456L              }
    }
  {
    
@@ -0,0 +1,535 @@
+// (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef CONTAINER_ALLOCATOR_HPP
+#define CONTAINER_ALLOCATOR_HPP
+
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <unordered_map>
+#include "vector.hpp"
+
+
+/// Allocator for single-file containers. Instead of a directory with
+/// one file per vector, all the vectors of an array (and of the index
+/// of a 'zts') are extents of a single file:
+///
+///   page 0    header: magic, version, location and capacity of the
+///             extent table, end of the used part of the file
+///   table     one entry per extent: name, offset, length
+///   extents   page aligned, each one starts with the 'RawVector'
+///             header, so the layout of a vector is the same as in a
+///             file of its own
+///
+/// The container is opened once, and each vector maps its extent
+/// from the shared file descriptor. An extent that is at the end of
+/// the file grows in place; any other extent is moved to the end of
+/// the file (or to a free extent that is big enough) when it needs to
+/// grow, and its old space becomes free. The extent table itself is
+/// moved and doubled when full.
+///
+/// The table is only updated once the data it points to has been
+/// written, so a crash can leak space but doesn't lose an extent.
+
+
+namespace arr {
+
+  const uint64_t CONTAINER_MAGIC   = 0x5a54534442435431ULL; // "ZTSDBCT1"
+  const uint64_t CONTAINER_VERSION = 1;
+
+  struct ContainerHeader {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t tableoff;          ///< offset of the extent table
+    uint64_t tablecap;          ///< number of entries in the extent table
+    uint64_t end;               ///< end of the used part of the file
+  };
+
+  /// An extent table entry. A free extent has an empty name; an
+  /// unused entry has an empty name and a null length.
+  struct ContainerExtent {
+    char name[48];
+    uint64_t off;
+    uint64_t len;
+  };
+  static_assert(sizeof(ContainerExtent) == 64, "ContainerExtent must be 64 bytes");
+
+
+  /// Check if 'path' is a container file.
+  inline bool isContainer(const fsys::path& path) {
+    if (!fsys::is_regular_file(path)) {
+      return false;
+    }
+    uint64_t magic = 0;
+    auto f = fopen(path.c_str(), "rb");
+    if (!f) {
+      return false;
+    }
+    auto res = fread(&magic, sizeof(magic), 1, f);
+    fclose(f);
+    return res == 1 && magic == CONTAINER_MAGIC;
+  }
+
+
+  struct Container {
+    /// Open the container 'path_p', or create it if 'create' is
+    /// true. A read-only container is opened 'O_RDONLY' and its
+    /// extents are mapped read-only.
+    Container(const fsys::path& path_p, bool create, bool readonly_p)
+      : path(path_p), fd(-1), pagesz(sysconf(_SC_PAGESIZE)), readonly(readonly_p)
+    {
+      if (create) {
+        fd = open(path.c_str(), O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+      }
+      else {
+        fd = open(path.c_str(), readonly ? O_RDONLY : O_RDWR);
+      }
+      if (fd == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot open "s + path.c_str());
+      }
+      try {
+        if (create) {
+          h = ContainerHeader{CONTAINER_MAGIC, CONTAINER_VERSION, pagesz,
+                              pagesz / sizeof(ContainerExtent), 2 * pagesz};
+          table.resize(h.tablecap);
+          fallocate(0, h.end);
+          writeTable();
+          writeHeader();
+        }
+        else {
+          readAll(&h, sizeof(h), 0);
+          if (h.magic != CONTAINER_MAGIC || h.version != CONTAINER_VERSION) {
+            throw std::range_error(path.string() + ": invalid container header");
+          }
+          table.resize(h.tablecap);
+          readAll(table.data(), h.tablecap * sizeof(ContainerExtent), h.tableoff);
+          for (size_t i=0; i<table.size(); ++i) {
+            table[i].name[sizeof(table[i].name) - 1] = '\0';
+            if (table[i].name[0]) {
+              names[table[i].name] = i;
+            }
+          }
+        }
+      }
+      catch (...) {
+        close(fd);
+        throw;
+      }
+    }
+
+    Container(const Container&) = delete;
+    Container& operator=(const Container&) = delete;
+
+    ~Container() {
+      if (!readonly) {
+        fdatasync(fd);          // the table and header, the extents are synced on unmap
+      }
+      close(fd);
+    }
+
+    inline int getFd() const { return fd; }
+    inline const fsys::path& getPath() const { return path; }
+    inline bool isReadOnly() const { return readonly; }
+    inline size_t roundup(size_t sz) const { return (sz + pagesz - 1) / pagesz * pagesz; }
+    inline bool has(const std::string& name) const { return names.count(name); }
+
+    /// The extent 'name'; throws if there is none.
+    inline const ContainerExtent& find(const std::string& name) const {
+      auto e = names.find(name);
+      if (e == names.end()) {
+        throw std::range_error(path.string() + ": no extent " + name);
+      }
+      return table[e->second];
+    }
+
+    /// Read the 'RawVector' header of the extent 'name'.
+    inline RawVector<uint64_t> readHeader(const std::string& name) const {
+      RawVector<uint64_t> v;
+      readAll(&v, sizeof(v), find(name).off);
+      return v;
+    }
+
+    /// Create the extent 'name' of at least 'sz' bytes.
+    const ContainerExtent& create(const std::string& name, size_t sz) {
+      if (name.empty() || name.size() >= sizeof(ContainerExtent::name)) {
+        throw std::range_error("invalid container extent name: " + name);
+      }
+      if (has(name)) {
+        throw std::range_error(path.string() + ": extent " + name + " already exists");
+      }
+      const auto len = roundup(std::max<size_t>(sz, 1));
+      const auto off = claim(len);
+      const auto i = getUnusedEntry();
+      strcpy(table[i].name, name.c_str());
+      table[i].off = off;
+      table[i].len = len;
+      names[name] = i;
+      writeEntry(i);
+      return table[i];
+    }
+
+    /// Grow the extent 'name' to 'len' bytes if it can be done in
+    /// place, that is if it is the last extent of the file.
+    bool extend(const std::string& name, size_t len) {
+      auto i = names.at(name);
+      auto& e = table[i];
+      if (e.off + e.len != h.end || len <= e.len) {
+        return false;
+      }
+      fallocate(h.end, e.off + len - h.end);
+      h.end = e.off + len;
+      syncHeader();             // never an entry beyond the end, see 'syncHeader'
+      e.len = len;
+      writeEntry(i);
+      return true;
+    }
+
+    /// Reserve 'len' bytes of free space, taken from a free extent or
+    /// from the end of the file. 'len' must be a multiple of the page
+    /// size.
+    size_t claim(size_t len) {
+      for (size_t i=0; i<table.size(); ++i) {
+        auto& e = table[i];
+        if (!e.name[0] && e.len >= len) {
+          const auto off = e.off;
+          e.off += len;
+          e.len -= len;
+          writeEntry(i);
+          return off;
+        }
+      }
+      const auto off = h.end;
+      fallocate(h.end, len);
+      h.end += len;
+      syncHeader();             // before the caller writes the entry
+      return off;
+    }
+
+    /// Point the extent 'name' to the 'len' bytes at 'off' obtained
+    /// with 'claim'; its previous space becomes free.
+    void move(const std::string& name, size_t off, size_t len) {
+      auto i = names.at(name);
+      const auto oldoff = table[i].off;
+      const auto oldlen = table[i].len;
+      table[i].off = off;
+      table[i].len = len;
+      writeEntry(i);
+      release(oldoff, oldlen);
+    }
+
+    /// Delete the extent 'name'.
+    void remove(const std::string& name) {
+      auto i = names.at(name);
+      names.erase(name);
+      memset(table[i].name, 0, sizeof(table[i].name));
+      const auto off = table[i].off;
+      const auto len = table[i].len;
+      table[i].off = 0;
+      table[i].len = 0;
+      writeEntry(i);
+      release(off, len);
+    }
+
+  private:
+    const fsys::path path;
+    int fd;
+    const size_t pagesz;
+    const bool readonly;
+    ContainerHeader h;
+    std::vector<ContainerExtent> table;
+    std::unordered_map<std::string, size_t> names; ///< extent name -> table entry
+
+    /// Make the 'len' bytes at 'off' free. Free space at the end of
+    /// the file is given back to the file system.
+    void release(size_t off, size_t len) {
+      if (!len) {
+        return;
+      }
+      if (off + len == h.end) {
+        h.end = off;
+        // free extents that now end the file go too:
+        for (bool found=true; found; ) {
+          found = false;
+          for (size_t i=0; i<table.size(); ++i) {
+            auto& e = table[i];
+            if (!e.name[0] && e.len && e.off + e.len == h.end) {
+              h.end = e.off;
+              e.off = e.len = 0;
+              writeEntry(i);
+              found = true;
+            }
+          }
+        }
+        writeHeader();
+        if (ftruncate(fd, h.end) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()),
+                                  "cannot truncate "s + path.c_str());
+        }
+        return;
+      }
+      auto i = getUnusedEntry();
+      table[i].off = off;
+      table[i].len = len;
+      writeEntry(i);
+    }
+
+    /// An unused table entry, doubling the table if there are none.
+    size_t getUnusedEntry() {
+      for (size_t i=0; i<table.size(); ++i) {
+        if (!table[i].name[0] && !table[i].len) {
+          return i;
+        }
+      }
+      const auto oldoff = h.tableoff;
+      const auto oldcap = h.tablecap;
+      const auto newcap = 2 * oldcap;
+      const auto newoff = h.end;
+      fallocate(h.end, roundup(newcap * sizeof(ContainerExtent)));
+      h.end += roundup(newcap * sizeof(ContainerExtent));
+      table.resize(newcap);
+      // the old table space is recorded as free in the new table,
+      // which only becomes current once written:
+      table[oldcap].off = oldoff;
+      table[oldcap].len = roundup(oldcap * sizeof(ContainerExtent));
+      h.tableoff = newoff;
+      h.tablecap = newcap;
+      writeTable();
+      writeHeader();
+      return oldcap + 1;
+    }
+
+    inline void fallocate(size_t off, size_t len) {
+      if (posix_fallocate(fd, off, len) != 0) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "posix_fallocate "s + path.c_str());
+      }
+    }
+
+    inline void writeAll(const void* buf, size_t sz, size_t off) {
+      if (readonly) {
+        throw std::range_error(path.string() + " is mapped read-only");
+      }
+      if (pwrite(fd, buf, sz, off) != static_cast<ssize_t>(sz)) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot write "s + path.c_str());
+      }
+    }
+
+    inline void readAll(void* buf, size_t sz, size_t off) const {
+      if (pread(fd, buf, sz, off) != static_cast<ssize_t>(sz)) {
+        throw std::range_error(path.string() + ": truncated container");
+      }
+    }
+
+    inline void writeHeader() { writeAll(&h, sizeof(h), 0); }
+    /// Write the header and make it durable. When the file grows, the
+    /// new end has to reach the disk before an entry refers to the
+    /// space past the old end: after a crash in between, that space
+    /// is merely unused.
+    inline void syncHeader() {
+      writeHeader();
+      if (fdatasync(fd) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot sync "s + path.c_str());
+      }
+    }
+    inline void writeTable() {
+      writeAll(table.data(), table.size() * sizeof(ContainerExtent), h.tableoff);
+    }
+    inline void writeEntry(size_t i) {
+      writeAll(&table[i], sizeof(ContainerExtent), h.tableoff + i * sizeof(ContainerExtent));
+    }
+  };
+
+
+  struct containerallocator : baseallocator {
+    /// The vector stored in extent 'name_p' of 'cont_p'; see
+    /// 'mmapallocator' for 'advice_p'.
+    containerallocator(const std::shared_ptr<Container>& cont_p, const std::string& name_p,
+                       int advice_p=MADV_NORMAL)
+      : t(nullptr), n(0), off(0), cont(cont_p), name(name_p), advice(advice_p) { }
+
+    inline void* initialize() {
+      const auto& e = cont->find(name);
+      map(e.off, e.len);
+      if (advice != MADV_NORMAL) {
+        ::madvise(t, n, advice);  // only a hint, so ignore failures
+      }
+      if (!cont->isReadOnly()) {
+        MsyncFlusher::instance().add(this);
+      }
+      return t;
+    }
+
+    inline size_t size() const { return n; }
+
+    inline void* allocate(size_t sz) {
+      checkWritable();
+      if (cont->has(name)) {    // same as truncating an existing file
+        cont->remove(name);
+      }
+      const auto& e = cont->create(name, sz);
+      map(e.off, e.len);
+      dirty.mark(0, n);         // whatever the constructor writes
+      MsyncFlusher::instance().add(this);
+      return t;
+    }
+
+    inline void deallocate(void* address, size_t) {
+      checkWritable();
+      if (t) {
+        MsyncFlusher::instance().remove(this);
+        std::lock_guard<std::mutex> guard(mx);
+        if (munmap(t, n) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "munmap");
+        }
+        t = nullptr;
+        n = 0;
+        setBytes(0);
+        size_t from, to;
+        dirty.take(from, to);
+        cont->remove(name);
+      }
+    }
+
+    inline void* reallocate(void* old_address, size_t new_size) {
+      if (old_address != t) {
+        throw std::out_of_range("containerallocator can't reallocate at an offset");
+      }
+      checkWritable();
+      std::lock_guard<std::mutex> guard(mx); // the flusher can't use 't' and 'n' now
+      const auto len = cont->roundup(new_size);
+      countRealloc(len > n);
+      if (len <= n) {
+        return t;               // keep the space, as a file would keep its pages
+      }
+      if (cont->extend(name, len)) {
+        void* new_t = mremap(t, n, len, MREMAP_MAYMOVE);
+        if (new_t == MAP_FAILED) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "mremap");
+        }
+        t = new_t;
+      }
+      else {
+        const auto off = cont->claim(len);
+        void* new_t = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, cont->getFd(), off);
+        if (new_t == MAP_FAILED) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "mmap");
+        }
+        memcpy(new_t, t, n);
+        if (::msync(new_t, n, MS_SYNC) == -1) {
+          munmap(new_t, len);
+          throw std::system_error(std::error_code(errno, std::system_category()), "msync");
+        }
+        cont->move(name, off, len);
+        munmap(t, n);
+        t = new_t;
+        this->off = off;
+      }
+      n = len;
+      setBytes(n);
+      return t;
+    }
+
+    /// Flush the header page and the pages written to since the last
+    /// flush.
+    inline virtual void msync(bool async) const {
+      if (cont->isReadOnly()) {
+        return;
+      }
+      std::lock_guard<std::mutex> guard(mx);
+      syncDirty(async ? MS_ASYNC : MS_SYNC);
+    }
+
+    inline virtual DirtyRange* getDirtyRange() { return cont->isReadOnly() ? nullptr : &dirty; }
+
+    inline virtual size_t resident() const { return residentBytes(t, n); }
+
+    inline virtual bool isReadOnly() const { return cont->isReadOnly(); }
+
+    inline virtual bool getFileRange(int& fd_p, off_t& off_p) const {
+      if (!t) {
+        return false;
+      }
+      fd_p  = cont->getFd();
+      off_p = off;
+      return true;
+    }
+
+    inline virtual void flushDirty() {
+      std::lock_guard<std::mutex> guard(mx);
+      syncDirty(MS_SYNC);
+    }
+
+    virtual ~containerallocator() {
+      if (t && !cont->isReadOnly()) {
+        MsyncFlusher::instance().remove(this);
+        if (::msync(t, n, MS_SYNC) == -1) {
+          munmap(t, n);
+          throw std::system_error(std::error_code(errno, std::system_category()), "msync");
+        }
+      }
+      if (t && munmap(t, n) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "munmap");
+      }
+    }
+
+  private:
+    void* t;
+    size_t n;
+    size_t off;                 ///< offset of the extent in the container
+    const std::shared_ptr<Container> cont; ///< keeps the file open as long as it's mapped
+    const std::string name;
+    mutable DirtyRange dirty;
+    mutable std::mutex mx;      ///< protects the mapping against the flusher
+    const int advice;
+
+    inline void checkWritable() const {
+      if (cont->isReadOnly()) {
+        throw std::range_error(cont->getPath().string() + " is mapped read-only");
+      }
+    }
+
+    inline void map(size_t off_p, size_t len) {
+      t = mmap(NULL, len, cont->isReadOnly() ? PROT_READ : PROT_READ|PROT_WRITE, MAP_SHARED,
+               cont->getFd(), off_p);
+      if (t == MAP_FAILED) {
+        t = nullptr;
+        throw std::system_error(std::error_code(errno, std::system_category()), "mmap");
+      }
+      off = off_p;
+      n = len;
+      setBytes(n);
+    }
+
+    /// To be called with 'mx' held.
+    inline void syncDirty(int flags) const {
+      if (t) {
+        MsyncTimer timer(*this);
+        msyncDirty(static_cast<char*>(t), n, 0, dirty, flags);
+      }
+    }
+  };
+
+} // end namespace arr
+
+
+#endif
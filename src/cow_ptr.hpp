@@ -30,6 +30,7 @@ namespace arr {
   const unsigned CONSTREF = 0x04;
   const unsigned TMP      = 0x08;
   const unsigned LAST     = 0x10;
+  const unsigned READONLY = 0x20;   ///< the object is backed by a read-only mapping
 
   /// This is a typical copy on write pointer, with the addition that
   /// if the nevercopy flag is set, it acts as a regular shared_ptr
@@ -62,6 +63,9 @@ namespace arr {
       if (isConst()) {
         throw std::range_error("cannot modify const object");        
       }
+      if (isReadOnly()) {
+        throw std::range_error("cannot modify read-only object");
+      }
       //std::cout << "->deref: use_count(): " << use_count() << std::endl;
       if (*count > 1) {
         if (flags & LOCKED) {
@@ -79,6 +83,9 @@ namespace arr {
       if (isConst()) {
         throw std::range_error("cannot modify const object");        
       }
+      if (isReadOnly()) {
+        throw std::range_error("cannot modify read-only object");
+      }
       if (*count > 1) {
         if (flags & LOCKED) {
           throw std::range_error("cannot copy locked object");
@@ -116,6 +123,7 @@ namespace arr {
     bool isConst()     const { return flags & CONSTREF; }
     bool isTmp()       const { return flags & TMP; }
     bool isLast()      const { return flags & LAST; }
+    bool isReadOnly()  const { return flags & READONLY; }
 
     void setTmp()   { flags |=  TMP; --*count; }
     void setRef()   { flags |=  REF; }
@@ -112,6 +112,27 @@ zcore::Encode& zcore::Encode::operator <<(const string& t) {
 }
 
 
+size_t zcore::Encode::sendChunk(std::vector<iovec>& iov, 
+                                std::vector<net::FileRange>& ranges, 
+                                size_t len) {
+  auto res = ranges.empty() ? 
+    com.sendv(peerid, iov.data(), iov.size(), len) :
+    com.sendfile(peerid, buf, offset, ranges, len);
+  if (res < 0) {
+    throw std::system_error(std::error_code(errno, std::system_category()), "Encode(array)");
+  }
+  bytes += res;
+  offset = net::INIT_OFFSET;
+  *this << msgt;
+  *this << reqid;
+  *this << sourceid;
+  iov.clear();
+  iov.push_back(iovec{buf, offset});
+  ranges.clear();
+  return offset;
+}
+
+
 zcore::Encode& zcore::Encode::operator <<(const arr::zstring& t) {
   return operator<<(static_cast<std::string>(t));
 }
@@ -21,6 +21,9 @@
 
 
 #include <cstdint>
+#include <climits>
+#include <type_traits>
+#include <sys/uio.h>
 #include "valuevar.hpp"
 #include "ast.hpp"
 #include "misc.hpp"
@@ -57,6 +60,22 @@ namespace zcore {
   val::Value convertToList(const vector<unique_ptr<arr::Dname>>& names);
 
 
+  /// Types whose in-memory representation is their encoding, so that
+  /// their elements can be sent straight from the columns of an
+  /// array. The encoding is little endian, and 'bool' and 'zstring'
+  /// are encoded differently from their representation.
+  template<typename T> struct IsWireLayout : std::false_type { };
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+  template<> struct IsWireLayout<double>           : std::true_type { };
+  template<> struct IsWireLayout<Global::dtime>    : std::true_type { };
+  template<> struct IsWireLayout<Global::duration> : std::true_type { };
+  template<> struct IsWireLayout<tz::interval>     : std::true_type { };
+  template<> struct IsWireLayout<tz::period>       : std::true_type { };
+  static_assert(sizeof(tz::interval) == 24, "tz::interval layout differs from its encoding");
+  static_assert(sizeof(tz::period)   == 16, "tz::period layout differs from its encoding");
+#endif
+
+
   /// This class handles the encoding/decoding of a message. A
   /// 'message' is a layer of abstraction above the chunk, itself a
   /// layer above the TCP segment (the reassembly of which is handled
@@ -121,6 +140,9 @@ namespace zcore {
                                                                // template func is used
       
       // followed by (after stage is set to 1) a series of integers or doubles, etc.
+      if (IsWireLayout<T>::value && t.size() * sizeof(T) >= Global::ZEROCOPY_MIN && !arePaged(t)) {
+        return writeColumns(t);
+      }
       for (idx_type col=0; col < t.v.size(); ++col) {
         for (idx_type j=0; j < t.dim[0]; ++j) {
           *this << static_cast<T>(t.getcol(col)[j]);
@@ -144,6 +166,9 @@ namespace zcore {
 
 
     ssize_t flush() { 
+      if (offset == HEADERSZ) {
+        return 0;               // nothing after the header
+      }
       auto res = com.send(peerid, buf, offset);
       if (res > 0) {
         bytes += res;
@@ -158,6 +183,10 @@ namespace zcore {
     }
 
     ssize_t flush_end() {       // LLL
+      if (offset == HEADERSZ) {
+        offset = net::INIT_OFFSET;
+        return 0;               // nothing after the header
+      }
       auto res = com.send(peerid, buf, offset); 
       if (res > 0) {
         bytes += res;
@@ -169,6 +198,81 @@ namespace zcore {
     }
 
   private:
+    /// Offset of the end of the chunk header (magic number, size,
+    /// message type, request id and source id).
+    static const size_t HEADERSZ = net::INIT_OFFSET + 3 * sizeof(uint64_t);
+
+    /// Send the elements of 't' without copying them: each chunk is
+    /// 'buf', which holds the header and whatever precedes the
+    /// elements, followed by slices of the columns. When all the
+    /// columns are shared mappings of files the slices are file ranges
+    /// sent with 'sendfile' from the page cache, otherwise they are
+    /// the columns' storage sent with 'writev'. Slices hold whole
+    /// elements as the decoding of a chunk can't continue an element
+    /// started in the previous one.
+    template<typename T>
+    Encode& writeColumns(const arr::Array<T>& t) {
+      std::vector<iovec> iov;
+      std::vector<net::FileRange> ranges;
+      iov.push_back(iovec{buf, offset});
+      const bool fromFiles = areInFiles(t);
+      size_t len = offset;
+      for (idx_type col=0; col < t.ncols(); ++col) {
+        const auto& v = t.getcol(col);
+        auto p = reinterpret_cast<const char*>(v.c_ptr());
+        int fd = -1;
+        off_t off = 0;
+        if (fromFiles) {
+          v.getFileRange(fd, off);
+        }
+        size_t remaining = t.getdim(0) * sizeof(T);
+        while (remaining) {
+          if (Global::IOVCHUNKSZ - len < sizeof(T) || iov.size() == IOV_MAX) {
+            len = sendChunk(iov, ranges, len);
+          }
+          const size_t n = std::min(remaining, (Global::IOVCHUNKSZ - len) / sizeof(T) * sizeof(T));
+          if (fromFiles) {
+            ranges.push_back(net::FileRange{fd, off, n});
+          }
+          else {
+            iov.push_back(iovec{const_cast<char*>(p), n});
+          }
+          p   += n;
+          off += n;
+          len += n;
+          remaining -= n;
+        }
+      }
+      sendChunk(iov, ranges, len);
+      return *this;
+    }
+
+    template<typename T>
+    static bool arePaged(const arr::Array<T>& t) {
+      for (idx_type col=0; col < t.ncols(); ++col) {
+        if (t.getcol(col).isPaged()) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    template<typename T>
+    static bool areInFiles(const arr::Array<T>& t) {
+      for (idx_type col=0; col < t.ncols(); ++col) {
+        int fd;
+        off_t off;
+        if (!t.getcol(col).getFileRange(fd, off)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /// Send the chunk of length 'len' made of 'iov', or of 'buf' and
+    /// 'ranges' if the latter is not empty, and start a new one in
+    /// 'buf'. Returns the length of the new chunk.
+    size_t sendChunk(std::vector<iovec>& iov, std::vector<net::FileRange>& ranges, size_t len);
 
     Encode& operator <<(const val::VClos& t);
     Encode& operator <<(const val::VConn& t);
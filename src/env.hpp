@@ -19,12 +19,14 @@
 #ifndef ENV_HPP
 #define ENV_HPP
 
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <string>
 #include <iterator>
 #include <memory>
 #include <tuple>
+#include <cstddef>
 #include "valuevar.hpp"
 #include "display.hpp"
 
@@ -36,13 +38,56 @@ using namespace Juice;
 namespace interp {
   struct Kont;
 
+  /// Allocator drawing from the thread-local small block free lists
+  /// (see 'arr::SmallBlocks'). Every request creates and destroys a
+  /// great many continuations, frames and frame map entries; this
+  /// lets the blocks released when a request completes be reused by
+  /// the next one instead of going back to 'malloc'.
+  template <typename T>
+  struct PoolAllocator {
+    typedef T value_type;
+    static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned type");
+
+    PoolAllocator() { }
+    template <typename U> PoolAllocator(const PoolAllocator<U>&) { }
+
+    T* allocate(size_t n) {
+      const auto sz = n * sizeof(T);
+      return static_cast<T*>(sz <= arr::SmallBlocks::MAX_SIZE ?
+                             arr::SmallBlocks::get(arr::SmallBlocks::sizeClass(sz)) :
+                             ::operator new(sz));
+    }
+    void deallocate(T* p, size_t n) {
+      const auto sz = n * sizeof(T);
+      if (sz <= arr::SmallBlocks::MAX_SIZE) {
+        arr::SmallBlocks::put(arr::SmallBlocks::sizeClass(sz), p);
+      }
+      else {
+        ::operator delete(p);
+      }
+    }
+  };
+  template <typename T, typename U>
+  inline bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+  template <typename T, typename U>
+  inline bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+  /// Same as 'make_shared', with the object and its control block
+  /// allocated from a 'PoolAllocator'.
+  template <typename T, typename... Args>
+  inline std::shared_ptr<T> make_pooled(Args&&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+  }
+
+
   struct BaseFrame;
   typedef std::shared_ptr<BaseFrame> shpfrm;
 
   struct BaseFrame : std::enable_shared_from_this<BaseFrame> {
 
-    typedef map<string,val::Value> map_type;
-    typedef map<string,val::Value>::const_iterator const_map_iterator;
+    typedef map<string, val::Value, std::less<string>,
+                PoolAllocator<std::pair<const string, val::Value>>> map_type;
+    typedef map_type::const_iterator const_map_iterator;
 
 
     //  BaseFrame(const string& name_p) : name(name_p), up(0), global(0), ec(nullptr), cc(nullptr) { }
@@ -52,7 +97,8 @@ namespace interp {
               shared_ptr<interp::Kont> bc_p = nullptr, 
               shared_ptr<interp::Kont> ec_p = shared_ptr<interp::Kont>(), 
               shared_ptr<interp::Kont> cc_p = nullptr) : 
-      name(name_p), up(u), global(g), bc(bc_p), ec(ec_p), cc(cc_p), depth(u ? u->depth + 1 : 0) {
+      name(name_p), up(u), global(g), bc(bc_p), ec(ec_p), cc(cc_p), scope(nullptr),
+      depth(u ? u->depth + 1 : 0) {
 #ifdef ENV_HPP_DEBUG
       cout << name << " FRAME CREATED: " << this << endl; 
 #endif
@@ -82,6 +128,11 @@ namespace interp {
     virtual bool removeSpecial(const string& symb) = 0;
 
     virtual shpfrm getTrueFrame() { return shared_from_this(); }
+    /// Same as 'getTrueFrame', without the cost of a 'shared_ptr'.
+    virtual BaseFrame* trueFrame() { return this; }
+
+    /// Is 's' stored in a slot rather than by name (see 'ClosureFrame')?
+    virtual bool hasSlot(const string& s) const { return false; }
 
     virtual operator string() const = 0;
     virtual void clearTmp() = 0;
@@ -110,6 +161,7 @@ namespace interp {
     shared_ptr<interp::Kont> bc;  /// begin   continuation
     shared_ptr<interp::Kont> ec;  /// escape  continuation
     shared_ptr<interp::Kont> cc;  /// current continuation
+    const Function* scope;        /// function whose locals are in slots, if any
 
   protected:
     map_type m;
@@ -272,13 +324,115 @@ namespace interp {
 
 
   /// Type of frame used when invoking functions defined in R (see 'val::VClos'). 
+  ///
+  /// The locals of the function (see 'anf::resolveSlots') are kept in
+  /// a flat vector of slots which symbols annotated with the slot
+  /// index address directly; the name based interface remains
+  /// available for the dynamic cases ('assign', 'get', 'rm', '<<-',
+  /// lookups from called functions) and maps the names of the locals
+  /// to their slots, so that a local never lives in the map.
   struct ClosureFrame : Frame {
-    ClosureFrame(shpfrm u) : Frame("closure", u->global, u) { }
+    ClosureFrame(shpfrm u, std::shared_ptr<const Function> f_p = nullptr) :
+      Frame("closure", u->global, u), f(f_p),
+      slots(f ? f->locals.size() : 0), bound(slots.size(), false)
+    {
+      scope = f.get();
+    }
+
+    /// Value in slot 'i', or 'nullptr' if the slot is not bound or,
+    /// for a function call, not bound to a function.
+    val::Value* findSlot(unsigned i, bool funcall=false) {
+      if (!bound[i]) return nullptr;
+      if (funcall && slots[i].which() != val::vt_clos && slots[i].which() != val::vt_builting) {
+        return nullptr;
+      }
+      return &slots[i];
+    }
+
+    val::Value& addSlot(unsigned i, val::Value&& val) {
+      val::Value tmp = slots[i]; // see 'Frame::add'
+      slots[i] = val::gval(val);
+      bound[i] = true;
+      return slots[i];
+    }
+
+    val::Value& addArgSlot(unsigned i, val::Value&& val, bool isRef) {
+      if (isRef) {
+        slots[i] = std::move(val);
+        setRef(slots[i]);
+      }
+      else {
+        addSlot(i, std::move(val));
+        resetRef(slots[i]);
+      }
+      bound[i] = true;
+      return slots[i];
+    }
+
+    bool hasSlot(const string& s) const { return slot(s) >= 0; }
+
+    val::Value find(const string& s) const {
+      auto i = slot(s);
+      if (i < 0) return Frame::find(s);
+      if (bound[i]) return slots[i];
+      if (up) return up->find(s);
+      throw std::out_of_range("object '" + s + "' not found");
+    }
+
+    val::Value findLocal(const string& s) const {
+      auto i = slot(s);
+      if (i < 0) return Frame::findLocal(s);
+      if (bound[i]) return slots[i];
+      throw std::out_of_range("object '" + s + "' not found");
+    }
+
+    val::Value& findR(const string& s, bool funcall=false) {
+      auto i = slot(s);
+      if (i < 0) return Frame::findR(s, funcall);
+      if (auto v = findSlot(i, funcall)) return *v;
+      if (up) return up->findR(s, funcall);
+      throw std::out_of_range("object '" + s + "' not found");
+    }
+
+    val::SpVAS getNames() {
+      // 'm' and the named slots are both sorted by name:
+      std::vector<string> names;
+      for (const auto& p : m) {
+        names.push_back(p.first);
+      }
+      for (unsigned i=0; i<slots.size(); ++i) {
+        if (f->locals[i][0] != '?' && bound[i]) {
+          names.push_back(f->locals[i]);
+        }
+      }
+      std::sort(names.begin(), names.end());
+      auto a = arr::make_cow<arr::Array<arr::zstring>>(false, arr::rsv, Vector<idx_type>{0});
+      for (const auto& n : names) {
+        a->concat(arr::zstring(n));
+      }
+      return a;
+    }
+
+    val::Value& add(string s, val::Value&& val) {
+      auto i = slot(s);
+      return i < 0 ? Frame::add(s, std::move(val)) : addSlot(i, std::move(val));
+    }
+
+    val::Value& addSpecial(string s, val::Value&& val) {
+      auto i = slot(s);
+      if (i < 0) return Frame::addSpecial(s, std::move(val));
+      if (bound[i]) return addSlot(i, std::move(val));
+      return up->addSpecial(s, std::move(val));
+    }
 
     val::Value& addArg(string s, val::Value&& val, const yy::location& loc, bool isRef) { 
 #ifdef ENV_HPP_DEBUG
       cout << "addArg " << s << " to " << this << "; isRef: " << isRef << endl;
 #endif    
+      auto i = slot(s);
+      if (i >= 0) {
+        return addArgSlot(i, std::move(val), isRef);
+      }
       map_type& ml = s[0] != '?' ? m : mtmp;
       auto elt = ml.find(s);
       if (elt != ml.end()) {
@@ -292,12 +446,57 @@ namespace interp {
       return res.first->second;
     }
 
+    bool remove(const string& symb) {
+      auto i = slot(symb);
+      if (i < 0) return Frame::remove(symb);
+      bool wasBound = bound[i];
+      slots[i] = val::Value();
+      bound[i] = false;
+      return wasBound;
+    }
+
+    bool removeSpecial(const string& symb) {
+      auto i = slot(symb);
+      if (i < 0) return Frame::removeSpecial(symb);
+      if (bound[i]) return remove(symb);
+      return up ? up->removeSpecial(symb) : false;
+    }
+
+    operator string() const {
+      stringstream ss;
+      ss << Frame::operator string();
+      for (unsigned i=0; i<slots.size(); ++i) {
+        if (bound[i]) {
+          ss << f->locals[i] << ":" << val::to_string(slots[i]) << " ";
+        }
+      }
+      return ss.str();
+    }
+
+    void clear() {
+      // keep the size of the slot vector, symbols address it by index:
+      for (auto& v : slots) v = val::Value();
+      bound.assign(bound.size(), false);
+      Frame::clear();
+    }
+
     val::Value& addEllipsis(string s, val::Value&& val, const yy::location& loc, bool isRef) {
       mv.emplace_back(make_tuple(s, std::move(val), loc));
       return get<1>(mv.back());
     }
 
     std::vector<std::tuple<std::string, val::Value, yy::location>> mv;
+
+  private:
+    int slot(const string& s) const {
+      if (!f) return -1;
+      auto elt = f->localMap.find(s);
+      return elt != f->localMap.end() ? int(elt->second) : -1;
+    }
+
+    std::shared_ptr<const Function> f; // keeps 'scope' alive
+    std::vector<val::Value> slots;
+    std::vector<bool> bound;
   };
 
 
@@ -406,8 +605,13 @@ namespace interp {
                 shared_ptr<interp::Kont> ec,
                 shared_ptr<interp::Kont> cc) : Frame("shadow", u->global, u, bc, ec, cc) { }
 
+    /// Temporaries are kept here, unless the true frame has a slot for them.
+    bool isLocal(const string& s) const { return s[0] == '?' && !up->hasSlot(s); }
+
+    bool hasSlot(const string& s) const { return up->hasSlot(s); }
+
     val::Value find(const string& s) const { 
-      if (s[0] == '?') {
+      if (isLocal(s)) {
         return Frame::find(s);
       }
       else {
@@ -416,7 +620,7 @@ namespace interp {
     }
 
     val::Value findLocal(const string& s) const { 
-      if (s[0] == '?') {
+      if (isLocal(s)) {
         return Frame::findLocal(s);
       }
       else {
@@ -425,7 +629,7 @@ namespace interp {
     }
 
     val::Value& findR(const string& s, bool funcall=false) { 
-      if (s[0] == '?') {
+      if (isLocal(s)) {
         return Frame::findR(s, funcall);
       }
       else {
@@ -438,7 +642,7 @@ namespace interp {
     }
 
     val::Value& add(string s, val::Value&& val) { 
-      if (s[0] == '?') {
+      if (isLocal(s)) {
 #ifdef ENV_HPP_DEBUG
         cout << "add " << s << " to " << this << endl;
 #endif
@@ -486,6 +690,7 @@ namespace interp {
     }
 
     virtual shpfrm getTrueFrame() { return up->getTrueFrame(); }
+    virtual BaseFrame* trueFrame() { return up->trueFrame(); }
 
     ~ShadowFrame() { }
   };
@@ -41,6 +41,10 @@ namespace Global {
 
   const size_t CHUNKSZ = 131072; // 2^17
   // static const size_t CHUNKSZ = 1024;
+  /// Arrays of at least ZEROCOPY_MIN bytes are sent straight from the
+  /// storage of their columns, in chunks of at most IOVCHUNKSZ bytes.
+  const size_t ZEROCOPY_MIN = 131072;
+  const size_t IOVCHUNKSZ = 1048576; // 2^20
   const size_t MAGICNB = 0x9316481736403219L;
 
   const size_t EPOLL_MAX_EVENTS = 64; // max number of peers...
@@ -80,6 +84,8 @@ namespace Global {
   const char* const LOGFILE_EXTENSION = ".log";
 
   using buflen_pair = std::pair<std::unique_ptr<char[]>, size_t>;
+  /// A buffer not owned, and its length.
+  using bufptr_pair = std::pair<const char*, size_t>;
 }
 
 
@@ -577,6 +577,19 @@ namespace arr {
   }; // end struct DtimeIndex
   
 
+  /// Position in the ordered time vector 'vi' of the first element at
+  /// or after 't' (after 't' if 'upper'). Only the part of 'vi' that
+  /// its allocator says can hold it is searched, see
+  /// 'baseallocator::findTimeRows'.
+  inline idx_type timeBound(const Vector<Global::dtime>& vi, Global::dtime t, bool upper) {
+    size_t from = 0, to = vi.size();
+    vi.findTimeRows(t.time_since_epoch().count(), upper, from, to);
+    const auto b = vi.begin() + from;
+    const auto e = vi.begin() + to;
+    return (upper ? std::upper_bound(b, e, t) : std::lower_bound(b, e, t)) - vi.begin();
+  }
+
+
   /// Provides the indexing into a 'Global::dtime' vector with an
   /// interval index. That's the only thing we allow an interval to
   /// index into. In particular, the indexing into an interval vector
@@ -591,11 +604,8 @@ namespace arr {
 
     inline bool getfirst(idx_type& val, idx_type& i) const {
       while (i < idx.size()) {
-        const auto iter = idx[i].sopen ? 
-          std::upper_bound(vi.begin(), vi.end(), idx[i].s) :
-          std::lower_bound(vi.begin(), vi.end(), idx[i].s);
-        val = iter - vi.begin();
-        if (iter == vi.end() || (!idx[i].eopen ? vi[val] > idx[i].e : vi[val] >= idx[i].e)) {
+        val = timeBound(vi, idx[i].s, idx[i].sopen);
+        if (val == vi.size() || (!idx[i].eopen ? vi[val] > idx[i].e : vi[val] >= idx[i].e)) {
           ++i;
         }
         else {
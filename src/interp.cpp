@@ -30,6 +30,7 @@
 #include "anf.hpp"
 #include "base_funcs.hpp"
 #include "config.hpp"
+#include "vm.hpp"
 
 
 // #define DEBUG
@@ -64,6 +65,125 @@ static bool isAtomic(const E* e) {
 }
 
 
+/// Find the local 's' directly in its slot if 'r' is running the
+/// function 's' belongs to; 'nullptr' means it must be looked up by
+/// name.
+static val::Value* findSlot(const Symbol* s, BaseFrame* r, bool isFuncall=false) {
+  if (s->slot >= 0) {
+    auto tf = r->trueFrame();
+    if (tf->scope == s->scope) {
+      return static_cast<ClosureFrame*>(tf)->findSlot(s->slot, isFuncall);
+    }
+  }
+  return nullptr;
+}
+
+
+static bool isOp(const E* e) {
+  return e->etype == etunop || e->etype == etbinop;
+}
+
+
+/// Evaluate the operator tree 'e' on unboxed scalars. Returns false
+/// as soon as an operand is not a scalar or an operation has no
+/// scalar specialisation; the tree must then be evaluated boxed,
+/// which also reports any error.
+static bool evalScalar(const E* e, BaseFrame* r, funcs::Scalar& s) {
+  switch (e->etype) {
+  case etdouble:
+    return funcs::unbox(val::Value(static_cast<const Double*>(e)->data), s);
+  case etbool:
+    return funcs::unbox(val::Value(static_cast<const Bool*>(e)->data), s);
+  case etdtime:
+    return funcs::unbox(val::Value(static_cast<const Dtime*>(e)->data), s);
+  case etsymbol: {
+    const auto sym = static_cast<const Symbol*>(e);
+    if (auto v = findSlot(sym, r)) {
+      return funcs::unbox(*v, s);
+    }
+    try {
+      return funcs::unbox(r->findR(sym->data), s);
+    }
+    catch (std::out_of_range&) {
+      return false;
+    }
+  }
+  case etunop: {
+    auto u = static_cast<const Unop*>(e);
+    funcs::Scalar s1;
+    return evalScalar(u->e, r, s1) && funcs::evalunop(s1, int(u->op), s);
+  }
+  case etbinop: {
+    auto b = static_cast<const Binop*>(e);
+    funcs::Scalar s1, s2;
+    return b->attrib->etype == etnull &&
+      evalScalar(b->left, r, s1) && evalScalar(b->right, r, s2) &&
+      funcs::evalbinop(s1, s2, int(b->op), s);
+  }
+  default:
+    return false;
+  }
+}
+
+
+/// Collect the operator tree 'e' into 'nodes' for fused evaluation;
+/// returns the index of its root, or -1 if an operand is not a double
+/// array or a time series.
+static int fuse(const E* e, BaseFrame* r, std::vector<funcs::FusedNode>& nodes) {
+  switch (e->etype) {
+  case etdouble:
+    nodes.push_back(funcs::FusedNode{0, -1, -1, val::Value(static_cast<const Double*>(e)->data)});
+    break;
+  case etsymbol: {
+    const auto sym = static_cast<const Symbol*>(e);
+    const val::Value* v = findSlot(sym, r);
+    if (!v) {
+      try {
+        v = &r->findR(sym->data);
+      }
+      catch (std::out_of_range&) {
+        return -1;
+      }
+    }
+    const auto& vv = val::gval(*v);
+    if (vv.which() != val::vt_double && vv.which() != val::vt_zts) {
+      return -1;
+    }
+    nodes.push_back(funcs::FusedNode{0, -1, -1, vv});
+    break;
+  }
+  case etunop: {
+    auto u = static_cast<const Unop*>(e);
+    auto l = fuse(u->e, r, nodes);
+    if (l < 0) return -1;
+    nodes.push_back(funcs::FusedNode{int(u->op), l, -1, val::VNull()});
+    break;
+  }
+  case etbinop: {
+    auto b = static_cast<const Binop*>(e);
+    if (b->attrib->etype != etnull) return -1;
+    auto l = fuse(b->left, r, nodes);
+    if (l < 0) return -1;
+    auto rr = fuse(b->right, r, nodes);
+    if (rr < 0) return -1;
+    nodes.push_back(funcs::FusedNode{int(b->op), l, rr, val::VNull()});
+    break;
+  }
+  default:
+    return -1;
+  }
+  return nodes.size() - 1;
+}
+
+
+/// Evaluate the elementwise operator tree 'e' in one pass, without a
+/// temporary array per operator; false if it can't be fused.
+static bool evalFused(const E* e, BaseFrame* r, val::Value& res) {
+  std::vector<funcs::FusedNode> nodes;
+  return fuse(e, r, nodes) >= 0 && funcs::evalfused(nodes, res);
+}
+
+
 static val::Value evalAtom(const E* e,
                            const shared_ptr<BaseFrame> r,
                            zcore::InterpCtx& ic,
@@ -80,6 +200,12 @@ static val::Value evalAtom(const E* e,
     return val::VNull();
   case etsymbol: {
     const auto s = static_cast<const Symbol*>(e);
+    if (auto v = findSlot(s, r.get(), isFuncall)) {
+      if (v->which() == val::vt_future) {
+        throw interp::FutureException(s->data);
+      }
+      return val::VPtr(*v);
+    }
     try {
       auto& val = r->findR(s->data, isFuncall); // will throw  
       if (val.which() == val::vt_future) {
@@ -118,10 +244,33 @@ static val::Value evalAtom(const E* e,
     return val::Value(s->data); }
   case etunop: {
     auto u = static_cast<const Unop*>(e);
+    // an operator tree on scalars is evaluated unboxed and boxed once:
+    funcs::Scalar sc;
+    val::Value res;
+    if (isOp(u->e)) {
+      if (evalScalar(u, r.get(), sc)) {
+        return funcs::box(sc);
+      }
+      // and an array tree in one pass:
+      if (evalFused(u, r.get(), res)) {
+        return res;
+      }
+    }
     const auto& e1 = evalAtom(u->e, r, ic);
     return funcs::evalunop(e1, int(u->op)); }
   case etbinop: {
     auto b = static_cast<const Binop*>(e);
+    funcs::Scalar sc;
+    val::Value res;
+    if (isOp(b->left) || isOp(b->right)) {
+      if (evalScalar(b, r.get(), sc)) {
+        return funcs::box(sc);
+      }
+      // and an array tree in one pass:
+      if (evalFused(b, r.get(), res)) {
+        return res;
+      }
+    }
     // choose integer for b.op LLL
     auto e1 = evalAtom(b->left, r, ic);
     const auto& e2 = evalAtom(b->right, r, ic);
@@ -326,7 +475,7 @@ static shared_ptr<Kont> applyProc(val::VClos& proc,
   cout << "| with k : " << string(*k) << endl;
 #endif
 
-  fstack.push_back(std::make_shared<ClosureFrame>(r));
+  fstack.push_back(make_pooled<ClosureFrame>(r, proc.f));
   auto fenv = fstack.back();
   if (fenv->getDepth() >= get<int64_t>(cfg::cfgmap.get("expressions"))) {
     throw EvalException("evaluation nested too deeply: infinite recursion / options(expressions=)?",
@@ -335,7 +484,7 @@ static shared_ptr<Kont> applyProc(val::VClos& proc,
   fenv->ec = r->ec;
 
   // put a sentinel continuation to make sure fenv is cleared:
-  auto ksentinel = make_shared<Kont>(Kont{nullptr, nullptr, fenv, k, Kont::END});
+  auto ksentinel = make_pooled<Kont>(Kont{nullptr, nullptr, fenv, k, Kont::END});
 
   // don't lose time if the function takes no args:
   if (!proc.f->formlist || proc.f->formlist->n == 0) {
@@ -344,26 +493,26 @@ static shared_ptr<Kont> applyProc(val::VClos& proc,
       throw interp::EvalException("unused argument (" + ::to_string(*el->begin->e) + ')', 
                                   el->begin->e->loc);
     }
-    return make_shared<Kont>(Kont{nullptr, proc.f->body, fenv, ksentinel, Kont::NORMAL});
+    return make_pooled<Kont>(Kont{nullptr, proc.f->body, fenv, ksentinel, Kont::NORMAL});
   } 
   // or if the function only has ellipsis and no args are given:
   else {
     if (proc.f->formlist->n == 1 && 
         proc.f->formlist->begin->e->etype == etellipsis && 
         (!el || el->n == 0)) {
-      return make_shared<Kont>(Kont{nullptr, proc.f->body, fenv, ksentinel, Kont::NORMAL});
+      return make_pooled<Kont>(Kont{nullptr, proc.f->body, fenv, ksentinel, Kont::NORMAL});
     }
   }
 
   auto paVec = processArgs(proc.ellipsisPos, proc.argMap, proc.f->formlist, el);
-  auto kchain = make_shared<Kont>(Kont{nullptr, proc.f->body, fenv, ksentinel, Kont::NORMAL});
+  auto kchain = make_pooled<Kont>(Kont{nullptr, proc.f->body, fenv, ksentinel, Kont::NORMAL});
 
   for (auto i=static_cast<int>(paVec.size())-1; i>=0; --i) {
     auto er = paVec[i].isFormal ? fenv : r;
     auto atype = (paVec[i].isEllipsis ? Kont::ELLIPSIS : Kont::ARG) |
                  (paVec[i].isRef ? Kont::REF : 0);
-    kchain = make_shared<Kont>(Kont{paVec[i].name, nullptr, fenv, kchain, atype}); 
-    kchain = make_shared<Kont>(Kont{nullptr, paVec[i].expr, er, kchain, Kont::NORMAL}); 
+    kchain = make_pooled<Kont>(Kont{paVec[i].name, nullptr, fenv, kchain, atype}); 
+    kchain = make_pooled<Kont>(Kont{nullptr, paVec[i].expr, er, kchain, Kont::NORMAL}); 
   }
 
   return kchain;
@@ -381,14 +530,14 @@ static shared_ptr<Kont> applyBuiltin(const val::SpBuiltin& builtin,
 #endif
   auto inv = builtin->invoke.get();
   Function* f = builtin->signature.get();
-  fstack.push_back(std::make_shared<BuiltinFrame>(r, r->ec, builtin->argMap.size()));
+  fstack.push_back(make_pooled<BuiltinFrame>(r, r->ec, builtin->argMap.size()));
   auto fenv = fstack.back();
 #ifdef DEBUG
   cout << "|  created fenv:   " << fenv << endl;
 #endif
 
   // put a sentinel continuation to make sure fenv is cleared:
-  auto ksentinel = make_shared<Kont>(Kont{nullptr, nullptr, fenv, k, Kont::END});
+  auto ksentinel = make_pooled<Kont>(Kont{nullptr, nullptr, fenv, k, Kont::END});
 
   // don't lose time if the function takes no args:
   if (!f->formlist || f->formlist->n == 0) {
@@ -397,17 +546,17 @@ static shared_ptr<Kont> applyBuiltin(const val::SpBuiltin& builtin,
       throw interp::EvalException("unused argument (" + ::to_string(*el->begin->e) + ')',
                                   el->begin->e->loc);
     }
-    return make_shared<Kont>(Kont{nullptr, inv, fenv, ksentinel, Kont::NORMAL});
+    return make_pooled<Kont>(Kont{nullptr, inv, fenv, ksentinel, Kont::NORMAL});
   } 
   // or if the function only has ellipsis and no args are given:
   else {
     if (f->formlist->n == 1 && f->formlist->begin->e->etype == etellipsis && (!el || el->n == 0)) {
-      return make_shared<Kont>(Kont{nullptr, inv, fenv, ksentinel, Kont::NORMAL});
+      return make_pooled<Kont>(Kont{nullptr, inv, fenv, ksentinel, Kont::NORMAL});
     }
   }
 
   auto paVec = processArgs(builtin->ellipsisPos, builtin->argMap, f->formlist, el);
-  auto kchain = make_shared<Kont>(Kont{nullptr, inv, fenv, ksentinel, Kont::NORMAL});
+  auto kchain = make_pooled<Kont>(Kont{nullptr, inv, fenv, ksentinel, Kont::NORMAL});
 
 
   for (auto i=static_cast<int>(paVec.size())-1; i>=0; --i) {
@@ -439,8 +588,8 @@ static shared_ptr<Kont> applyBuiltin(const val::SpBuiltin& builtin,
         paVec[i].name->loc = paVec[i].expr->loc; // we need to recover the
                                                  // location of the evaluated
       }                                          // argument and not of the symbol
-      kchain = make_shared<Kont>(Kont{paVec[i].name, nullptr, fenv, kchain, atype});
-      kchain = make_shared<Kont>(Kont{nullptr, paVec[i].expr, er, kchain, Kont::NORMAL});
+      kchain = make_pooled<Kont>(Kont{paVec[i].name, nullptr, fenv, kchain, atype});
+      kchain = make_pooled<Kont>(Kont{nullptr, paVec[i].expr, er, kchain, Kont::NORMAL});
     }
   }
 
@@ -466,10 +615,10 @@ shared_ptr<Kont> interp::buildElChain(const ElNode* eln,
     auto la = static_cast<LeftAssign*>(eln->e);
     // next is not created here, protect the overwriting of an assignment:
     if (n == 1) {
-      nk = make_shared<Kont>(Kont{nullptr, la->e1, r, nk, Kont::NORMAL});
+      nk = make_pooled<Kont>(Kont{nullptr, la->e1, r, nk, Kont::NORMAL});
       nk->next->atype |= Kont::SILENT;
     }
-    auto rk = make_shared<Kont>(Kont{nullptr, la->e2, r, nk, Kont::NORMAL});
+    auto rk = make_pooled<Kont>(Kont{nullptr, la->e2, r, nk, Kont::NORMAL});
     rk->next->var = la->e1;
     return rk;
   } 
@@ -477,16 +626,16 @@ shared_ptr<Kont> interp::buildElChain(const ElNode* eln,
     auto sa = static_cast<SpecialAssign*>(eln->e);
     // next is not created here, protect the overwriting of an assignment:
     if (n == 1) {
-      nk = make_shared<Kont>(Kont{nullptr, sa->e1, r, nk, Kont::NORMAL});
+      nk = make_pooled<Kont>(Kont{nullptr, sa->e1, r, nk, Kont::NORMAL});
       nk->next->atype |= Kont::SILENT;
     }
-    auto rk = make_shared<Kont>(Kont{nullptr, sa->e2, r, nk, Kont::NORMAL});
+    auto rk = make_pooled<Kont>(Kont{nullptr, sa->e2, r, nk, Kont::NORMAL});
     rk->next->var = sa->e1;
     rk->next->atype |= Kont::GLOBAL;
     return rk;
   }
   else {
-    return make_shared<Kont>(Kont{nullptr, eln->e, r, nk, Kont::NORMAL});
+    return make_pooled<Kont>(Kont{nullptr, eln->e, r, nk, Kont::NORMAL});
   }
 }
 
@@ -495,23 +644,23 @@ static shared_ptr<Kont> buildKont(const E* e, shared_ptr<BaseFrame> r, shared_pt
 {
   if (e->etype == etleftassign) {
     auto la = static_cast<const LeftAssign*>(e);
-    k = make_shared<Kont>(Kont{nullptr, la->e1, r, k, Kont::NORMAL});
+    k = make_pooled<Kont>(Kont{nullptr, la->e1, r, k, Kont::NORMAL});
     k->next->atype |= Kont::SILENT;
-    auto rk = make_shared<Kont>(Kont{nullptr, la->e2, r, k, Kont::NORMAL});
+    auto rk = make_pooled<Kont>(Kont{nullptr, la->e2, r, k, Kont::NORMAL});
     rk->next->var = la->e1;
     return rk;
   } 
   else if (e->etype == etspecialassign) {
     auto sa = static_cast<const SpecialAssign*>(e);
-    k = make_shared<Kont>(Kont{nullptr, sa->e1, r, k, Kont::NORMAL});
+    k = make_pooled<Kont>(Kont{nullptr, sa->e1, r, k, Kont::NORMAL});
     k->next->atype |= Kont::SILENT;
-    auto rk = make_shared<Kont>(Kont{nullptr, sa->e2, r, k, Kont::NORMAL});
+    auto rk = make_pooled<Kont>(Kont{nullptr, sa->e2, r, k, Kont::NORMAL});
     rk->next->var = sa->e1;
     rk->next->atype |= Kont::GLOBAL;
     return rk;
   }
   else {
-    return make_shared<Kont>(Kont{nullptr, e, r, k, Kont::NORMAL});
+    return make_pooled<Kont>(Kont{nullptr, e, std::move(r), std::move(k), Kont::NORMAL});
   }
 }
 
@@ -521,14 +670,14 @@ inline static shared_ptr<Kont> insertWhile(shared_ptr<Kont> k, std::vector<shpfr
   cout << "insertWhile" << endl;
   cout << "| with k: " << string(*k) << endl;
 #endif
-  fstack.push_back(make_shared<ShadowFrame>(k->r->shared_from_this(), nullptr, k->r->ec, nullptr));
+  fstack.push_back(make_pooled<ShadowFrame>(k->r->shared_from_this(), nullptr, k->r->ec, nullptr));
   auto r = fstack.back();
 
   auto w = static_cast<const While*>(k->control);
 
   static const Null null(yy::missing_loc()); // result of while is null
   k->next->atype |= interp::Kont::SILENT;    // but silence it
-  auto nextk = make_shared<Kont>(Kont{
+  auto nextk = make_pooled<Kont>(Kont{
       k->next->var, 
       &null, 
       r, 
@@ -561,6 +710,43 @@ inline static shared_ptr<Kont> insertWhile(shared_ptr<Kont> k, std::vector<shpfr
 }
 
 
+static void checkAssign(const string& s, val::Value& val) {
+  if (s[0] != '?') {
+    if (isConst(val)) {
+      throw std::range_error("cannot assign const reference object");
+    }
+    // if (!isTmp(val) && isLocked(val)) {
+    //   throw std::range_error("cannot assign locked non-temporary object");   
+    // }
+    resetTmp(val);
+  }
+}
+
+
+val::Value& interp::assign(BaseFrame& r, const string& s, val::Value&& val, bool isRef) {
+  checkAssign(s, val);
+  auto& valref = r.add(s, std::move(val));
+  if (isRef) setRef(valref); else resetRef(valref);
+  return valref;
+}
+
+
+/// Same as 'interp::assign', but directly into the slot of 's' when
+/// 's' is a local of the function running in 'r'.
+static val::Value& assign(BaseFrame& r, const Symbol* s, val::Value&& val, bool isRef) {
+  if (s->slot >= 0) {
+    auto tf = r.trueFrame();
+    if (tf->scope == s->scope) {
+      checkAssign(s->data, val);
+      auto& valref = static_cast<ClosureFrame*>(tf)->addSlot(s->slot, std::move(val));
+      if (isRef) setRef(valref); else resetRef(valref);
+      return valref;
+    }
+  }
+  return interp::assign(r, s->data, std::move(val), isRef);
+}
+
+
 static void setIfFuture(val::Value& val, shpfrm& frame) {
   if (val.which() == val::vt_future) {
     auto& future = get<val::SpFuture>(val);
@@ -625,29 +811,22 @@ inline static shared_ptr<Kont> applyKont(shared_ptr<Kont> k,
 #endif 
     if (k->next->var) {
       if (k->next->var->etype == etsymbol) {
-        string sym = static_cast<const Symbol*>(k->next->var)->data;
-        const auto loc = k->control ? k->control->loc : k->next->var->loc;
+        auto sym = static_cast<const Symbol*>(k->next->var);
         if (k->next->atype & Kont::ARG) {
-          auto& valref = ar->addArg(sym, std::move(val), loc, k->next->atype & Kont::REF);
+          const auto loc = k->control ? k->control->loc : k->next->var->loc;
+          auto& valref = sym->slot >= 0 && ar->scope == sym->scope ?
+            static_cast<ClosureFrame&>(*ar).addArgSlot(sym->slot, std::move(val),
+                                                       k->next->atype & Kont::REF) :
+            ar->addArg(sym->data, std::move(val), loc, k->next->atype & Kont::REF);
           setIfFuture(valref, ar);
         }
         else if (k->next->atype & Kont::GLOBAL) {
-          auto& valref = ar->addSpecial(sym, std::move(val));
+          auto& valref = ar->addSpecial(sym->data, std::move(val));
           setIfFuture(valref, ar);
         }
         else {
-          if (sym[0] != '?') {
-            if (isConst(val)) {
-              throw std::range_error("cannot assign const reference object");
-            }
-            // if (!isTmp(val) && isLocked(val)) {
-            //   throw std::range_error("cannot assign locked non-temporary object");   
-            // }
-            resetTmp(val);
-          }
-          auto& valref = ar->add(sym, std::move(val));
+          auto& valref = assign(*ar, sym, std::move(val), k->next->atype & Kont::REF);
           setIfFuture(valref, ar);
-          if (k->next->atype & Kont::REF) setRef(valref); else resetRef(valref);
         }
       }
       else {
@@ -745,7 +924,7 @@ shared_ptr<Kont> interp::step(shared_ptr<Kont>& k, vector<shpfrm>& fstack, zcore
     }
     case etcode: {              // e.g. lazy function args
       auto c = static_cast<const Code*>(k->control);
-      return make_shared<Kont>(Kont{nullptr, c->e, k->r, k->next, Kont::NORMAL});
+      return make_pooled<Kont>(Kont{nullptr, c->e, k->r, k->next, Kont::NORMAL});
     }
     // Request ---------
     case etrequest: {
@@ -774,9 +953,9 @@ shared_ptr<Kont> interp::step(shared_ptr<Kont>& k, vector<shpfrm>& fstack, zcore
     case etifelse: {
       auto ie = static_cast<const IfElse*>(k->control);
       if (funcs::isTrue(val::gval(evalAtom(ie->e1, k->r, ic)))) {
-        return make_shared<Kont>(Kont{nullptr, ie->e2, k->r, k->next, Kont::NORMAL});
+        return make_pooled<Kont>(Kont{nullptr, ie->e2, k->r, k->next, Kont::NORMAL});
       } else {
-        return make_shared<Kont>(Kont{nullptr, ie->e3, k->r, k->next, Kont::NORMAL});
+        return make_pooled<Kont>(Kont{nullptr, ie->e3, k->r, k->next, Kont::NORMAL});
       }                         
     }
     // ExprSublist - function invocation -----
@@ -802,8 +981,16 @@ shared_ptr<Kont> interp::step(shared_ptr<Kont>& k, vector<shpfrm>& fstack, zcore
       }
     } 
     // While --------
-    case etwhile:
+    case etwhile: {
+      // run the loop in the VM when it can be compiled and none of the
+      // symbols it reads is a future; otherwise step through it:
+      const auto code = vm::compile(static_cast<const While*>(k->control));
+      if (code && vm::run(*code, k->r)) {
+        k->next->atype |= interp::Kont::SILENT;
+        return applyKont(k, fstack, val::VNull());
+      }
       return insertWhile(k, fstack);
+    }
     // For --------
     case etfor: {
       auto forexpr = static_cast<const For*>(k->control);
@@ -127,6 +127,11 @@ namespace interp {
                         zcore::InterpCtx& ic);
 
 
+  /// Assign 'val' to the symbol 's' in frame 'r' as a local '<-'
+  /// does; 'isRef' marks the assigned value as a reference.
+  val::Value& assign(BaseFrame& r, const string& s, val::Value&& val, bool isRef);
+
+
   shared_ptr<Kont> buildElChain(const ElNode* eln, 
                                 unsigned n, 
                                 shared_ptr<BaseFrame> r, 
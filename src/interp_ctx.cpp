@@ -215,12 +215,75 @@ static ssize_t readHeader(const char* buf,
     val = (*l)[s];
     off += sz + 1; 
   }
+  if (val::isReadOnly(val)) {
+    lg.log(zlog::SV_DEBUG, "invalid append: read-only target");
+    return -1;
+  }
   off = slen;
   return 0;
 }
 
 
-ssize_t zcore::InterpCtx::readAppendData(const char* buf, size_t len) {
+/// Length of the target of an append, -1 if it can't be appended to.
+static int64_t getAppendLength(const val::Value& val) {
+  switch(val.which()) {
+  case val::vt_zts:
+    return get<val::SpZts>(val)->getdim(0);
+  case val::vt_double:
+    return get<val::SpVAD>(val)->getdim(0);
+  case val::vt_time:
+    return get<val::SpVADT>(val)->getdim(0);
+  case val::vt_duration:
+    return get<val::SpVADUR>(val)->getdim(0);
+  case val::vt_interval:
+    return get<val::SpVAIVL>(val)->getdim(0);
+  case val::vt_bool:
+    return get<val::SpVAB>(val)->getdim(0);
+  default:
+    return -1;
+  }
+}
+
+
+/// Bring the target of a replayed append back to 'replayLen', the
+/// length it had before the append, so that an append that did reach
+/// the target, in full or in part, is applied again from the
+/// start. Returns false if the target is shorter, i.e. if appends
+/// before this one were lost.
+static bool rewindAppendTarget(val::Value& val, int64_t len, int64_t replayLen) {
+  if (len < replayLen) {
+    return false;
+  }
+  if (len == replayLen) {
+    return true;
+  }
+  switch(val.which()) {
+  case val::vt_zts:
+    get<val::SpZts>(val).get()->resize(0, replayLen);   // get() to avoid the copy
+    break;
+  case val::vt_double:
+    get<val::SpVAD>(val).get()->resize(0, replayLen);   // get() to avoid the copy
+    break;
+  case val::vt_time:
+    get<val::SpVADT>(val).get()->resize(0, replayLen);  // get() to avoid the copy
+    break;
+  case val::vt_duration:
+    get<val::SpVADUR>(val).get()->resize(0, replayLen); // get() to avoid the copy
+    break;
+  case val::vt_interval:
+    get<val::SpVAIVL>(val).get()->resize(0, replayLen); // get() to avoid the copy
+    break;
+  case val::vt_bool:
+    get<val::SpVAB>(val).get()->resize(0, replayLen);   // get() to avoid the copy
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+
+ssize_t zcore::InterpCtx::readAppendData(const char* buf, size_t len, int64_t replayLen) {
 #ifdef DEBUG
   cout << "InterpCtx::readAppendData():" << endl;
   //  cout << printBuf(buf, len) << endl;
@@ -230,7 +293,19 @@ ssize_t zcore::InterpCtx::readAppendData(const char* buf, size_t len) {
     val::Value val;
     auto res = readHeader(buf, len, off, val, r);
     if (res < 0) return res;
-    
+    const auto hdrlen = off;
+    const auto prelen = getAppendLength(val);
+    if (prelen < 0) {
+      lg.log(zlog::SV_DEBUG, "invalid append: incorrect type");
+      return -1;
+    }
+    if (replayLen >= 0 && !rewindAppendTarget(val, prelen, replayLen)) {
+      lg.log(zlog::SV_ERROR, "append log replay: target shorter than logged, appends lost");
+      return -1;
+    }
+    // write-ahead: the record is logged before the target changes:
+    ir.logAppend(Global::MsgType::APPEND, buf, len, hdrlen, replayLen >= 0 ? replayLen : prelen);
+
     switch(val.which()) {
     case val::vt_zts:
       get<val::SpZts>(val).get()->append(buf + off, len - off, off);   // get() to avoid the copy
@@ -269,7 +344,7 @@ ssize_t zcore::InterpCtx::readAppendData(const char* buf, size_t len) {
 }
 
 
-ssize_t zcore::InterpCtx::readAppendVectorData(const char* buf, size_t len) {
+ssize_t zcore::InterpCtx::readAppendVectorData(const char* buf, size_t len, int64_t replayLen) {
 #ifdef DEBUG
   cout << "InterpCtx::readAppendVectorData():" << endl;
   //  cout << printBuf(buf, len) << endl;
@@ -280,6 +355,17 @@ ssize_t zcore::InterpCtx::readAppendVectorData(const char* buf, size_t len) {
     val::Value val;
     auto res = readHeader(buf, len, off, val, r);
     if (res < 0) return res;
+    const auto prelen = getAppendLength(val);
+    if (prelen < 0) {
+      lg.log(zlog::SV_DEBUG, "invalid append: incorrect type");
+      return -1;
+    }
+    if (replayLen >= 0 && !rewindAppendTarget(val, prelen, replayLen)) {
+      lg.log(zlog::SV_ERROR, "append log replay: target shorter than logged, appends lost");
+      return -1;
+    }
+    // write-ahead: the record is logged before the target changes:
+    ir.logAppend(Global::MsgType::APPEND_VECTOR, buf, len, off, replayLen >= 0 ? replayLen : prelen);
 
     switch(val.which()) {
     case val::vt_zts:
@@ -317,6 +403,177 @@ ssize_t zcore::InterpCtx::readAppendVectorData(const char* buf, size_t len) {
 }
 
 
+size_t zcore::InterpCtx::readAppendBatch(Global::MsgType mt, 
+                                         const std::vector<Global::bufptr_pair>& bufs) {
+  auto readOneByOne = [this, mt, &bufs]() {
+    size_t nfail = 0;
+    for (const auto& b : bufs) {
+      auto res = mt == Global::MsgType::APPEND ? 
+        readAppendData(b.first, b.second) : 
+        readAppendVectorData(b.first, b.second);
+      nfail += res != 0;
+    }
+    return nfail;
+  };
+  if (bufs.size() < 2) {
+    return readOneByOne();
+  }
+
+  size_t off = 0;
+  val::Value val;
+  try {
+    if (readHeader(bufs[0].first, bufs[0].second, off, val, r) < 0) {
+      return bufs.size();
+    }
+  }
+  catch (std::exception& e) {
+    lg.log(zlog::SV_DEBUG, "invalid append: %s", e.what());
+    return bufs.size();
+  }
+  const auto hdrlen = off;
+  auto prelen = getAppendLength(val);
+  if (prelen < 0) {
+    lg.log(zlog::SV_DEBUG, "invalid append: incorrect type");
+    return bufs.size();
+  }
+
+  std::vector<Global::bufptr_pair> data;
+  for (const auto& b : bufs) {
+    data.emplace_back(b.first + hdrlen, b.second - hdrlen);
+  }
+  std::vector<arr::idx_type> rows;
+  try {
+    if (mt == Global::MsgType::APPEND) {
+      // write-ahead: each record is logged with the length the target
+      // will have before it, given by the row counts that start the
+      // buffers. Should the batch fail, 'readOneByOne' logs the
+      // buffers again, which is harmless as a replay rewinds the
+      // target to the length of each record before applying it:
+      auto logLen = prelen;
+      for (size_t i=0; i<bufs.size(); ++i) {
+        const auto adim = arr::Vector<arr::idx_type>(const_cast<char*>(data[i].first), data[i].second);
+        if (adim.size() == 0) {
+          throw std::out_of_range("invalid append buffer: no dimensions");
+        }
+        ir.logAppend(mt, bufs[i].first, bufs[i].second, hdrlen, logLen);
+        logLen += adim[0];
+      }
+      std::vector<size_t> offsets;
+      switch(val.which()) {
+      case val::vt_zts:
+        get<val::SpZts>(val).get()->appendBatch(data, rows);             // get() to avoid the copy
+        break;
+      case val::vt_double:
+        get<val::SpVAD>(val).get()->appendBatch(data, offsets, rows);    // get() to avoid the copy
+        break;
+      case val::vt_time:
+        get<val::SpVADT>(val).get()->appendBatch(data, offsets, rows);   // get() to avoid the copy
+        break;
+      case val::vt_duration:
+        get<val::SpVADUR>(val).get()->appendBatch(data, offsets, rows);  // get() to avoid the copy
+        break;
+      case val::vt_interval:
+        get<val::SpVAIVL>(val).get()->appendBatch(data, offsets, rows);  // get() to avoid the copy
+        break;
+      case val::vt_bool:
+        get<val::SpVAB>(val).get()->appendBatch(data, offsets, rows);    // get() to avoid the copy
+        break;
+      default:
+        lg.log(zlog::SV_DEBUG, "invalid append: incorrect type");
+        return bufs.size();
+      }
+    }
+    else {
+      // vectors are appended element by element anyway, so only the
+      // lookup is shared:
+      size_t nfail = 0;
+      for (size_t i=0; i<bufs.size(); ++i) {
+        try {
+          auto& d = data[i];
+          ir.logAppend(mt, bufs[i].first, bufs[i].second, hdrlen, prelen);
+          switch(val.which()) {
+          case val::vt_zts:
+            get<val::SpZts>(val).get()->appendVector(d.first, d.second);   // get() to avoid the copy
+            break;
+          case val::vt_double:
+            get<val::SpVAD>(val).get()->appendVector(d.first, d.second);   // get() to avoid the copy
+            break;
+          case val::vt_time:
+            get<val::SpVADT>(val).get()->appendVector(d.first, d.second);  // get() to avoid the copy
+            break;
+          case val::vt_duration:
+            get<val::SpVADUR>(val).get()->appendVector(d.first, d.second); // get() to avoid the copy
+            break;
+          case val::vt_interval:
+            get<val::SpVAIVL>(val).get()->appendVector(d.first, d.second); // get() to avoid the copy
+            break;
+          case val::vt_bool:
+            get<val::SpVAB>(val).get()->appendVector(d.first, d.second);   // get() to avoid the copy
+            break;
+          default:
+            lg.log(zlog::SV_DEBUG, "invalid append: incorrect type");
+            return bufs.size();
+          }
+        }
+        catch (std::exception& e) {
+          lg.log(zlog::SV_DEBUG, "invalid append: %s", e.what());
+          ++nfail;
+          prelen = getAppendLength(val);
+          continue;
+        }
+        prelen = getAppendLength(val);
+        ++stats.nbAppendVector;
+        stats.bytesAppendVector += bufs[i].second;
+      }
+      stats.nbAppendCoalesced += bufs.size() - nfail;
+      return nfail;
+    }
+  }
+  catch (std::exception& e) {
+    // nothing was appended; find out which buffers are at fault:
+    return readOneByOne();
+  }
+
+  for (size_t i=0; i<bufs.size(); ++i) {
+    ++stats.nbAppend;
+    stats.bytesAppend += bufs[i].second;
+  }
+  stats.nbAppendCoalesced += bufs.size();
+  return 0;
+}
+
+
+void zcore::InterpCtx::msyncAppendTarget(const std::string& hdr) {
+  size_t off = 0;
+  val::Value val;
+  if (readHeader(hdr.data(), hdr.size(), off, val, r) < 0) {
+    return;
+  }
+  switch(val.which()) {
+  case val::vt_zts:
+    get<val::SpZts>(val)->msync(false);
+    break;
+  case val::vt_double:
+    get<val::SpVAD>(val)->msync(false);
+    break;
+  case val::vt_time:
+    get<val::SpVADT>(val)->msync(false);
+    break;
+  case val::vt_duration:
+    get<val::SpVADUR>(val)->msync(false);
+    break;
+  case val::vt_interval:
+    get<val::SpVAIVL>(val)->msync(false);
+    break;
+  case val::vt_bool:
+    get<val::SpVAB>(val)->msync(false);
+    break;
+  default:
+    break;
+  }
+}
+
+
 
 void zcore::InterpState::popAndClearUntil(const interp::shpfrm r) {
   for (auto i = fstack.size(); i > 0; --i) {
@@ -361,7 +618,7 @@ ssize_t zcore::InterpCtx::readReqData(Global::conn_id_t peerid,
     // variables; this makes sure that the expression has access to
     // these bound variables and that they will get destroyed after
     // expression evaluation (including if an exception occurs):
-    interp::shpfrm sr = make_shared<interp::ShadowFrame>(r, nullptr, r->ec, nullptr);
+    interp::shpfrm sr = interp::make_pooled<interp::ShadowFrame>(r, nullptr, r->ec, nullptr);
 
     // get the bound variables and insert them in the shadow frame:
     auto bndvars = std::move(req.valstack[0].val);
@@ -370,9 +627,9 @@ ssize_t zcore::InterpCtx::readReqData(Global::conn_id_t peerid,
       sr->add(bndvarsList->a.getnames(0)[i], val::Value(bndvarsList->a[i]));
     }
 
-    auto halt = make_shared<interp::Kont>(interp::Kont{nullptr, nullptr, sr, 
+    auto halt = interp::make_pooled<interp::Kont>(interp::Kont{nullptr, nullptr, sr, 
           nullptr, interp::Kont::NORMAL});
-    auto k = make_shared<interp::Kont>(interp::Kont{nullptr, req.e.get(), sr, 
+    auto k = interp::make_pooled<interp::Kont>(interp::Kont{nullptr, req.e.get(), sr, 
           halt, interp::Kont::NORMAL});
     auto state = states.emplace(make_pair(reqid, 
                                           InterpState{reqid,
@@ -529,10 +786,10 @@ int zcore::InterpCtxLocal::processReqData(Global::conn_id_t peerid,
   cout << "| sourceid: " << sourceid << endl;
 #endif  
 
-  interp::shpfrm sr = make_shared<interp::ShadowFrame>(r, nullptr, r->ec, nullptr);
-  auto halt = make_shared<interp::Kont>(interp::Kont{nullptr, nullptr, sr, 
+  interp::shpfrm sr = interp::make_pooled<interp::ShadowFrame>(r, nullptr, r->ec, nullptr);
+  auto halt = interp::make_pooled<interp::Kont>(interp::Kont{nullptr, nullptr, sr, 
         nullptr, interp::Kont::NORMAL});
-  auto k = make_shared<interp::Kont>(interp::Kont{nullptr, e.get(), sr, halt, interp::Kont::NORMAL});
+  auto k = interp::make_pooled<interp::Kont>(interp::Kont{nullptr, e.get(), sr, halt, interp::Kont::NORMAL});
   auto state = states.emplace(make_pair(reqid, 
                                         InterpState{reqid,
                                                     sourceid,
@@ -922,10 +1179,10 @@ int zcore::InterpCtxTimer::interpretTimer(int fd) {
   auto sourceid = static_cast<Global::reqid_t>(fd); // check this!!! LLL
   Global::conn_id_t peerid = 0;
 
-  interp::shpfrm sr = make_shared<interp::ShadowFrame>(r, nullptr, r->ec, nullptr);
-  auto halt = make_shared<interp::Kont>(interp::Kont{nullptr, nullptr, sr, 
+  interp::shpfrm sr = interp::make_pooled<interp::ShadowFrame>(r, nullptr, r->ec, nullptr);
+  auto halt = interp::make_pooled<interp::Kont>(interp::Kont{nullptr, nullptr, sr, 
         nullptr, interp::Kont::NORMAL});
-  auto k = make_shared<interp::Kont>(interp::Kont{nullptr, e.get(), sr, halt, interp::Kont::NORMAL});
+  auto k = interp::make_pooled<interp::Kont>(interp::Kont{nullptr, e.get(), sr, halt, interp::Kont::NORMAL});
   auto state = states.emplace(make_pair(reqid, 
                                         InterpState{reqid,
                                             sourceid,
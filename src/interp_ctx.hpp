@@ -151,10 +151,23 @@ namespace zcore {
                         Global::reqid_t sourceid, 
                         const char* buf, 
                         size_t len);
-    /// Read a buffer containing an array to append.
-    ssize_t readAppendData(const char* buf, size_t len);
+    /// Read a buffer containing an array to append. When replaying
+    /// the append log, 'replayLen' is the length the target had
+    /// before the append; a longer target is cut back to that length
+    /// before the append is applied again, and a shorter one is an
+    /// error.
+    ssize_t readAppendData(const char* buf, size_t len, int64_t replayLen=-1);
     /// Read a buffer containing a vector to append.
-    ssize_t readAppendVectorData(const char* buf, size_t len);
+    ssize_t readAppendVectorData(const char* buf, size_t len, int64_t replayLen=-1);
+    /// Read consecutive buffers of type 'mt' (APPEND or APPEND_VECTOR)
+    /// whose headers designate the same target: the target is looked
+    /// up once, and for APPEND it grows and has its ordering checked
+    /// once for all the buffers. Returns the number of buffers that
+    /// could not be appended.
+    size_t readAppendBatch(Global::MsgType mt, const std::vector<Global::bufptr_pair>& bufs);
+    /// Synchronously 'msync' the target of an append; 'hdr' is the
+    /// header of the append message that designates the target.
+    void msyncAppendTarget(const std::string& hdr);
 
     /// Establish connection to given ip/port.
     Global::conn_id_t connect(const string& ip_p, int port_p); 
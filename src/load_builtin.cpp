@@ -164,6 +164,10 @@ void core::loadBuiltinFunctions(interp::BaseFrame* r) {
                  "function(reset=FALSE) NULL\n", 
                  funcs::stats_ctx, true,
                  {{"reset",  {{val::vt_bool  }, true}}});
+  val::VBuiltinG(r, "stats.mem", 
+                 "function(reset=FALSE, x=NULL) NULL\n", 
+                 funcs::stats_mem, true,
+                 {{"reset",  {{val::vt_bool  }, true}}});
   val::VBuiltinG(r, "info.net", "function() NULL\n", funcs::info_net);
   val::VBuiltinG(r, "info.msg", "function() NULL\n", funcs::info_msg);
   val::VBuiltinG(r, "info.ctx", "function() NULL\n", funcs::info_ctx);
@@ -212,6 +216,11 @@ void core::loadBuiltinFunctions(interp::BaseFrame* r) {
                  funcs::zts_truncate, true,
                  {{"x"    , {{val::vt_zts}, true}},
                   {"end",   {{val::vt_double,val::vt_time}, true}}});
+  val::VBuiltinG(r, "zts.reorder", "function(x, window, late=\"reject\") NULL\n", 
+                 funcs::zts_reorder, true,
+                 {{"x"     , {{val::vt_zts}, true}},
+                  {"window", {{val::vt_duration}, true}},
+                  {"late",   {{val::vt_string}, true}}});
 
   val::VBuiltinG(r, "rbind", "function(...) NULL\n", funcs::rbind);
   val::VBuiltinG(r, "cbind", "function(...) NULL\n", funcs::cbind);
@@ -233,11 +242,15 @@ void core::loadBuiltinFunctions(interp::BaseFrame* r) {
                   {"loop_max", {{val::vt_double},   true}}});
   val::VBuiltinG(r,
                  "zts",
-                 "function(idx, data = NaN, file=\"\") NULL\n",
+                 "function(idx, data = NaN, file=\"\", compress=FALSE, segmented=FALSE, "
+                 "container=FALSE) NULL\n",
                  funcs::make_zts, true,
                  {{"idx",      {{val::vt_time              }, true}},
                   {"data",     {{val::vt_double            }, true}},
-                  {"file",     {{val::vt_string            }, true}}});
+                  {"file",     {{val::vt_string            }, true}},
+                  {"compress", {{val::vt_bool              }, true}},
+                  {"segmented", {{val::vt_bool             }, true}},
+                  {"container", {{val::vt_bool             }, true}}});
   val::VBuiltinG(r,
                  "zts.idx",
                  "function(zts) NULL\n",
@@ -288,8 +301,11 @@ void core::loadBuiltinFunctions(interp::BaseFrame* r) {
   val::VBuiltinG(r, "dblsubset", "function(...) NULL\n", funcs::dblsubset);
   val::VBuiltinG(r, "subassign", "function(...) NULL\n", funcs::subassign);
   val::VBuiltinG(r, "dblsubassign", "function(...) NULL\n", funcs::dblsubassign);
-  val::VBuiltinG(r, "load", "function(file) NULL\n", funcs::load, true,
-                 {{"file", {{val::vt_string}, true}}});
+  val::VBuiltinG(r, "load", "function(file, readonly=FALSE, advice=\"normal\") NULL\n",
+                 funcs::load, true,
+                 {{"file",     {{val::vt_string}, true}},
+                  {"readonly", {{val::vt_bool  }, true}},
+                  {"advice",   {{val::vt_string}, true}}});
   
   val::VBuiltinG(r,
                 "sort",
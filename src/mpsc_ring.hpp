@@ -0,0 +1,118 @@
+// (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef MPSC_RING_HPP
+#define MPSC_RING_HPP
+
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+
+namespace net {
+
+  /// Bounded lock-free queue with multiple producers and a single
+  /// consumer. Each cell carries a sequence number telling whether it
+  /// is free for the producer claiming position 'pos' (seq == pos) or
+  /// filled for the consumer reading it (seq == pos + 1), after
+  /// D. Vyukov's bounded queue. Producers claim a position with a CAS
+  /// on 'tail'; the consumer being alone, 'head' is only a counter.
+  template <typename T>
+  struct MpscRing {
+    /// 'capacity_p' is rounded up to a power of 2.
+    MpscRing(size_t capacity_p) :
+      capacity(roundup(capacity_p)), mask(capacity - 1),
+      cells(new Cell[capacity]), head(0), tail(0)
+    {
+      for (size_t i=0; i<capacity; ++i) {
+        cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    /// Append 'e'; returns 'false' without moving from 'e' if the
+    /// queue is full.
+    bool push(T&& e) {
+      auto pos = tail.load(std::memory_order_relaxed);
+      for (;;) {
+        auto& cell = cells[pos & mask];
+        auto seq = cell.seq.load(std::memory_order_acquire);
+        auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (dif == 0) {
+          if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            cell.e = std::move(e);
+            cell.seq.store(pos + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (dif < 0) {
+          return false;         // full
+        }
+        else {
+          pos = tail.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    /// Take the oldest element; only to be called by the consumer.
+    bool pop(T& e) {
+      const auto h = head.load(std::memory_order_relaxed);
+      auto& cell = cells[h & mask];
+      if (cell.seq.load(std::memory_order_acquire) != h + 1) {
+        return false;           // empty, or a producer is still writing
+      }
+      e = std::move(cell.e);
+      cell.seq.store(h + capacity, std::memory_order_release);
+      head.store(h + 1, std::memory_order_relaxed);
+      return true;
+    }
+
+    /// Approximate number of elements, as seen by a producer.
+    size_t size() const {
+      auto t = tail.load(std::memory_order_relaxed);
+      auto h = head.load(std::memory_order_relaxed);
+      return t > h ? t - h : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    const size_t capacity;
+
+  private:
+    struct Cell {
+      std::atomic<size_t> seq;
+      T e;
+    };
+
+    static size_t roundup(size_t n) {
+      size_t c = 2;
+      while (c < n) c <<= 1;
+      return c;
+    }
+
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    // on separate cache lines, as written by different threads:
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+  };
+
+}
+
+
+#endif
@@ -21,6 +21,7 @@
 #include <poll.h>
 #include <unistd.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include "parser_ctx.hpp"
 #include "globals.hpp"
 #include "anf.hpp"
@@ -30,6 +31,7 @@
 #include "interp_error.hpp"
 #include "logging.hpp"
 #include "msg_handler.hpp"
+#include "columns.hpp"
 
 
 // #define _DEBUG
@@ -61,7 +63,8 @@ zcore::MsgHandler::MsgHandler(net::NetHandler& com_p,
                               const std::string& initialCode) : 
   com(com_p), global(global_p), fd_read_data(fd_read_data_p), 
   fd_read_sig(fd_read_sig_p), fd_input(fd_input_p), once(once_p), 
-  localContext(make_unique<InterpCtxLocal>(*this, global))
+  localContext(make_unique<InterpCtxLocal>(*this, global)),
+  walTimerFd(-1), walCheckpointBytes(0), walReplaying(false)
 { 
   resetMsgStats();
 
@@ -138,6 +141,183 @@ zcore::MsgHandler::MsgHandler(net::NetHandler& com_p,
       cout << prompt << flush;
     }
   }
+
+  // the append log is replayed once the initial code has loaded the
+  // persistent arrays it refers to:
+  auto walpath = get<string>(cfg::cfgmap.get("wal.path"));
+  if (!walpath.empty()) {
+    openAppendLog(walpath);
+  }
+}
+
+
+zcore::MsgHandler::~MsgHandler() {
+  if (walTimerFd != -1) {
+    close(walTimerFd);
+  }
+}
+
+
+void zcore::MsgHandler::openAppendLog(const std::string& filename) {
+  const auto syncms = get<int64_t>(cfg::cfgmap.get("wal.sync.ms"));
+  const auto syncbytes = get<int64_t>(cfg::cfgmap.get("wal.sync.bytes"));
+  walCheckpointBytes = get<int64_t>(cfg::cfgmap.get("wal.checkpoint.bytes"));
+  if (syncms <= 0 || syncbytes <= 0) {
+    throw std::range_error("wal.sync.ms and wal.sync.bytes must be positive");
+  }
+  wal = make_unique<AppendLog>(filename, syncbytes, std::chrono::milliseconds(syncms));
+
+  walReplaying = true;
+  size_t nbapplied = 0;
+  auto nbrecords = wal->replay([this, &nbapplied](Global::MsgType mt,
+                                                  const char* buf,
+                                                  size_t len,
+                                                  uint64_t prelen) {
+    auto res = mt == Global::MsgType::APPEND ?
+      localContext->readAppendData(buf, len, prelen) :
+      localContext->readAppendVectorData(buf, len, prelen);
+    if (res == 0) {
+      ++nbapplied;
+    }
+    // 'buf' starts with the length of the header (see 'readHeader'):
+    uint64_t hdrlen;
+    memcpy(&hdrlen, buf, sizeof(hdrlen));
+    hdrlen = ntoh64(hdrlen) & 0xffffffff;
+    if (hdrlen <= len) {
+      walTargets.emplace(buf, hdrlen);
+    }
+  });
+  walReplaying = false;
+  lg.log(zlog::SV_INFO, "append log %s: %zu records, %zu replayed",
+         filename.c_str(), nbrecords, nbapplied);
+  checkpointAppendLog();
+
+  // the timer makes sure appends are synced within 'wal.sync.ms'
+  // even when no more appends come in:
+  walTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (walTimerFd == -1) {
+    throw std::system_error(std::error_code(errno, std::system_category()), "timerfd_create");
+  }
+  itimerspec its;
+  its.it_value.tv_sec  = syncms / 1000;
+  its.it_value.tv_nsec = (syncms % 1000) * 1000000;
+  its.it_interval = its.it_value;
+  if (timerfd_settime(walTimerFd, 0, &its, NULL) == -1) {
+    throw std::system_error(std::error_code(errno, std::system_category()), "timerfd_settime");
+  }
+  epoll_event ev;
+  memset(&ev, 0, sizeof(epoll_event));
+  ev.events = EPOLLIN;
+  ev.data.fd = walTimerFd;
+  if (epoll_ctl(epollfd, EPOLL_CTL_ADD, walTimerFd, &ev) == -1) {
+    throw std::system_error(std::error_code(errno, std::system_category()), "epoll_ctl");
+  }
+}
+
+
+void zcore::MsgHandler::logAppend(Global::MsgType mt, const char* buf, size_t len,
+                                  size_t hdrlen, uint64_t prelen) {
+  if (!wal || walReplaying) {
+    return;
+  }
+  wal->append(mt, buf, len, prelen);
+  walTargets.emplace(buf, hdrlen);
+}
+
+
+/// Make all the appends in the log durable in their targets, after
+/// which the log can be discarded.
+void zcore::MsgHandler::checkpointAppendLog() {
+  wal->flush(true);
+  for (const auto& hdr : walTargets) {
+    try {
+      localContext->msyncAppendTarget(hdr);
+    }
+    catch (std::exception& e) {
+      // keep the log, it's the only durable copy of these appends:
+      lg.log(zlog::SV_ERROR, "append log checkpoint failed: %s", e.what());
+      return;
+    }
+  }
+  walTargets.clear();
+  wal->truncate();
+}
+
+
+bool zcore::MsgHandler::canCoalesce(Global::conn_id_t id, const net::Buf& buf) const {
+  if (appends.empty()) {
+    return true;
+  }
+  const auto& first = appends.front();
+  if (first.id != id || memcmp(first.data.get(), buf.data.get(), sizeof(uint64_t)) != 0) {
+    return false;               // not from the same peer, or not of the same type
+  }
+  // same target if same header, whose length is at its start (see
+  // 'readHeader'):
+  const size_t HDROFF = sizeof(uint64_t);
+  if (first.len < HDROFF + sizeof(uint64_t) || buf.len < HDROFF + sizeof(uint64_t)) {
+    return false;
+  }
+  uint64_t hdrlen;
+  memcpy(&hdrlen, first.data.get() + HDROFF, sizeof(hdrlen));
+  hdrlen = ntoh64(hdrlen) & 0xffffffff;
+  return hdrlen <= first.len - HDROFF && hdrlen <= buf.len - HDROFF &&
+    memcmp(first.data.get() + HDROFF, buf.data.get() + HDROFF, hdrlen) == 0;
+}
+
+
+void zcore::MsgHandler::flushAppends() {
+  if (appends.empty()) {
+    return;
+  }
+  const auto id = appends.front().id;
+  Global::MsgType mt;
+  memcpy(&mt, appends.front().data.get(), sizeof(mt));
+  mt = static_cast<Global::MsgType>(ntoh64(static_cast<uint64_t>(mt)));
+  ++stats.nbAppendBatch;
+  std::vector<Global::bufptr_pair> bufs;
+  for (const auto& b : appends) {
+    bufs.emplace_back(b.data.get() + 8, b.len - 8);
+    if (mt == Global::MsgType::APPEND) {
+      stats.bytesAppend += b.len;
+      ++stats.nbAppend;
+    }
+    else {
+      stats.bytesAppendVector += b.len;
+      ++stats.nbAppendVector;
+    }
+  }
+
+  auto ic = reqContexts.find(id);
+  if (ic == reqContexts.end()) {
+    lg.log(zlog::SV_DEBUG, "can't find interp context in reqContexts for id=%d", id);
+  }
+  else {
+    try {
+      auto nfail = ic->second->readAppendBatch(mt, bufs); // shouldn't throw
+      if (mt == Global::MsgType::APPEND) {
+        stats.nbAppendFail += nfail;
+      }
+      else {
+        stats.nbAppendVectorFail += nfail;
+      }
+    }
+    catch (std::exception& e) {
+      lg.log(zlog::SV_DEBUG, "unexpected exception: %s", e.what());
+    }
+  }
+  appends.clear();              // the buffers go back to their pool
+
+  // the records are written before their appends are applied, so the
+  // log is only checkpointed once the whole batch is applied:
+  if (wal && wal->size() >= walCheckpointBytes) {
+    try {
+      checkpointAppendLog();
+    }
+    catch (std::exception& e) {
+      lg.log(zlog::SV_ERROR, "append log checkpoint failed: %s", e.what());
+    }
+  }
 }
 
 
@@ -236,10 +416,27 @@ int MsgHandler::run() {
           throw std::system_error(std::error_code(errno, std::system_category()), "read(fd_read_data)");
         }
 
-        // get message signalled by the event:
+        // one signal covers all the buffers queued until now; take at
+        // most 'DATA_BATCH' of them so that the keyboard and the other
+        // events get their turn, and have the network side signal again
+        // for what we leave behind, whichever way we leave the loop:
+        com.ackDataSignal();
+        struct Resignal {
+          net::NetHandler& com;
+          ~Resignal() {
+            // may run while unwinding, so it must not throw:
+            try {
+              com.resignalData();
+            }
+            catch (std::exception& e) {
+              lg.log(zlog::SV_ERROR, "cannot resignal data: %s", e.what());
+            }
+          }
+        } resignal{com};
         Global::conn_id_t id;
         net::Buf combuf;
-        while (val-- > 0 && com.get_data(id, combuf)) { // second probably not necessary LLL
+        size_t nbuf = 0;
+        while (nbuf++ < DATA_BATCH && com.get_data(id, combuf)) {
           const char* buf = combuf.data.get();
         
           auto len = combuf.len;
@@ -260,39 +457,17 @@ int MsgHandler::run() {
           
           // APPEND or APPEND_VECTOR ----------------------------
           if (mt == Global::MsgType::APPEND || mt == Global::MsgType::APPEND_VECTOR) {
-            auto ic = reqContexts.find(id);
-            if (ic == reqContexts.end()) {
-              lg.log(zlog::SV_DEBUG, "can't find interp context in reqContexts for id=%d", id);
-              break;
-            }
-            auto& evalCtx = *ic->second;
-            if (mt == Global::MsgType::APPEND) {
-              stats.bytesAppend += len;
-              ++stats.nbAppend;
-              try {
-                if (evalCtx.readAppendData(buf+8, len-8) != 0) { // shouldn't throw
-                  ++stats.nbAppendFail;
-                }
-              }
-              catch (std::exception& e) {
-                lg.log(zlog::SV_DEBUG, "unexpected exception: %s", e.what());
-              }    
-            }
-            else {
-              stats.bytesAppendVector += len;
-              ++stats.nbAppendVector;
-              try {
-                if (evalCtx.readAppendVectorData(buf+8, len-8) != 0) {
-                  ++stats.nbAppendVectorFail;                  
-                }
-              }
-              catch (std::exception& e) {
-                lg.log(zlog::SV_DEBUG, "unexpected exception: %s", e.what());
-              }    
+            // held back, so that it can be applied together with the
+            // appends to the same target that follow it:
+            if (!canCoalesce(id, combuf)) {
+              flushAppends();
             }
+            combuf.id = id;
+            appends.emplace_back(std::move(combuf));
           }
           // REQ or RSP ----------------------------
           else {
+            flushAppends();       // keep the order of the messages
             Global::reqid_t reqid;
             memcpy(&reqid, buf+8, sizeof(reqid));
             reqid = ntoh64(reqid);
@@ -307,7 +482,7 @@ int MsgHandler::run() {
               auto ic = reqContexts.find(id);
               if (ic == reqContexts.end()) {
                 lg.log(zlog::SV_DEBUG, "can't find interp context in reqContexts for id=%d", id);
-                break;
+                continue;
               }
               auto& evalCtx = *ic->second;
               stats.bytesInREQ += len;
@@ -323,7 +498,7 @@ int MsgHandler::run() {
               auto ic = rspContexts.find(id);
               if (ic == rspContexts.end()) {
                 lg.log(zlog::SV_DEBUG, "can't find interp context in rspContexts for id=%d", id);
-                break;
+                continue;
               }
               stats.bytesInRSP += len;
               ++stats.nbInRSP;
@@ -341,6 +516,7 @@ int MsgHandler::run() {
             }  
           }
         }
+        flushAppends();
       }
       // keyboard: ----------------------------------------------
       else if (events[i].data.fd == fd_input) {
@@ -429,6 +605,21 @@ int MsgHandler::run() {
           // 'pctx.prog' will be deleted when 'pctx' goes out of scope 
         }
       }
+      // append log group commit: ----------------------------------
+      else if (events[i].data.fd == walTimerFd) {
+        uint64_t count;
+        if (read(walTimerFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "read");
+        }
+        try {
+          if (wal->syncDue()) {
+            wal->flush(true);
+          }
+        }
+        catch (std::exception& e) {
+          lg.log(zlog::SV_ERROR, "append log sync failed: %s", e.what());
+        }
+      }
       // it's a timer: ----------------------------------------------
       else {
         uint64_t count;
@@ -451,6 +642,15 @@ int MsgHandler::run() {
         }          
       }
     } // end for loop
+
+    // no evaluation is in progress, so no column can be referenced
+    // and we can unmap the ones least recently used:
+    try {
+      arr::ColumnCache::instance().trim();
+    }
+    catch (std::exception& e) {
+      lg.log(zlog::SV_ERROR, "column unmapping failed: %s", e.what());
+    }
   } // end for loop
   return 0;
 }
@@ -490,6 +690,9 @@ size_t MsgHandler::sendReq(InterpCtx* reqCtx,
   if (peerid == 0) {
     throw std::range_error("send request failed: no connection to peer");
   }
+  if (!com.admit(peerid)) {
+    throw std::range_error("send request failed: outbound queue full");
+  }
   try {
     zcore::Encode ec(com, peerid, reqid, sourceid, Global::MsgType::REQ);
     ec << e;
@@ -531,6 +734,10 @@ size_t MsgHandler::sendRsp(Global::conn_id_t peerid,
   // thread would not have to wait on the sending itself.
 #endif
 
+  if (!com.admit(peerid)) {
+    lg.log(zlog::SV_INFO, "outbound queue full, dropping response to id: %d", peerid);
+    return 0;
+  }
   try {
     zcore::Encode ec(com, peerid, reqid, sourceid, Global::MsgType::RSP);
     ec << rsp;
@@ -23,12 +23,14 @@
 #include <unordered_map>
 #include <memory>
 #include <cstdint>
+#include <set>
 #include <poll.h>
 #include "env.hpp"
 #include "interp_ctx.hpp"
 #include "stats.hpp"
 #include "config.hpp"
 #include "net_handler.hpp"
+#include "append_log.hpp"
 
 
 namespace zcore {
@@ -73,6 +75,12 @@ namespace zcore {
       throw std::logic_error("getMsgInfo not implemented"); 
     }
 
+    /// Record an append in the append log, if any, before it is
+    /// applied. 'hdrlen' is the length of the part of 'buf' that
+    /// designates the target.
+    inline virtual void logAppend(Global::MsgType mt, const char* buf, size_t len,
+                                  size_t hdrlen, uint64_t prelen) { }
+
     const MsgStats& getMsgStats() { return stats; }
     void resetMsgStats() { stats.reset(); }
 
@@ -121,6 +129,11 @@ namespace zcore {
     zcore::NetInfo getNetInfo() const;
     zcore::MsgInfo getMsgInfo() const;
 
+    void logAppend(Global::MsgType mt, const char* buf, size_t len,
+                   size_t hdrlen, uint64_t prelen);
+
+    virtual ~MsgHandler();
+
   private:
     net::NetHandler& com;
     
@@ -140,6 +153,26 @@ namespace zcore {
     int epollfd;
     epoll_event events[Global::EPOLL_MAX_EVENTS];
     static const int EPOLL_TIMEOUT = 1000;
+    /// Maximum number of network buffers handled per wake up.
+    static const size_t DATA_BATCH = 256;
+
+    /// Consecutive APPEND or APPEND_VECTOR buffers from the same
+    /// connection to the same target, applied together by
+    /// 'flushAppends'.
+    std::vector<net::Buf> appends;
+    /// Whether the append in 'buf' can join 'appends'.
+    bool canCoalesce(Global::conn_id_t id, const net::Buf& buf) const;
+    void flushAppends();
+
+    // append log:
+    std::unique_ptr<AppendLog> wal;
+    int walTimerFd;
+    size_t walCheckpointBytes;
+    bool walReplaying;
+    std::set<std::string> walTargets; ///< headers of the targets appended to since
+                                      ///  the last checkpoint
+    void openAppendLog(const std::string& filename);
+    void checkpointAppendLog();
   };
 
 }
@@ -76,10 +76,11 @@ int client::Client::run() {
         throw std::system_error(std::error_code(errno, std::system_category()), "read(fd_read_data)");
       }
 
-      // get message signalled by the event:
+      // the signal covers all the buffers queued until now, so drain:
+      com.ackDataSignal();
       Global::conn_id_t id;
       net::Buf combuf;
-      while (n-- > 0 && com.get_data(id, combuf)) {
+      while (com.get_data(id, combuf)) {
         const char* buf = combuf.data.get();
         
         auto len = combuf.len;
@@ -151,6 +152,9 @@ size_t client::Client::sendReq(Global::conn_id_t peer_conn_id,
 
   rsp = RspState(getNextId());
 
+  if (!com.admit(peer_conn_id)) {
+    throw std::range_error("send request failed: outbound queue full");
+  }
   try {
     zcore::Encode ec(com, peer_conn_id, rsp.reqid, sourceid, Global::MsgType::REQ);
     ec << e;
@@ -22,10 +22,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <sys/eventfd.h>
 #include <sys/fcntl.h>
 #include <netinet/tcp.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <climits>
+#include <thread>
 #include "net_handler.hpp"
 #include "misc.hpp"
 #include "globals.hpp"
@@ -43,15 +49,22 @@ extern zlog::Logger lg;
 static auto gennb = GenNbFun<Global::conn_id_t>(); // sequence number generator
 
 
+/// Printable address of a peer.
+static const char* peerAddress(const sockaddr_in& addr) {
+  return addr.sin_family == AF_UNIX ? "unix" : inet_ntoa(addr.sin_addr);
+}
+
+
 Global::conn_id_t net::ConnectionMappings::createConnection(int fd, 
                                                              const sockaddr_in& addr,
-                                                             Connection::Direction dir) 
+                                                             Connection::Direction dir,
+                                                             int epollfd) 
 {
   auto id = gennb();
   mx.lock();
   try {
     fdToId.emplace(fd, id);
-    connections.emplace(id, Connection(id, fd, addr, dir));
+    connections.emplace(id, Connection(id, fd, addr, dir, epollfd));
   }
   catch (...) {
     id = 0;
@@ -124,100 +137,134 @@ std::map<Global::conn_id_t, net::Connection> net::ConnectionMappings::getAllConn
 }
 
 
-void net::BufferMgt::addBufferToReadylist(Global::conn_id_t id, net::Buf&& b) {
-#ifdef DEBUG
-  std::cout << "comm::BufferMgt::addBufferToReadylist[id=" << id << "]" << std::endl;
-#endif
-  mx.lock();
-  try {
-    auto sz = readybuflist.size();
-    if (sz > stats.readbuflistmax) {
-      stats.readbuflistmax.store(sz);
+void net::BufDeleter::operator()(char* p) const {
+  if (pool) {
+    pool->put(k, p);
+  }
+  else {
+    delete[] p;
+  }
+}
+
+
+net::BufPool::BufPool(zcore::NetStats& stats_p) 
+  : maxBytes(Juice::get<int64_t>(cfg::cfgmap.get("commbuf.pool.bytes"))), stats(stats_p) { }
+
+
+net::BufPool::~BufPool() {
+  for (auto& l : lists) {
+    while (l.head) {
+      auto p = l.head;
+      l.head = p->next;
+      free(p);
     }
-    if (sz == max_size) {
-      // keep the ready to its max_size: 
-      readybuflist.pop_front();
-      ++stats.nbInBuffersDrop;
+  }
+}
+
+
+std::unique_ptr<char[], net::BufDeleter> net::BufPool::get(size_t n) {
+  if (n > MAX_SIZE) {
+    return std::unique_ptr<char[], BufDeleter>(new char[n], BufDeleter{nullptr, 0});
+  }
+  auto k = sizeClass(n);
+  auto& l = lists[k];
+  l.mx.lock();
+  auto p = l.head;
+  if (p) {
+    l.head = p->next;
+  }
+  l.mx.unlock();
+  if (p) {
+    ++stats.nbBufPoolHits;
+    stats.bytesInBufPool -= classSize(k);
+  }
+  else {
+    ++stats.nbBufPoolMisses;
+    p = static_cast<Free*>(malloc(classSize(k)));
+    if (p == nullptr) {
+      throw std::bad_alloc();
     }
-    readybuflist.emplace_back(std::make_pair(id, std::move(b)));
   }
-  catch (...) {
-    // can't see anything else than memory exhaustion; just register we dropped:
-    ++stats.nbInBuffersDrop;    
+  return std::unique_ptr<char[], BufDeleter>(reinterpret_cast<char*>(p), BufDeleter{this, k});
+}
+
+
+void net::BufPool::put(size_t k, char* p) {
+  // the bound is approximate when several threads give back buffers
+  // at the same time, which is good enough:
+  if (stats.bytesInBufPool + classSize(k) > maxBytes) {
+    free(p);
+    return;
   }
-  mx.unlock();
+  stats.bytesInBufPool += classSize(k);
+  auto f = reinterpret_cast<Free*>(p);
+  auto& l = lists[k];
+  l.mx.lock();
+  f->next = l.head;
+  l.head = f;
+  l.mx.unlock();
 }
 
 
-bool net::BufferMgt::get_data(Global::conn_id_t& id, Buf& buf) { 
+net::BufferMgt::BufferMgt(size_t max_size_p, zcore::NetStats& stats_p, int data_out_fd_p) 
+  : readybuflist(max_size_p), signalled(false), data_out_fd(data_out_fd_p), 
+    ttl(std::chrono::seconds(Juice::get<int64_t>(cfg::cfgmap.get("commbuf.ttl.secs")))),
+    stats(stats_p) { }
+
+
+void net::BufferMgt::addBufferToReadylist(Global::conn_id_t id, net::Buf&& b) {
 #ifdef DEBUG
-  std::cout << "comm::BufferMgt::get_data" << std::endl;
+  std::cout << "comm::BufferMgt::addBufferToReadylist[id=" << id << "]" << std::endl;
 #endif
-  mx.lock();
-  try {
-    if (readybuflist.size() > 0) {
-      auto& p = readybuflist.front();
-      std::swap(p.second, buf);
-      id = p.first;
-      readybuflist.pop_front();
-      mx.unlock();
-      return true;
-    }
-    else {
-      mx.unlock();
-      return false;
-    }
-  }
-  catch (...) {
-    mx.unlock();
-    return false;
+  auto e = std::make_pair(id, std::move(b));
+  if (!readybuflist.push(std::move(e))) {
+    ++stats.nbInBuffersDrop;
+    return;
   }
+  // high-water mark:
+  auto sz = readybuflist.size();
+  auto max = stats.readbuflistmax.load();
+  while (sz > max && !stats.readbuflistmax.compare_exchange_weak(max, sz)) ;
+  signal();
 }
 
 
-size_t net::BufferMgt::gc() {
-  size_t bytes = 0;
-  std::chrono::system_clock::time_point::duration combufttl =
-    std::chrono::seconds(Juice::get<int64_t>(cfg::cfgmap.get("commbuf.ttl.secs")));
-  auto now = std::chrono::system_clock::now();
-  mx.lock();
-  for (auto i = bufmap.begin(); i != bufmap.end(); ++i) { 
-    if (now - i->second.timestamp >= combufttl) { 
-      bytes += i->second.offset;
-      bufmap.erase(i);
-    } 
+void net::BufferMgt::signal() {
+  if (signalled.exchange(true)) {
+    return;                     // the upper level has yet to wake up
   }
-  for (auto i = readybuflist.begin(); i != readybuflist.end(); ) {
-    if (now - i->second.timestamp >= combufttl) {
-      bytes += i->second.offset;
-      i = readybuflist.erase(i);
-    }
-    else {
-      // the buffer list's timestamp is ordered, so we can stop
-      // searching as soon as a non-expired buffer is found:
-      break;
-    }
+  size_t count = 1;
+  ssize_t res = write(data_out_fd, (void*)&count, sizeof(count));
+  if (res == -1 ) {
+    signalled = false;          // so that the next 'resignal' tries again
+    throw std::system_error(std::error_code(errno, std::system_category()), 
+                            "write(data_out_fd)");
   }
-  mx.unlock();
-  return bytes;
+  ++stats.nbDataSignals;
 }
 
 
-void net::BufferMgt::removeAllBuffersForId(Global::conn_id_t id) {
-  mx.lock();
-  bufmap.erase(id);
-  mx.unlock();
-  // 'readyBufList' does not need to be cleaned here; once a context
-  // has disappeared, the upper layer (interp_run) will just throw
-  // away the orphaned buffers as it picks them up.
+bool net::BufferMgt::get_data(Global::conn_id_t& id, Buf& buf) { 
+#ifdef DEBUG
+  std::cout << "comm::BufferMgt::get_data" << std::endl;
+#endif
+  std::pair<Global::conn_id_t, Buf> e;
+  auto now = std::chrono::system_clock::now();
+  while (readybuflist.pop(e)) {
+    if (now - e.second.timestamp >= ttl) {
+      stats.bytesTimedOut += e.second.offset;
+      continue;
+    }
+    id = e.first;
+    std::swap(e.second, buf);
+    return true;
+  }
+  return false;
 }
 
 
 size_t net::BufferMgt::getReadyBufSz() const {
-  mx.lock();
-  auto sz = readybuflist.size();
-  mx.unlock();
-  return sz;
+  return readybuflist.size();
 }
 
 
@@ -267,6 +314,24 @@ size_t net::SignallingMgt::getListSz() const {
 }
 
 
+size_t net::Worker::gc(std::chrono::system_clock::duration ttl, ConnectionMappings& conns) {
+  size_t bytes = 0;
+  auto now = std::chrono::system_clock::now();
+  for (auto i = bufmap.begin(); i != bufmap.end(); ) {
+    // a connection closed by another thread leaves its partial
+    // buffer here:
+    if (now - i->second.timestamp >= ttl || conns.getFd(i->first) == 0) {
+      bytes += i->second.offset;
+      i = bufmap.erase(i);
+    }
+    else {
+      ++i;
+    }
+  }
+  return bytes;
+}
+
+
 // NetHandler ----------------------------------------------
 
 
@@ -275,16 +340,25 @@ net::NetHandler::NetHandler(const std::string ip_addr,
                  int data_out_fd_p, 
                  int sig_out_fd_p,
                  size_t datalist_max_size,
-                 size_t siglist_max_size)
-  : ready(0), port(port_p), data_out_fd(data_out_fd_p), sig_out_fd(sig_out_fd_p), 
-    bufmgt(datalist_max_size, stats), sigmgt(siglist_max_size) {
+                 size_t siglist_max_size,
+                 unsigned nthreads)
+  : ready(0), port(port_p), 
+    unixPath(Juice::get<std::string>(cfg::cfgmap.get("net.unix.path"))), unixFd(-1),
+    data_out_fd(data_out_fd_p), sig_out_fd(sig_out_fd_p), 
+    pool(stats), bufmgt(datalist_max_size, stats, data_out_fd_p), sigmgt(siglist_max_size), 
+    workers(std::max(nthreads, 1U)), nextWorker(0),
+    outHigh(Juice::get<int64_t>(cfg::cfgmap.get("net.out.high.bytes"))),
+    outLow(Juice::get<int64_t>(cfg::cfgmap.get("net.out.low.bytes"))),
+    outPolicy(from_string(Juice::get<std::string>(cfg::cfgmap.get("net.out.policy")))) {
+  if (outLow > outHigh) {
+    throw std::range_error("net.out.low.bytes must not be greater than net.out.high.bytes");
+  }
 #ifdef DEBUG
   std::cout << "NetHandler::comm()" << std::endl;
   std::cout << "| port:" << port << std::endl;
+  std::cout << "| nthreads:" << workers.size() << std::endl;
 #endif
 
-  memset(&ev, 0, sizeof(epoll_event));
-
   if (port > 0) {
     // open and bind socket
     bzero(&addr,sizeof(addr));
@@ -305,33 +379,85 @@ net::NetHandler::NetHandler(const std::string ip_addr,
       }
     }
     addr.sin_port=htons(port);
-    fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (fd == -1) {
+    // one listening socket per thread; the port is only shared when
+    // there are several, so that another process can't bind it:
+    for (auto& w : workers) {
+      w.fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (w.fd == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), 
+                                "NetHandler: cannot create TCP socket");
+      }
+      int one = 1; 
+      setsockopt(w.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (workers.size() > 1 && 
+          setsockopt(w.fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), 
+                                "NetHandler: setsockopt(SO_REUSEPORT)");
+      }
+      if (fcntl(w.fd, F_SETFL, O_NONBLOCK) ==  -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), 
+                                "NetHandler: fcntl(fd, F_SETFL, O_NONBLOCK)");
+      }
+
+      /// \todo figure out what TCP params we need and add them to the options
+      ///       setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); 
+      ///       set up keepalive? http://tldp.org/HOWTO/TCP-Keepalive-HOWTO/programming.html
+    
+      if (bind(w.fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), 
+                                "NetHandler: cannot bind TCP socket");
+      }
+    }
+  }
+  // not an error, it just means comm only has client capabilities.
+
+  if (unixPath.size()) {
+    // same messages as on the TCP port, without the TCP/IP stack, for
+    // the producers on this host:
+    sockaddr_un uaddr;
+    bzero(&uaddr, sizeof(uaddr));
+    uaddr.sun_family = AF_UNIX;
+    if (unixPath.size() >= sizeof(uaddr.sun_path)) {
+      throw std::range_error("net.unix.path is too long: " + unixPath);
+    }
+    strncpy(uaddr.sun_path, unixPath.c_str(), sizeof(uaddr.sun_path) - 1);
+    // remove the socket left by a previous run, but nothing else:
+    struct stat st;
+    if (lstat(unixPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+      unlink(unixPath.c_str());
+    }
+    unixFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (unixFd == -1) {
       throw std::system_error(std::error_code(errno, std::system_category()), 
-                              "NetHandler: cannot create TCP socket");
+                              "NetHandler: cannot create Unix socket");
     }
-    int one = 1; 
-    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
-    if (fcntl(fd, F_SETFL, O_NONBLOCK) ==  -1) {
+    if (fcntl(unixFd, F_SETFL, O_NONBLOCK) ==  -1) {
+      close(unixFd);
       throw std::system_error(std::error_code(errno, std::system_category()), 
                               "NetHandler: fcntl(fd, F_SETFL, O_NONBLOCK)");
     }
-
-    /// \todo figure out what TCP params we need and add them to the options
-    ///       setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); 
-    ///       set up keepalive? http://tldp.org/HOWTO/TCP-Keepalive-HOWTO/programming.html
-    
-    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+    if (bind(unixFd, (sockaddr*)&uaddr, sizeof(uaddr)) == -1) {
+      close(unixFd);
       throw std::system_error(std::error_code(errno, std::system_category()), 
-                              "NetHandler: cannot bind TCP socket");
+                              "NetHandler: cannot bind Unix socket " + unixPath);
     }
   }
-  // not an error, it just means comm only has client capabilities.
 }
 
 
 net::NetHandler::~NetHandler() {
-  close(fd);
+  if (unixFd != -1) {
+    close(unixFd);
+    unlink(unixPath.c_str());
+  }
+  for (auto& w : workers) {
+    if (w.fd != -1) {
+      close(w.fd);
+    }
+    if (w.epollfd != -1) {
+      close(w.epollfd);
+    }
+  }
 }
 
 
@@ -340,29 +466,67 @@ void net::NetHandler::run(volatile bool& stop) {
   std::cout << "NetHandler[" << port << "]::run()" << std::endl;
 #endif
 
-  epollfd = epoll_create1(0);
-  if (epollfd == -1) {
-    throw std::system_error(std::error_code(errno, std::system_category()), "epoll_create1");
+  for (auto& w : workers) {
+    w.epollfd = epoll_create1(0);
+    if (w.epollfd == -1) {
+      throw std::system_error(std::error_code(errno, std::system_category()), "epoll_create1");
+    }
+    if (w.fd != -1) {
+      const int backlog = 5;
+      listen(w.fd, backlog);
+      epoll_event ev;
+      memset(&ev, 0, sizeof(epoll_event));
+      ev.events = EPOLLIN;
+      ev.data.fd = w.fd;
+      if (epoll_ctl(w.epollfd, EPOLL_CTL_ADD, w.fd, &ev) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "epoll_ctl");
+      }
+    }
+  }
+  if (unixFd != -1) {
+    const int backlog = 5;
+    listen(unixFd, backlog);
+    epoll_event ev;
+    memset(&ev, 0, sizeof(epoll_event));
+    ev.events = EPOLLIN;
+    ev.data.fd = unixFd;
+    if (epoll_ctl(workers[0].epollfd, EPOLL_CTL_ADD, unixFd, &ev) == -1) {
+      throw std::system_error(std::error_code(errno, std::system_category()), "epoll_ctl");
+    }
   }
   // now we have epollfd we are ready to create outgoing connection,
   // so set the atomic variable to signal this:
   ready.store(1);
 
-  ev.events = EPOLLIN;
-
-  if (port > 0) {
-    const int backlog = 5;
-    listen(fd, backlog);
-    ev.data.fd = fd;
-    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
-      throw std::system_error(std::error_code(errno, std::system_category()), "epoll_ctl");
-    }
+  // the other threads inherit the signal mask of this one:
+  std::vector<std::thread> threads;
+  for (size_t i=1; i<workers.size(); ++i) {
+    threads.emplace_back([this, i, &stop]() {
+        try {
+          runWorker(workers[i], stop);
+        }
+        catch (const std::exception& e) {
+          lg.log(zlog::SV_ERROR, "network thread %d: %s", static_cast<int>(i), e.what());
+        }
+      });
+  }
+  try {
+    runWorker(workers[0], stop);
   }
+  catch (...) {
+    stop = true;
+    for (auto& t : threads) t.join();
+    throw;
+  }
+  for (auto& t : threads) t.join();
+}
 
+
+void net::NetHandler::runWorker(Worker& w, volatile bool& stop) {
   epoll_event events[Global::EPOLL_MAX_EVENTS];
 
   for (;;) {
-    int nfds = epoll_wait(epollfd, events, Global::EPOLL_MAX_EVENTS, EPOLL_TIMEOUT);
+    int nfds = epoll_wait(w.epollfd, events, Global::EPOLL_MAX_EVENTS, EPOLL_TIMEOUT);
 
     if (stop) return;
 
@@ -374,30 +538,38 @@ void net::NetHandler::run(volatile bool& stop) {
       continue;
     } 
     else if (nfds == 0) {       // timeout
-      bufmgt.gc();
+      w.gc(std::chrono::seconds(Juice::get<int64_t>(cfg::cfgmap.get("commbuf.ttl.secs"))), 
+           connMappings);
       continue;
     }
     
     for (int i = 0; i < nfds; ++i) {
       // connection request: -------------------------------------
-      if (events[i].data.fd == fd) {
-        acceptConnection();
+      if (events[i].data.fd == w.fd || events[i].data.fd == unixFd) {
+        acceptConnection(w, events[i].data.fd);
       }
-      // data on TCP connection: ---------------------------------
+      // data on a connection: -----------------------------------
       else {
+        int peerfd = events[i].data.fd;
+        if (events[i].events & EPOLLOUT) {
+          flushOut(connMappings.getId(peerfd));
+          if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            continue;           // the socket just became writable
+          }
+        }
         bool first_read = true;
         ssize_t nread = 0;
+        const auto peerid = connMappings.getId(peerfd);
         while (nread >= 0) {
-          int peerfd = events[i].data.fd;
 #ifdef DEBUG
           std::cout << "data for fd: " << peerfd << std::endl;
 #endif
           auto id = connMappings.getId(peerfd);
 
-          auto elt = bufmgt.bufmap.find(id); // find an active buffer for this peer
+          auto elt = w.bufmap.find(id); // find an active buffer for this peer
 
           // no active buffer, so this is a new msg:
-          if (elt == bufmgt.bufmap.end()) {
+          if (elt == w.bufmap.end()) {
             // if less than 16 bytes, try again, because we need a
             // length and the magic number to allocate a new buffer:
             int bytesAvail;
@@ -432,29 +604,25 @@ void net::NetHandler::run(volatile bool& stop) {
             msglen = ntoh<size_t>(msglen);
 
             // create a new buffer in bufmap:
-            bufmgt.bufmap.emplace(std::make_pair(id, Buf(id, msglen-16)));
+            w.bufmap.emplace(std::make_pair(id, Buf(id, msglen-16, pool)));
           } 
 
           // continue buffer reassembly:
-          auto& msg = bufmgt.bufmap.at(id);
+          auto& msg = w.bufmap.at(id);
           auto nread = read(id, peerfd, &msg.data[msg.offset], msg.len - msg.offset);
           if (nread <= 0) continue;
           msg.offset += nread;
 	
           if (msg.offset == msg.len) {
+            // this also lets the upper layer know there's a msg ready:
             bufmgt.addBufferToReadylist(id, std::move(msg));
-            bufmgt.bufmap.erase(id);
+            w.bufmap.erase(id);
             ++stats.nbInBuffers;
-
-            // let upper layer know there's a msg ready:
-            size_t count = 1;
-            ssize_t res = write(data_out_fd, (void*)&count, sizeof(count));
-            if (res == -1 ) {
-              throw std::system_error(std::error_code(errno, std::system_category()), 
-                                      "write(data_out_fd)");
-            }
           }
         }
+        if (connMappings.getFd(peerid) == 0) {
+          w.bufmap.erase(peerid); // the connection went down
+        }
       }
     }
   }
@@ -488,39 +656,260 @@ ssize_t net::NetHandler::send(Global::conn_id_t id, char* buf, size_t len) {
   std::cout << "| id:  " << id << std::endl;
   std::cout << "| len: " << len << std::endl;
 #endif
-  mx.lock();
-  auto fd = connMappings.getFd(id);
-  mx.unlock();
-  ssize_t res = 0;
-  if (fd > 0) {
+  *(reinterpret_cast<uint64_t*>(buf))   = hton64(Global::MAGICNB);
+  *(reinterpret_cast<uint64_t*>(buf+8)) = hton64(len);
+  iovec iov{buf, len};
+  return transmit(id, &iov, 1, std::vector<FileRange>(), len, false);
+}
+
+
+/// Send the chunk made of the 'iovcnt' buffers of 'iov' to peer 'id'
+/// with 'writev', so the data is not copied to an intermediate
+/// buffer.
+ssize_t net::NetHandler::sendv(Global::conn_id_t id, iovec* iov, int iovcnt, size_t len) {
 #ifdef DEBUG
-    std::cout << "| fd:  " << fd << std::endl;
+  std::cout << "NetHandler[" << port << "]::sendv" << std::endl;
+  std::cout << "| id:     " << id << std::endl;
+  std::cout << "| iovcnt: " << iovcnt << std::endl;
+  std::cout << "| len:    " << len << std::endl;
 #endif
-    *(reinterpret_cast<uint64_t*>(buf))   = hton64(Global::MAGICNB);
-    *(reinterpret_cast<uint64_t*>(buf+8)) = hton64(len);
-    
-    res = write(fd, buf, len);
-    if (res < 0) {
-      ++stats.nbSendFail;
+  auto buf = static_cast<char*>(iov[0].iov_base);
+  *(reinterpret_cast<uint64_t*>(buf))   = hton64(Global::MAGICNB);
+  *(reinterpret_cast<uint64_t*>(buf+8)) = hton64(len);
+  return transmit(id, iov, iovcnt, std::vector<FileRange>(), len, true);
+}
+
+
+/// Send a chunk made of 'buf' and of the file ranges 'ranges' to peer
+/// 'id'. The ranges are sent with 'sendfile', so they go from the page
+/// cache to the socket without being copied to user space.
+ssize_t net::NetHandler::sendfile(Global::conn_id_t id, char* buf, size_t buflen,
+                                  const std::vector<FileRange>& ranges, size_t len) {
+#ifdef DEBUG
+  std::cout << "NetHandler[" << port << "]::sendfile" << std::endl;
+  std::cout << "| id:     " << id << std::endl;
+  std::cout << "| ranges: " << ranges.size() << std::endl;
+  std::cout << "| len:    " << len << std::endl;
+#endif
+  *(reinterpret_cast<uint64_t*>(buf))   = hton64(Global::MAGICNB);
+  *(reinterpret_cast<uint64_t*>(buf+8)) = hton64(len);
+  iovec iov{buf, buflen};
+  return transmit(id, &iov, 1, ranges, len, false);
+}
+
+
+bool net::NetHandler::admit(Global::conn_id_t id) {
+  if (outPolicy != DROP || connMappings.getFd(id) <= 0) {
+    return true;                // no connection: let 'transmit' fail
+  }
+  const auto conn = connMappings.getConnection(id);
+  auto& out = *conn.out;
+  std::lock_guard<std::mutex> lock(out.mx);
+  if (out.bytes >= outHigh) {
+    ++stats.nbOutDropped;
+    return false;
+  }
+  return true;
+}
+
+
+/// Skip the first 'n' bytes of the 'iovcnt' buffers of 'iov'.
+static void skipIov(iovec*& iov, int& iovcnt, size_t n) {
+  while (iovcnt && n >= iov->iov_len) {
+    n -= iov->iov_len;
+    ++iov;
+    --iovcnt;
+  }
+  if (iovcnt) {
+    iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+    iov->iov_len -= n;
+  }
+}
+
+
+/// Send as much of the chunk as the socket of 'id' takes without
+/// waiting, the buffers first, then the file ranges, and copy the rest
+/// to the outbound queue of 'id'. Nothing is sent directly when the
+/// queue is not empty, to keep the chunks in order.
+ssize_t net::NetHandler::transmit(Global::conn_id_t id, iovec* iov, int iovcnt,
+                                  const std::vector<FileRange>& ranges, size_t len, 
+                                  bool zerocopy) {
+  if (connMappings.getFd(id) <= 0) {
+    throw std::range_error("no connection to peer"); // decide if we want to throw or not LLL
+  }
+  const auto conn = connMappings.getConnection(id);
+  auto& out = *conn.out;
+  std::unique_lock<std::mutex> lock(out.mx);
+
+  if (out.bytes >= outHigh) {
+    switch (outPolicy) {
+    case BLOCK:
+      ++stats.nbOutBlocked;
+      out.cv.wait(lock, [&out, this] { return out.bytes <= outLow || out.closed; });
+      break;
+    case DROP:
+      break;                    // decided for the whole message by 'admit'
+    case DISCONNECT:
+      lock.unlock();
+      ++stats.nbOutOverflow;
+      lg.log(zlog::SV_INFO, "outbound queue full, disconnecting id: %d", id);
+      disconnect(id);
+      errno = ECONNRESET;
+      return -1;
     }
-    else {
-      ++stats.nbOutBuffers;
+  }
+  if (out.closed) {
+    ++stats.nbSendFail;
+    errno = ECONNRESET;
+    return -1;
+  }
+
+  size_t r = 0;                 // current file range
+  off_t roff = ranges.empty() ? 0 : ranges[0].off;
+  size_t rleft = ranges.empty() ? 0 : ranges[0].len;
+  size_t filebytes = 0;
+  if (out.q.empty()) {
+    // the header is held back until the file data follows:
+    const int flags = MSG_DONTWAIT | MSG_NOSIGNAL | (ranges.empty() ? 0 : MSG_MORE);
+    while (iovcnt) {
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = std::min(iovcnt, IOV_MAX);
+      auto res = ::sendmsg(conn.fd, &msg, flags);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        ++stats.nbSendFail;
+        return res;
+      }
+      if (zerocopy) stats.bytesOutZeroCopy += res;
+      skipIov(iov, iovcnt, res);
     }
+    while (!iovcnt && r < ranges.size()) {
+      if (rleft == 0) {
+        if (++r < ranges.size()) {
+          roff  = ranges[r].off;
+          rleft = ranges[r].len;
+        }
+        continue;
+      }
+      auto res = ::sendfile(conn.fd, ranges[r].fd, &roff, rleft);
+      if (res < 0 && errno == EINTR) continue;
+      if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      if (res <= 0) {
+        ++stats.nbSendFail;
+        return -1;              // a file shorter than its vector is an error too
+      }
+      rleft -= res;
+      filebytes += res;
+    }
+    stats.bytesOutSendfile += filebytes;
   }
-  else {
-    throw std::range_error("no connection to peer"); // decide if we want to throw or not LLL
+
+  if (iovcnt || r < ranges.size()) {
+    // the peer is behind, queue the rest for 'flushOut':
+    std::vector<char> v;
+    for (; iovcnt; ++iov, --iovcnt) {
+      auto p = static_cast<const char*>(iov->iov_base);
+      v.insert(v.end(), p, p + iov->iov_len);
+    }
+    for (; r < ranges.size(); ++r) {
+      v.resize(v.size() + rleft);
+      while (rleft) {
+        auto res = ::pread(ranges[r].fd, v.data() + v.size() - rleft, rleft, roff);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) {
+          ++stats.nbSendFail;
+          return -1;
+        }
+        rleft -= res;
+        roff  += res;
+      }
+      if (r + 1 < ranges.size()) {
+        roff  = ranges[r+1].off;
+        rleft = ranges[r+1].len;
+      }
+    }
+    out.bytes += v.size();
+    out.q.emplace_back(std::move(v));
+    ++stats.nbOutQueued;
+    if (!out.armed) {
+      setOutEvents(conn, true);
+      out.armed = true;
+    }
   }
-  return res;
+  ++stats.nbOutBuffers;
+  return len;
 }
 
 
-void net::NetHandler::acceptConnection() {
+void net::NetHandler::flushOut(Global::conn_id_t id) {
+  if (id == 0) return;          // already disconnected
+  try {
+    const auto conn = connMappings.getConnection(id);
+    auto& out = *conn.out;
+    std::unique_lock<std::mutex> lock(out.mx);
+    if (out.closed) return;
+    while (!out.q.empty()) {
+      auto& v = out.q.front();
+      auto res = ::send(conn.fd, v.data() + out.offset, v.size() - out.offset, 
+                        MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        ++stats.nbSendFail;
+        lock.unlock();
+        disconnect(id);
+        return;
+      }
+      out.offset += res;
+      out.bytes  -= res;
+      if (out.offset == v.size()) {
+        out.q.pop_front();
+        out.offset = 0;
+      }
+    }
+    if (out.q.empty() && out.armed) {
+      setOutEvents(conn, false);
+      out.armed = false;
+    }
+    if (out.bytes <= outLow) {
+      out.cv.notify_all();
+    }
+  }
+  catch (std::out_of_range&) {
+    return;                     // disconnected in the meantime
+  }
+}
+
+
+void net::NetHandler::setOutEvents(const Connection& conn, bool out) {
+  epoll_event ev;
+  memset(&ev, 0, sizeof(epoll_event));
+  ev.events = EPOLLIN | EPOLLET | (out ? EPOLLOUT : 0);
+  ev.data.fd = conn.fd;
+  if (epoll_ctl(conn.epollfd, EPOLL_CTL_MOD, conn.fd, &ev) == -1) {
+    throw std::system_error(std::error_code(errno, std::system_category()), "epoll_ctl: MOD");
+  }
+}
+
+
+net::NetHandler::OutPolicy net::NetHandler::from_string(const std::string& s) {
+  if (s == "block")      return BLOCK;
+  if (s == "drop")       return DROP;
+  if (s == "disconnect") return DISCONNECT;
+  throw std::range_error("invalid net.out.policy: " + s);
+}
+
+
+void net::NetHandler::acceptConnection(Worker& w, int lfd) {
   // see https://banu.com/blog/2/how-to-use-epoll-a-complete-example-in-c/
   while (1) {
-    sockaddr_in peeraddr;
-    socklen_t sz = sizeof(peeraddr);
+    sockaddr_storage peer;
+    socklen_t sz = sizeof(peer);
     
-    int newfd = accept(fd, (sockaddr *)&peeraddr, &sz);
+    int newfd = accept(lfd, (sockaddr *)&peer, &sz);
     if (newfd == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
         break;                  // all incoming connections processed
@@ -529,13 +918,32 @@ void net::NetHandler::acceptConnection() {
         throw std::system_error(std::error_code(errno, std::system_category()), "accept");
       }
     }
+    sockaddr_in peeraddr;
+    if (peer.ss_family == AF_INET) {
+      memcpy(&peeraddr, &peer, sizeof(peeraddr));
+    }
+    else {
+      bzero(&peeraddr, sizeof(peeraddr));
+      peeraddr.sin_family = peer.ss_family;
+    }
+    // sends must not wait for the peer, see 'transmit':
+    if (fcntl(newfd, F_SETFL, O_NONBLOCK) == -1) {
+      throw std::system_error(std::error_code(errno, std::system_category()), 
+                              "NetHandler: fcntl(fd, F_SETFL, O_NONBLOCK)");
+    }
+    // the connections of the Unix socket all come through the first
+    // thread, so spread them like the outgoing ones:
+    auto& cw = lfd == unixFd ? workers[nextWorker++ % workers.size()] : w;
+    epoll_event ev;
+    memset(&ev, 0, sizeof(epoll_event));
     ev.events = EPOLLIN | EPOLLET;
     ev.data.fd = newfd;
-    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, newfd, &ev) == -1) {
+    if (epoll_ctl(cw.epollfd, EPOLL_CTL_ADD, newfd, &ev) == -1) {
       throw std::system_error(std::error_code(errno, std::system_category()), "epoll_ctl: ADD");
     }
 
-    auto id = connMappings.createConnection(newfd, peeraddr, net::Connection::Direction::INCOMING);
+    auto id = connMappings.createConnection(newfd, peeraddr, net::Connection::Direction::INCOMING,
+                                            cw.epollfd);
 
 #ifdef DEBUG
     std::cout << "new incoming conn: " << id << std::endl;
@@ -561,7 +969,7 @@ void net::NetHandler::acceptConnection() {
       // hopefully this can't happen...
       throw std::out_of_range("unknown error: write(UP) != 8");
     }
-    lg.log(zlog::SV_INFO, "UP @ %s: %d", inet_ntoa(peeraddr.sin_addr), peeraddr.sin_port);
+    lg.log(zlog::SV_INFO, "UP @ %s: %d", peerAddress(peeraddr), peeraddr.sin_port);
   } // end while(1)
 }
 
@@ -592,10 +1000,22 @@ Global::conn_id_t net::NetHandler::connect(const std::string& ip, int port) {
     throw std::system_error(std::error_code(errno, std::system_category()), "socket");
   }
 
-  auto id = connMappings.createConnection(peerfd, addr, net::Connection::Direction::OUTGOING);
+  // sends must not wait for the peer, see 'transmit':
+  if (fcntl(peerfd, F_SETFL, O_NONBLOCK) == -1) {
+    close(peerfd);
+    throw std::system_error(std::error_code(errno, std::system_category()), 
+                            "NetHandler: fcntl(fd, F_SETFL, O_NONBLOCK)");
+  }
+
+  // spread the outgoing connections over the network threads:
+  auto& w = workers[nextWorker++ % workers.size()];
+  auto id = connMappings.createConnection(peerfd, addr, net::Connection::Direction::OUTGOING,
+                                          w.epollfd);
+  epoll_event ev;
+  memset(&ev, 0, sizeof(epoll_event));
   ev.events = EPOLLIN | EPOLLET;
   ev.data.fd = peerfd;
-  if (epoll_ctl(epollfd, EPOLL_CTL_ADD, peerfd, &ev) == -1) {
+  if (epoll_ctl(w.epollfd, EPOLL_CTL_ADD, peerfd, &ev) == -1) {
     connMappings.deleteConnection(id);
     throw std::system_error(std::error_code(errno, std::system_category()), "epoll_ctl: ADD");
   }
@@ -616,7 +1036,16 @@ void net::NetHandler::disconnect(Global::conn_id_t id) {
   
   try {
     auto& conn = connMappings.getConnection(id);
-    lg.log(zlog::SV_INFO, "DOWN @ %s: %d", inet_ntoa(conn.addr.sin_addr), conn.addr.sin_port);
+    lg.log(zlog::SV_INFO, "DOWN @ %s: %d", peerAddress(conn.addr), conn.addr.sin_port);
+    {
+      // from now on the fd is not used for sending; release what's
+      // queued and any sender waiting on the queue:
+      std::lock_guard<std::mutex> lock(conn.out->mx);
+      conn.out->closed = true;
+      conn.out->q.clear();
+      conn.out->bytes = 0;
+      conn.out->cv.notify_all();
+    }
     int res = close(conn.fd);
     if (res != 0) {
       lg.log(zlog::SV_ERROR, "comm::NetHandler::disconnect 'close': %s", 
@@ -636,8 +1065,9 @@ void net::NetHandler::disconnect(Global::conn_id_t id) {
   // note that, per the man page, fd is taken out of the epoll
   // set automatically on close
     
+  // the partial buffer of 'id', if any, is removed by its network
+  // thread.
   connMappings.deleteConnection(id);
-  bufmgt.removeAllBuffersForId(id);
     
   uint64_t count = 1;
 
@@ -657,7 +1087,7 @@ zcore::NetInfo net::NetHandler::getNetInfo() const {
     auto& c = cpair.second;
     info.conninfo.emplace_back(zcore::ConnectionInfo{
         c.id, 
-        inet_ntoa(c.addr.sin_addr),
+        peerAddress(c.addr),
         c.addr.sin_port, 
         c.dir==net::Connection::Direction::OUTGOING ? 
           zcore::ConnectionInfo::Direction::OUTGOING :
@@ -22,17 +22,22 @@
 #include <netinet/in.h>
 #include <deque>
 #include <map>
+#include <vector>
 #include <unordered_map>
 #include <utility>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <boost/circular_buffer.hpp>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include "misc.hpp"
 #include "stats.hpp"
 #include "info.hpp"
 #include "config.hpp"
+#include "mpsc_ring.hpp"
 
 
 
@@ -85,37 +90,119 @@ namespace net {
   using namespace std::literals;
   using time_point = std::chrono::system_clock::time_point;
 
+  struct BufPool;
+
+  /// Gives a buffer back to its pool, or to the heap when it doesn't
+  /// come from a pool.
+  struct BufDeleter {
+    BufPool* pool;
+    size_t k;                   ///< size class in 'pool'
+    void operator()(char* p) const;
+  };
+
+
+  /// Receive buffers, recycled in power-of-two size classes of 256
+  /// bytes to 64KB. Buffers are taken by the network threads and
+  /// mostly given back by the upper level once it has processed them,
+  /// so each size class is a free list behind its own mutex. The
+  /// total size of the free buffers is bounded by
+  /// 'commbuf.pool.bytes'; larger messages, and the ones arriving
+  /// when the lists are empty, go to the heap.
+  struct BufPool {
+    static const size_t NB_CLASSES = 9;
+    static const size_t MIN_SIZE   = 256;
+    static const size_t MAX_SIZE   = MIN_SIZE << (NB_CLASSES - 1);
+
+    BufPool(zcore::NetStats& stats_p);
+    ~BufPool();
+
+    std::unique_ptr<char[], BufDeleter> get(size_t n);
+    void put(size_t k, char* p);
+
+  private:
+    struct Free { Free* next; };
+    struct FreeList {
+      Free* head = nullptr;
+      std::mutex mx;
+    };
+    FreeList lists[NB_CLASSES];
+    const size_t maxBytes;
+    zcore::NetStats& stats;
+
+    static inline size_t sizeClass(size_t n) {
+      size_t k = 0;
+      while ((MIN_SIZE << k) < n) ++k;
+      return k;
+    }
+    static inline size_t classSize(size_t k) { return MIN_SIZE << k; }
+  };
+
+
   struct Buf {
    
-    Buf() : id(0), len(0), offset(0), timestamp(0s), data(nullptr) { }
+    Buf() : id(0), len(0), offset(0), timestamp(0s), data(nullptr, BufDeleter{nullptr, 0}) { }
     Buf(Global::conn_id_t id_p, size_t len_p) : id(id_p), len(len_p), offset(0),
                                       timestamp(std::chrono::system_clock::now()),
-                                              data(std::make_unique<char[]>(len_p)) { }
+                                              data(new char[len_p], BufDeleter{nullptr, 0}) { }
+    Buf(Global::conn_id_t id_p, size_t len_p, BufPool& pool) : id(id_p), len(len_p), offset(0),
+                                      timestamp(std::chrono::system_clock::now()),
+                                              data(pool.get(len_p)) { }
     
     
     Global::conn_id_t id;       // owner of the buffer
     size_t  len;
     size_t  offset;		// usable buffer has offset=len
     time_point timestamp;       // can't allow buffers to live forever
-    std::unique_ptr<char[]> data;
+    std::unique_ptr<char[], BufDeleter> data;
   };
   
   
+  /// 'len' bytes of file 'fd' at offset 'off', to be sent straight
+  /// from the page cache.
+  struct FileRange {
+    int fd;
+    off_t off;
+    size_t len;
+  };
+
+
+  /// Bytes of a connection waiting for its socket to become
+  /// writable. When the socket can't take a whole chunk, what's left
+  /// of it and of the following chunks is copied here, and the network
+  /// thread of the connection sends it on EPOLLOUT.
+  struct OutQueue {
+    std::deque<std::vector<char>> q;
+    size_t offset = 0;          ///< bytes of 'q.front()' already sent
+    size_t bytes = 0;           ///< bytes waiting, over all of 'q'
+    bool armed = false;         ///< EPOLLOUT is in the epoll set
+    bool closed = false;        ///< the connection went down
+    std::mutex mx;
+    std::condition_variable cv; ///< signalled when 'bytes' goes down
+  };
+
+
   struct Connection {
     enum Direction { INCOMING, OUTGOING };
 
-    Connection(Global::conn_id_t id_p, int fd_p, const sockaddr_in& addr_p, Direction dir_p) :
-      id(id_p), fd(fd_p), addr(addr_p), dir(dir_p)  { }
+    Connection(Global::conn_id_t id_p, int fd_p, const sockaddr_in& addr_p, Direction dir_p,
+               int epollfd_p) :
+      id(id_p), fd(fd_p), addr(addr_p), dir(dir_p), epollfd(epollfd_p),
+      out(std::make_shared<OutQueue>()) { }
 
     Global::conn_id_t id;
     int fd;
-    sockaddr_in addr;           // contains both IP address and port
+    sockaddr_in addr;           // contains both IP address and port; 
+                                // only 'sin_family' (AF_UNIX) is set 
+                                // for the Unix socket
     Direction dir;
+    int epollfd;                ///< of the network thread handling 'fd'
+    std::shared_ptr<OutQueue> out;
   };
 
   struct ConnectionMappings {
 
-    Global::conn_id_t createConnection(int fd, const sockaddr_in& addr, Connection::Direction dir);
+    Global::conn_id_t createConnection(int fd, const sockaddr_in& addr, Connection::Direction dir,
+                                       int epollfd);
     const Connection getConnection(Global::conn_id_t id);
     Global::conn_id_t getId(int fd);
     int getFd(Global::conn_id_t id);
@@ -131,36 +218,36 @@ namespace net {
   };
   
   
+  /// Completed buffers, handed from the network threads to the upper
+  /// level through a lock-free queue. The upper level is told there
+  /// is data with an eventfd, which is only written when it is not
+  /// already signalled: after reading the eventfd the upper level calls
+  /// 'ackSignal' and then drains the queue, in batches if it wants to,
+  /// calling 'resignal' when it leaves buffers behind.
   struct BufferMgt {
-    BufferMgt(size_t max_size_p, zcore::NetStats& stats_p) 
-      : max_size(max_size_p), stats(stats_p) { }
+    BufferMgt(size_t max_size_p, zcore::NetStats& stats_p, int data_out_fd_p);
 
-    /// Add a buffer to the ready list.
+    /// Add a buffer to the ready list; the buffer is dropped if the
+    /// list is full.
     void addBufferToReadylist(Global::conn_id_t id, Buf&& b);
+    /// Get the oldest buffer; buffers that waited for more than the
+    /// time to live are dropped. Only to be called by the upper level.
     bool get_data(Global::conn_id_t& id, Buf& buf);
 
-    /// Garbage collect the buffer queue. Returns the number of bytes
-    /// that were deleted. 'd' is the amount of time a buffer can
-    /// live.
-    size_t gc();
-
-    /// Remove all the buffers (both partial and completed) that
-    /// belong to 'id'.
-    void removeAllBuffersForId(Global::conn_id_t id);
-
-    /// A queue for partially completed buffers, i.e. buffers that are
-    /// still being assembled.
-    std::unordered_map<Global::conn_id_t, Buf> bufmap;
+    void ackSignal() { signalled.exchange(false); }
+    void resignal() { if (!readybuflist.empty()) signal(); }
 
     size_t getReadyBufSz() const;
     
   private:
     /// Completed buffers, i.e. ready to be used by the upper level.
-    std::deque<std::pair<Global::conn_id_t, Buf>> readybuflist;
-    mutable std::mutex mx;      // only need to protect 'readybuflist'
-
-    const size_t max_size;
+    MpscRing<std::pair<Global::conn_id_t, Buf>> readybuflist;
+    std::atomic<bool> signalled;
+    const int data_out_fd;
+    const std::chrono::system_clock::duration ttl;
     zcore::NetStats& stats;
+
+    void signal();
   };
   
   
@@ -182,24 +269,80 @@ namespace net {
 
 
 
+  /// A network thread: its own epoll set, listening socket (the
+  /// listening sockets of all the threads share the port through
+  /// SO_REUSEPORT, so that the kernel spreads the incoming
+  /// connections) and buffers under reassembly. A connection is
+  /// handled by a single thread, which keeps the order of its
+  /// messages. The Unix listening socket, if any, is in the epoll set
+  /// of the first thread.
+  struct Worker {
+    Worker() : fd(-1), epollfd(-1) { }
+
+    int fd;                     ///< TCP listen sock, -1 if none
+    int epollfd;
+
+    /// Partially completed buffers, i.e. buffers that are still being
+    /// assembled. Only accessed by the thread of the worker.
+    std::unordered_map<Global::conn_id_t, Buf> bufmap;
+
+    /// Remove the partial buffers that are older than 'ttl' or whose
+    /// connection is down. Returns the number of bytes deleted.
+    size_t gc(std::chrono::system_clock::duration ttl, ConnectionMappings& conns);
+  };
+
+
   using namespace std::literals;
 
   struct NetHandler {
+
+    /// What to do with a message sent to a connection whose outbound
+    /// queue is over 'net.out.high.bytes': wait until the queue is
+    /// down to 'net.out.low.bytes', drop the message, or drop the
+    /// connection. 'BLOCK' and 'DISCONNECT' apply to each chunk,
+    /// 'DROP' to whole messages, see 'admit'.
+    enum OutPolicy { BLOCK, DROP, DISCONNECT };
+    static OutPolicy from_string(const std::string& s);
     
     NetHandler(const std::string ip_addr, 
          int port_p, 
          int data_out_fd, 
          int signalling_out_fd,
          size_t datalist_max_size=1e5,
-         size_t siglist_max_size=10);
+         size_t siglist_max_size=10,
+         unsigned nthreads=1);
 
     ~NetHandler();
     
+    /// Run the network threads until 'stop' is set; the calling
+    /// thread is the first of them.
     void run(volatile bool& stop);
 
+    /// The 'send' functions below never wait for a slow peer, except
+    /// under the 'BLOCK' policy: what the socket doesn't take is
+    /// queued, and they return 'len' once the whole chunk is either
+    /// sent or queued, or -1 with 'errno' set.
     ssize_t send(Global::conn_id_t id, char*  buf, size_t  len);
-
+    /// Decide whether a message to 'id' goes out, before its first
+    /// chunk is sent: under the 'DROP' policy it is dropped as a whole
+    /// if the outbound queue of 'id' is over 'net.out.high.bytes';
+    /// the chunks of a message that is let through are never dropped.
+    bool admit(Global::conn_id_t id);
+    /// Send the 'iovcnt' buffers of 'iov' as a single chunk of length
+    /// 'len'; the first buffer must start with 'INIT_OFFSET' bytes for
+    /// the magic number and size. 'iov' is modified.
+    ssize_t sendv(Global::conn_id_t id, iovec* iov, int iovcnt, size_t len);
+    /// Send 'buf' followed by the file ranges 'ranges' as a single
+    /// chunk of length 'len'; 'buf' must start with 'INIT_OFFSET'
+    /// bytes for the magic number and size.
+    ssize_t sendfile(Global::conn_id_t id, char* buf, size_t buflen,
+                     const std::vector<FileRange>& ranges, size_t len);
+
+    /// Get a completed buffer; see 'BufferMgt' for the signalling
+    /// protocol.
     bool get_data(Global::conn_id_t& id, Buf& buf) { return bufmgt.get_data(id, buf); }
+    void ackDataSignal() { bufmgt.ackSignal(); }
+    void resignalData() { bufmgt.resignal(); }
     bool get_sig(Global::conn_id_t& id, SignallingMgt::Status& st) { return sigmgt.get_sig(id, st); }
 
     /// Establish TCP connection to a given addres/port. Either
@@ -218,33 +361,45 @@ namespace net {
 
     std::atomic_uint_fast64_t ready;
   private:
-    void acceptConnection();
+    void runWorker(Worker& w, volatile bool& stop);
+    /// Accept the connections pending on 'lfd', the TCP listening
+    /// socket of 'w' or the Unix one.
+    void acceptConnection(Worker& w, int lfd);
+    ssize_t transmit(Global::conn_id_t id, iovec* iov, int iovcnt,
+                     const std::vector<FileRange>& ranges, size_t len, bool zerocopy);
+    /// Send what 'id' has queued, on EPOLLOUT.
+    void flushOut(Global::conn_id_t id);
+    void setOutEvents(const Connection& conn, bool out);
     ssize_t read(Global::conn_id_t id, int fd, char* buf, size_t n);  
 
-    int fd;                     // TCP listen sock
     int port;			// local listen port
 
     sockaddr_in addr;		// local address
 
+    const std::string unixPath; ///< Unix socket path, empty if none
+    int unixFd;                 ///< Unix listen sock, -1 if none
+
     /// Used for synchronization w/ upper level thread. Both these
     /// file descriptors must refer to eventfd file descriptors. The
-    /// lower level increments the count for each retrievable data or
-    /// signalling buffer. This allows the upper level poll to trigger
-    /// and know exactly how many messages it should retrieve.
+    /// lower level increments the count for each retrievable
+    /// signalling buffer; for data buffers, see 'BufferMgt'.
     const int data_out_fd; 
     const int sig_out_fd; 
 
     ConnectionMappings connMappings;
 
+    zcore::NetStats stats;
+
+    BufPool pool;               ///< must outlive the buffers of 'bufmgt'
     BufferMgt bufmgt;
     SignallingMgt sigmgt;
-
-    zcore::NetStats stats;
     
-    std::mutex mx;              // global mutex
+    std::vector<Worker> workers;
+    std::atomic_uint_fast64_t nextWorker; ///< for outgoing connections
 
-    int epollfd;
-    epoll_event ev;
+    const size_t outHigh;       ///< watermarks of the outbound queues
+    const size_t outLow;
+    const OutPolicy outPolicy;
 
     static const int EPOLL_TIMEOUT = 1000;
   };
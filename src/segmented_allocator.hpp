@@ -0,0 +1,506 @@
+// (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef SEGMENTED_ALLOCATOR_HPP
+#define SEGMENTED_ALLOCATOR_HPP
+
+
+#include <vector>
+#include <cstdio>
+#include "vector.hpp"
+
+
+/// Allocator for segmented persistent columns. Instead of one file
+/// that is grown with lseek/write/mremap, a column is a directory:
+///
+///   hdr       one page, the 'RawVector' header sits at its very end
+///   000000    first segment of 'segsz' bytes of data
+///   000001    ...
+///   manifest  segment size, number of segments, time range of each
+///             segment when the column is a time index
+///
+/// The header page and the segments are mapped at consecutive
+/// addresses inside a reserved (PROT_NONE) address range, so the
+/// 'Vector' sees one contiguous 'RawVector'. A segment is only mapped
+/// when it is first accessed (see 'FaultPager'). Growing the column
+/// maps a new segment after the last one: existing segments are never
+/// remapped, resized or rewritten. The reservation itself only has
+/// to move when it is exhausted, and it is doubled each time.
+///
+/// All segments but the tail are sealed: their time range is recorded
+/// and they are mapped read-only. A write to a sealed segment faults
+/// and opens it again, and its time range is unknown until it is
+/// sealed again. A read-only column maps everything read-only,
+/// including the tail and the header page.
+///
+/// Since all the columns of a 'zts' use the same segment size and
+/// the same element size, segment 'k' of the index and segment 'k'
+/// of each data column hold the same rows, and the time range
+/// recorded for the index segment is the time range of that
+/// partition. A search in the index for a time only touches the
+/// segment that holds it (see 'findTimeRows'), so a range query
+/// only maps the segments it overlaps.
+
+
+namespace arr {
+
+  const uint64_t SEGMENT_MAGIC   = 0x5a54534442534731ULL; // "ZTSDBSG1"
+  const uint64_t SEGMENT_VERSION = 1;
+
+  struct SegManifestHeader {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t segsz;
+    uint64_t nsegs;
+  };
+
+  /// Time range covered by a segment, in nanoseconds since the
+  /// epoch. Only meaningful for time index columns.
+  struct SegRange {
+    int64_t first;
+    int64_t last;
+  };
+
+  /// Range of a segment that isn't sealed.
+  const SegRange SEGRANGE_UNKNOWN{1, 0};
+
+  /// Check if 'path' is a segmented column.
+  inline bool isSegmentedColumn(const fsys::path& path) {
+    return fsys::is_regular_file(path / "manifest");
+  }
+
+
+  /// Read the 'RawVector' header of a segmented column.
+  inline RawVector<uint64_t> readSegmentedHeader(const fsys::path& path) {
+    RawVector<uint64_t> h;
+    auto hdrname = path / "hdr";
+    int fd = open(hdrname.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::system_error(std::error_code(errno, std::system_category()),
+                              "cannot open "s + hdrname.c_str());
+    }
+    auto res = pread(fd, &h, sizeof(h), sysconf(_SC_PAGESIZE) - sizeof(h));
+    close(fd);
+    if (res != sizeof(h)) {
+      throw std::range_error(hdrname.string() + ": invalid segmented column header");
+    }
+    return h;
+  }
+
+
+  struct segallocator : baseallocator {
+    /// 'segsz_p' is ignored when the column is read from disk: the
+    /// manifest has the segment size the column was created with. See
+    /// 'mmapallocator' for 'readonly_p' and 'advice_p'.
+    segallocator(const fsys::path& dirname_p, size_t segsz_p,
+                 bool readonly_p=false, int advice_p=MADV_NORMAL)
+      : base(nullptr), reserved(0), segsz(segsz_p), nsegs(0), dirname(dirname_p),
+        pagesz(sysconf(_SC_PAGESIZE)), readonly(readonly_p), advice(advice_p)
+    {
+      if (segsz % pagesz) {
+        segsz = (segsz / pagesz + 1) * pagesz;
+      }
+    }
+
+    inline void* initialize() {
+      SegManifestHeader h;
+      auto f = fopen((dirname / "manifest").c_str(), "rb");
+      if (!f) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot open "s + (dirname / "manifest").c_str());
+      }
+      auto res = fread(&h, sizeof(h), 1, f);
+      if (res == 1 && h.magic == SEGMENT_MAGIC && h.version == SEGMENT_VERSION) {
+        ranges.resize(h.nsegs);
+        res = h.nsegs ? fread(ranges.data(), sizeof(SegRange), h.nsegs, f) : 0;
+      }
+      fclose(f);
+      if (h.magic != SEGMENT_MAGIC || h.version != SEGMENT_VERSION || res != h.nsegs) {
+        throw std::range_error(dirname.string() + ": invalid segment manifest");
+      }
+      segsz = h.segsz;
+      reserve(h.nsegs);
+      nsegs = h.nsegs;
+      segstate.assign(nsegs, UNMAPPED);
+      setBytes(pagesz + nsegs * segsz);
+      FaultPager::instance().add(this);
+      if (!readonly) {
+        MsyncFlusher::instance().add(this);
+      }
+      return t();
+    }
+
+    inline size_t size() const { return sizeof(RawVector<uint64_t>) + nsegs * segsz; }
+
+    inline void* allocate(size_t sz) {
+      checkWritable();
+      if (mkdir(dirname.c_str(), 0700) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot create "s + dirname.c_str());
+      }
+      auto needed = segmentsFor(sz);
+      reserve(needed);
+      for (size_t k=0; k<needed; ++k) {
+        addSegment();
+      }
+      writeManifest();
+      setBytes(pagesz + nsegs * segsz);
+      dirty.mark(0, size());    // whatever the constructor writes
+      FaultPager::instance().add(this);
+      MsyncFlusher::instance().add(this);
+      return t();
+    }
+
+    inline void deallocate(void* address, size_t) {
+      checkWritable();
+      if (base) {
+        MsyncFlusher::instance().remove(this);
+        FaultPager::instance().remove(this);
+        std::lock_guard<std::recursive_mutex> guard(mx);
+        if (munmap(base, reserved) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "munmap");
+        }
+        base = nullptr;
+        reserved = 0;
+        nsegs = 0;
+        setBytes(0);
+        ranges.clear();
+        segstate.clear();
+        fsys::remove_all(dirname);
+      }
+    }
+
+    inline void* reallocate(void* old_address, size_t new_size) {
+      if (old_address != t()) {
+        throw std::out_of_range("segallocator can't reallocate at an offset");
+      }
+      checkWritable();
+      std::lock_guard<std::recursive_mutex> guard(mx); // the flusher can't use the mapping now
+      auto needed = segmentsFor(new_size);
+      auto oldbase = base;
+      if (needed > nsegs) {
+        reserve(needed);
+        while (nsegs < needed) {
+          addSegment();
+        }
+        // the segments before the tail are full and won't change:
+        sealOpen();
+        writeManifest();
+      }
+      else if (needed < nsegs) {
+        for (size_t k=needed; k<nsegs; ++k) {
+          auto segname = segmentName(k);
+          if (mmap(segAddress(k), segsz, PROT_NONE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE|MAP_FIXED, -1, 0)
+              == MAP_FAILED) {
+            throw std::system_error(std::error_code(errno, std::system_category()), "mmap (NONE)");
+          }
+          remove(segname.c_str());
+        }
+        nsegs = needed;
+        ranges.resize(nsegs);
+        segstate.resize(nsegs);
+        if (segstate[nsegs - 1] == SEALED) {
+          openSegment(nsegs - 1); // the new tail
+        }
+        writeManifest();
+      }
+      // segments are added or removed in place, only a new
+      // reservation moves the mapping:
+      countRealloc(base != oldbase);
+      setBytes(pagesz + nsegs * segsz);
+      return t();
+    }
+
+    /// Flush the header page and the pages written to since the last
+    /// flush.
+    inline virtual void msync(bool async) const {
+      if (readonly) {
+        return;
+      }
+      std::lock_guard<std::recursive_mutex> guard(mx);
+      syncDirty(async ? MS_ASYNC : MS_SYNC);
+    }
+
+    inline virtual DirtyRange* getDirtyRange() { return readonly ? nullptr : &dirty; }
+
+    inline virtual void flushDirty() {
+      std::lock_guard<std::recursive_mutex> guard(mx);
+      syncDirty(MS_SYNC);
+    }
+
+    virtual ~segallocator() {
+      FaultPager::instance().remove(this);
+      if (base && readonly) {
+        munmap(base, reserved);
+      }
+      else if (base) {
+        MsyncFlusher::instance().remove(this);
+        if (nsegs) {
+          sealOpen();
+          if (segstate[nsegs - 1] == OPEN) {
+            sealSegment(nsegs - 1); // record the time range of the tail
+          }
+          writeManifest();
+        }
+        if (::msync(base, pagesz + nsegs * segsz, MS_SYNC) == -1) {
+          munmap(base, reserved);
+          throw std::system_error(std::error_code(errno, std::system_category()), "msync");
+        }
+        if (munmap(base, reserved) == -1) {
+          throw std::system_error(std::error_code(errno, std::system_category()), "munmap");
+        }
+      }
+    }
+
+    inline virtual size_t resident() const {
+      return base ? residentBytes(base, pagesz + nsegs * segsz) : 0;
+    }
+
+    inline virtual bool isPaged() const { return true; }
+
+    inline virtual bool isReadOnly() const { return readonly; }
+
+    /// Map the segment on first access, or open a sealed segment that
+    /// is written to.
+    inline virtual bool onFault(const char* addr) {
+      if (!base || addr < segAddress(0) || addr >= segAddress(nsegs)) {
+        return false;
+      }
+      std::lock_guard<std::recursive_mutex> guard(mx);
+      const size_t k = (addr - segAddress(0)) / segsz;
+      try {
+        if (segstate[k] == UNMAPPED) {
+          mapSegment(k, false, k + 1 == nsegs && !readonly ? OPEN : SEALED);
+          return true;
+        }
+        if (segstate[k] == SEALED && !readonly) {
+          openSegment(k);
+          writeManifest();
+          return true;
+        }
+      }
+      catch (...) {
+        // nothing can be thrown from here; the access faults again
+        // and the process gets the default action.
+      }
+      return false;
+    }
+
+    /// Narrow [from, to) to the segment holding the first time at or
+    /// after 'tm' (after 'tm' if 'upper'), using the time ranges of the
+    /// sealed segments.
+    inline virtual void findTimeRows(int64_t tm, bool upper, size_t& from, size_t& to) const {
+      auto raw = static_cast<const RawVector<int64_t>*>(t());
+      if (!base || raw->typenumber != TypeNumber<Global::dtime>::n) {
+        return;
+      }
+      // the sealed segments holding elements:
+      const size_t perseg = segsz / sizeof(int64_t);
+      const size_t nsealed = std::min(nsegs ? nsegs - 1 : 0, (raw->n + perseg - 1) / perseg);
+      for (size_t k=0; k<nsealed; ++k) {
+        if (ranges[k].first > ranges[k].last) {
+          return;               // a segment was written to since it was sealed
+        }
+      }
+      auto it = std::partition_point(ranges.begin(), ranges.begin() + nsealed,
+                                     [&](const SegRange& r) { return upper ? r.last <= tm : r.last < tm; });
+      const size_t k = it - ranges.begin();
+      from = std::max(from, k * perseg);
+      to   = std::max(from, std::min(to, k < nsealed ? (k + 1) * perseg : to));
+    }
+
+  private:
+    enum SegState : char { UNMAPPED, SEALED, OPEN };
+
+    char* base;                 // start of the reservation
+    size_t reserved;            // size of the reservation
+    size_t segsz;
+    size_t nsegs;
+    const fsys::path dirname;
+    const size_t pagesz;
+    std::vector<SegRange> ranges;
+    std::vector<char> segstate; ///< 'SegState' of each segment
+    mutable DirtyRange dirty;
+    mutable std::recursive_mutex mx; ///< protects the mapping against the flusher and the faults
+    const bool readonly;
+    const int advice;
+
+    inline void checkWritable() const {
+      if (readonly) {
+        throw std::range_error(dirname.string() + " is mapped read-only");
+      }
+    }
+
+    /// To be called with 'mx' held.
+    inline void syncDirty(int flags) const {
+      if (base) {
+        MsyncTimer timer(*this);
+        msyncDirty(base, pagesz + nsegs * segsz, pagesz - sizeof(RawVector<uint64_t>), dirty, flags);
+      }
+    }
+
+    /// The address handed out to the 'Vector'.
+    inline void* t() const { return base + pagesz - sizeof(RawVector<uint64_t>); }
+    inline char* segAddress(size_t k) const { return base + pagesz + k * segsz; }
+
+    inline size_t segmentsFor(size_t sz) const {
+      auto datasz = sz > sizeof(RawVector<uint64_t>) ? sz - sizeof(RawVector<uint64_t>) : 0;
+      return std::max<size_t>(1, (datasz + segsz - 1) / segsz);
+    }
+
+    inline fsys::path segmentName(size_t k) const {
+      char name[32];
+      snprintf(name, sizeof(name), "%06zu", k);
+      return dirname / name;
+    }
+
+    /// Map the file 'filename' of size 'sz' at 'addr', creating it if
+    /// asked to. Without 'writable', or if the column is read-only,
+    /// the mapping is read-only.
+    inline void mapFile(const fsys::path& filename, void* addr, size_t sz, bool create,
+                        bool writable=true) const {
+      int fd = open(filename.c_str(), create ? O_RDWR|O_CREAT|O_TRUNC : (readonly ? O_RDONLY : O_RDWR),
+                    S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+      if (fd == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot open "s + filename.c_str());
+      }
+      if (create && posix_fallocate(fd, 0, sz) != 0) {
+        close(fd);
+        throw std::system_error(std::error_code(errno, std::system_category()), "posix_fallocate");
+      }
+      auto p = mmap(addr, sz, writable && !readonly ? PROT_READ|PROT_WRITE : PROT_READ,
+                    MAP_SHARED|MAP_FIXED, fd, 0);
+      close(fd);                // the mapping keeps the file open
+      if (p == MAP_FAILED) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mmap");
+      }
+    }
+
+    inline void mapSegment(size_t k, bool create, SegState st) {
+      mapFile(segmentName(k), segAddress(k), segsz, create, st == OPEN);
+      if (advice != MADV_NORMAL) {
+        ::madvise(segAddress(k), segsz, advice); // only a hint
+      }
+      segstate[k] = st;
+    }
+
+    /// Create a new tail segment.
+    inline void addSegment() {
+      segstate.push_back(UNMAPPED);
+      ranges.push_back(SEGRANGE_UNKNOWN);
+      mapSegment(nsegs, true, OPEN);
+      ++nsegs;
+    }
+
+    /// Make a sealed segment writable again.
+    inline void openSegment(size_t k) {
+      if (mprotect(segAddress(k), segsz, PROT_READ|PROT_WRITE) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mprotect");
+      }
+      segstate[k] = OPEN;
+      ranges[k] = SEGRANGE_UNKNOWN;
+    }
+
+    /// Seal the segments before the tail that were written to.
+    void sealOpen() {
+      for (size_t k=0; k + 1 < nsegs; ++k) {
+        if (segstate[k] == OPEN) {
+          sealSegment(k);
+          if (mprotect(segAddress(k), segsz, PROT_READ) == -1) {
+            throw std::system_error(std::error_code(errno, std::system_category()), "mprotect");
+          }
+          segstate[k] = SEALED;
+        }
+      }
+    }
+
+    /// Make sure the reservation can hold 'needed' segments, moving
+    /// all the mappings to a bigger reservation if it can't.
+    void reserve(size_t needed) {
+      size_t want = pagesz + needed * segsz;
+      if (base && want <= reserved) {
+        return;
+      }
+      size_t newreserved = std::max(want, std::max(2 * reserved, pagesz + 16 * segsz));
+      auto newbase = static_cast<char*>(mmap(NULL, newreserved, PROT_NONE,
+                                             MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0));
+      if (newbase == MAP_FAILED) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "mmap (NONE)");
+      }
+      auto oldbase = base;
+      auto oldreserved = reserved;
+      base = newbase;
+      reserved = newreserved;
+      try {
+        mapFile(dirname / "hdr", base, pagesz, !oldbase && !fsys::exists(dirname / "hdr"));
+        for (size_t k=0; k<nsegs; ++k) {
+          if (segstate[k] != UNMAPPED) {
+            mapSegment(k, false, static_cast<SegState>(segstate[k]));
+          }
+        }
+      }
+      catch (...) {
+        munmap(newbase, newreserved);
+        base = oldbase;
+        reserved = oldreserved;
+        throw;
+      }
+      if (oldbase) {
+        munmap(oldbase, oldreserved);
+      }
+    }
+
+    /// Record the time range of segment 'k' if the column is a time
+    /// index.
+    void sealSegment(size_t k) {
+      auto raw = static_cast<const RawVector<int64_t>*>(t());
+      if (raw->typenumber != TypeNumber<Global::dtime>::n) {
+        return;
+      }
+      const size_t perseg = segsz / sizeof(int64_t);
+      const size_t from = k * perseg;
+      if (from >= raw->n) {
+        return;
+      }
+      const size_t to = std::min<size_t>(raw->n, from + perseg) - 1;
+      ranges[k] = SegRange{raw->v[from], raw->v[to]};
+    }
+
+    void writeManifest() const {
+      auto tmpname = dirname / "manifest.tmp";
+      auto f = fopen(tmpname.c_str(), "wb");
+      if (!f) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot open "s + tmpname.c_str());
+      }
+      SegManifestHeader h{SEGMENT_MAGIC, SEGMENT_VERSION, segsz, nsegs};
+      bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+        (!nsegs || fwrite(ranges.data(), sizeof(SegRange), nsegs, f) == nsegs);
+      ok = fclose(f) == 0 && ok;
+      if (!ok || rename(tmpname.c_str(), (dirname / "manifest").c_str()) == -1) {
+        throw std::system_error(std::error_code(errno, std::system_category()),
+                                "cannot write "s + (dirname / "manifest").c_str());
+      }
+    }
+  };
+
+} // end namespace arr
+
+
+#endif
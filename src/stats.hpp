@@ -27,7 +27,7 @@
 namespace zcore {
 
   struct NetStats {
-    NetStats() { reset(); }
+    NetStats() : bytesInBufPool(0) { reset(); }
 
     std::atomic_uint_fast64_t nbInConn;
     std::atomic_uint_fast64_t nbOutConn;
@@ -35,6 +35,12 @@ namespace zcore {
     std::atomic_uint_fast64_t nbCloseOutConn;
     std::atomic_uint_fast64_t nbOutBuffers;     
     std::atomic_uint_fast64_t nbSendFail;
+    std::atomic_uint_fast64_t nbOutQueued;
+    std::atomic_uint_fast64_t nbOutBlocked;
+    std::atomic_uint_fast64_t nbOutDropped;
+    std::atomic_uint_fast64_t nbOutOverflow;
+    std::atomic_uint_fast64_t bytesOutZeroCopy;
+    std::atomic_uint_fast64_t bytesOutSendfile;
     std::atomic_uint_fast64_t nbInBuffers;     
     std::atomic_uint_fast64_t nbInBuffersDrop;     
     std::atomic_uint_fast64_t bytesTimedOut;
@@ -42,6 +48,10 @@ namespace zcore {
     std::atomic_uint_fast64_t nbReadFail;
     std::atomic_uint_fast64_t nbInMalformed;     
     std::atomic_uint_fast64_t readbuflistmax;     
+    std::atomic_uint_fast64_t nbDataSignals;
+    std::atomic_uint_fast64_t nbBufPoolHits;
+    std::atomic_uint_fast64_t nbBufPoolMisses;
+    std::atomic_uint_fast64_t bytesInBufPool; ///< occupancy, not reset
 
     inline void reset() {
       nbInConn.store(0);              
@@ -50,6 +60,12 @@ namespace zcore {
       nbCloseOutConn.store(0);  
       nbOutBuffers.store(0);     
       nbSendFail.store(0);      
+      nbOutQueued.store(0);
+      nbOutBlocked.store(0);
+      nbOutDropped.store(0);
+      nbOutOverflow.store(0);
+      bytesOutZeroCopy.store(0);
+      bytesOutSendfile.store(0);
       nbInBuffers.store(0);     
       bytesTimedOut.store(0);       
       nbInBuffersDrop.store(0);     
@@ -57,6 +73,9 @@ namespace zcore {
       nbReadFail.store(0);      
       nbInMalformed.store(0);   
       readbuflistmax.store(0);  
+      nbDataSignals.store(0);
+      nbBufPoolHits.store(0);
+      nbBufPoolMisses.store(0);
     }
   };
 
@@ -76,6 +95,7 @@ namespace zcore {
     std::atomic_uint_fast64_t nbAppendVector;
     std::atomic_uint_fast64_t nbAppendFail;
     std::atomic_uint_fast64_t nbAppendVectorFail;
+    std::atomic_uint_fast64_t nbAppendBatch;   ///< appends applied together, see 'flushAppends'
 
     inline void reset() {
       bytesOutREQ.store(0);      
@@ -90,6 +110,7 @@ namespace zcore {
       nbAppendVector.store(0);
       nbAppendFail.store(0);      
       nbAppendVectorFail.store(0);
+      nbAppendBatch.store(0);
     }
   };
 
@@ -108,6 +129,7 @@ namespace zcore {
     std::atomic_uint_fast64_t bytesInRSP;
     std::atomic_uint_fast64_t bytesAppend;
     std::atomic_uint_fast64_t bytesAppendVector;
+    std::atomic_uint_fast64_t nbAppendCoalesced;
 
     inline void reset() {
       nbOutREQ.store(0);         
@@ -122,6 +144,7 @@ namespace zcore {
       bytesInRSP.store(0);       
       bytesAppend.store(0);      
       bytesAppendVector.store(0);
+      nbAppendCoalesced.store(0);
     }
   };
 }
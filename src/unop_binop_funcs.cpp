@@ -97,6 +97,13 @@ inline void evalunop_inplace(arr::Array<T>& d, int op) {
 val::Value funcs::evalunop(val::Value vv, int op) {
   auto& v = val::gval(vv);
 
+  // scalars are evaluated unboxed, unless 'v' is a reference that
+  // must be modified in place:
+  Scalar s, res;
+  if (unbox(v, s) && !val::isRef(v) && evalunop(s, op, res)) {
+    return box(res);
+  }
+
   static std::set<int> arithmetic{
     yy::parser::token::PLUS, 
     yy::parser::token::MINUS};
@@ -446,6 +453,13 @@ static const tz::Zone& getTzone(const val::Value& val) {
 val::Value funcs::evalbinop(val::Value vv1, const val::Value& vv2, int op, const val::Value& attrib) {
   auto& v1 = val::gval(vv1);
   const auto& v2 = val::gval(vv2); 
+
+  // scalars are evaluated unboxed, unless 'v1' is a reference that
+  // must be modified in place:
+  Scalar s1, s2, res;
+  if (unbox(v1, s1) && unbox(v2, s2) && !val::isRef(v1) && evalbinop(s1, s2, op, res)) {
+    return box(res);
+  }
   
   static std::set<int> arithmetic{
     yy::parser::token::PLUS, 
@@ -1035,3 +1049,345 @@ val::Value funcs::evalbinop(val::Value vv1, const val::Value& vv2, int op, const
   // function:
   return evalbinop_value_value_comp(v1, v2, op);
 }
+
+
+// -------------- scalars -----------------------------
+
+template<typename T>
+static bool unboxArray(const val::Value& v, T& t) {
+  const auto& a = get<arr::cow_ptr<arr::Array<T>>>(v);
+  if (!a->isScalar() || a->hasNames()) {
+    return false;
+  }
+  t = (*a)[0];
+  return true;
+}
+
+
+bool funcs::unbox(const val::Value& vv, Scalar& s) {
+  const auto& v = val::gval(vv);
+  bool res = false;
+  switch (v.which()) {
+  case val::vt_double:   res = unboxArray(v, s.d);   break;
+  case val::vt_bool:     res = unboxArray(v, s.b);   break;
+  case val::vt_time:     res = unboxArray(v, s.t);   break;
+  case val::vt_duration: res = unboxArray(v, s.dur); break;
+  default: break;
+  }
+  s.vt = res ? static_cast<val::ValType>(v.which()) : val::vt_null;
+  return res;
+}
+
+
+val::Value funcs::box(const Scalar& s) {
+  switch (s.vt) {
+  case val::vt_double:   return val::make_array(s.d);
+  case val::vt_bool:     return val::make_array(s.b);
+  case val::vt_time:     return val::make_array(s.t);
+  case val::vt_duration: return val::make_array(s.dur);
+  default: throw std::range_error("box: not a scalar");
+  }
+}
+
+
+/// Comparison operators, as in 'doop' for the types that support them.
+template<typename T>
+static bool compare(const T& t, const T& u, int op, bool& res) {
+  switch (op) {
+  case yy::parser::token::LE: res = std::less_equal<T>()(t, u);    return true;
+  case yy::parser::token::LT: res = std::less<T>()(t, u);          return true;
+  case yy::parser::token::EQ: res = std::equal_to<T>()(t, u);      return true;
+  case yy::parser::token::NE: res = std::not_equal_to<T>()(t, u);  return true;
+  case yy::parser::token::GE: res = std::greater_equal<T>()(t, u); return true;
+  case yy::parser::token::GT: res = std::greater<T>()(t, u);       return true;
+  default: return false;
+  }
+}
+
+/// Comparison and logical operators ('boolean' in 'evalbinop').
+template<typename T>
+static bool logical(const T& t, const T& u, int op, bool& res) {
+  switch (op) {
+  case yy::parser::token::AND:
+  case yy::parser::token::AND2: res = std::logical_and<T>()(t, u); return true;
+  case yy::parser::token::OR:
+  case yy::parser::token::OR2:  res = std::logical_or<T>()(t, u);  return true;
+  default: return compare(t, u, op, res);
+  }
+}
+
+template<typename T, typename U, typename R>
+static bool plusMinus(const T& t, const U& u, int op, R& res) {
+  switch (op) {
+  case yy::parser::token::PLUS:  res = ztsdb::plus<T,U,R>()(t, u);  return true;
+  case yy::parser::token::MINUS: res = ztsdb::minus<T,U,R>()(t, u); return true;
+  default: return false;
+  }
+}
+
+
+bool funcs::evalunop(const Scalar& s, int op, Scalar& res) {
+  switch (s.vt) {
+  case val::vt_double:
+    switch (op) {
+    case yy::parser::token::PLUS:  res = s;                                return true;
+    case yy::parser::token::MINUS: res = s; res.d = unary_minus<double>()(s.d); return true;
+    case yy::parser::token::NOT:   res.vt = val::vt_bool; res.b = !s.d;    return true;
+    default: return false;
+    }
+  case val::vt_duration:
+    switch (op) {
+    case yy::parser::token::PLUS:  res = s;                                return true;
+    case yy::parser::token::MINUS: res = s; res.dur = -s.dur;              return true;
+    default: return false;
+    }
+  case val::vt_bool:
+    if (op != yy::parser::token::NOT) return false;
+    res.vt = val::vt_bool;
+    res.b = !s.b;
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+bool funcs::evalbinop(const Scalar& s1, const Scalar& s2, int op, Scalar& res) {
+  // the type rules are those of the boxed 'evalbinop':
+  switch (s1.vt) {
+  case val::vt_double:
+    if (s2.vt != val::vt_double) return false;
+    res.vt = val::vt_double;
+    switch (op) {
+    case yy::parser::token::PLUS:  res.d = ztsdb::plus<double,double,double>()(s1.d, s2.d);       return true;
+    case yy::parser::token::MINUS: res.d = ztsdb::minus<double,double,double>()(s1.d, s2.d);      return true;
+    case yy::parser::token::MUL:   res.d = ztsdb::multiplies<double,double,double>()(s1.d, s2.d); return true;
+    case yy::parser::token::DIV:   res.d = ztsdb::divides<double,double,double>()(s1.d, s2.d);    return true;
+    case yy::parser::token::MOD:   res.d = ztsdb::modulus<double,double,double>()(s1.d, s2.d);    return true;
+    case yy::parser::token::POWER: res.d = funcs::power<double>()(s1.d, s2.d);                    return true;
+    default:
+      res.vt = val::vt_bool;
+      return logical(s1.d, s2.d, op, res.b);
+    }
+  case val::vt_bool:
+    if (s2.vt != val::vt_bool) return false;
+    res.vt = val::vt_bool;
+    return logical(s1.b, s2.b, op, res.b);
+  case val::vt_time:
+    if (s2.vt == val::vt_time) {
+      if (op == yy::parser::token::MINUS) {
+        res.vt = val::vt_duration;
+        res.dur = s1.t - s2.t;
+        return true;
+      }
+      res.vt = val::vt_bool;
+      return compare(s1.t, s2.t, op, res.b);
+    }
+    else if (s2.vt == val::vt_duration) {
+      res.vt = val::vt_time;
+      return plusMinus(s1.t, s2.dur, op, res.t);
+    }
+    return false;
+  case val::vt_duration:
+    if (s2.vt == val::vt_duration) {
+      res.vt = val::vt_duration;
+      if (plusMinus(s1.dur, s2.dur, op, res.dur)) return true;
+      res.vt = val::vt_bool;
+      return compare(s1.dur, s2.dur, op, res.b);
+    }
+    else if (s2.vt == val::vt_time && op == yy::parser::token::PLUS) {
+      res.vt = val::vt_time;
+      res.t = ztsdb::plus<Global::duration, Global::dtime, Global::dtime>()(s1.dur, s2.t);
+      return true;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+
+// -------------- fused elementwise evaluation -----------------------
+
+namespace {
+
+  /// What a fused node evaluates to, following the rules of
+  /// 'arr::apply' and of the 'zts' cases of 'evalbinop': the array
+  /// giving its dimensions, the names of each dimension, and the time
+  /// index if the node is a time series.
+  struct Shape {
+    const arr::Array<double>* a;
+    std::vector<const arr::Dname*> names;
+    const arr::Array<Global::dtime>* idx;
+    arr::idx_type size() const { return a->size(); }
+  };
+
+  /// Number of elements of each column evaluated at a time; the
+  /// intermediate results of a block stay in the cache.
+  const size_t FUSED_BLOCK = 512;
+
+  template <typename F>
+  void fusedApply(const double* l, size_t sl, const double* r, size_t sr, double* out, size_t n) {
+    F f;
+    if (sl && sr) {
+      for (size_t i=0; i<n; ++i) out[i] = f(l[i], r[i]);
+    }
+    else if (sl) {
+      const auto rv = r[0];
+      for (size_t i=0; i<n; ++i) out[i] = f(l[i], rv);
+    }
+    else if (sr) {
+      const auto lv = l[0];
+      for (size_t i=0; i<n; ++i) out[i] = f(lv, r[i]);
+    }
+    else {
+      out[0] = f(l[0], r[0]);
+    }
+  }
+
+  void fusedBinop(int op, const double* l, size_t sl, const double* r, size_t sr, double* out, size_t n) {
+    switch (op) {
+    case yy::parser::token::PLUS:
+      return fusedApply<ztsdb::plus<double, double, double>>(l, sl, r, sr, out, n);
+    case yy::parser::token::MINUS:
+      return fusedApply<ztsdb::minus<double, double, double>>(l, sl, r, sr, out, n);
+    case yy::parser::token::MUL:
+      return fusedApply<ztsdb::multiplies<double, double, double>>(l, sl, r, sr, out, n);
+    case yy::parser::token::DIV:
+      return fusedApply<ztsdb::divides<double, double, double>>(l, sl, r, sr, out, n);
+    case yy::parser::token::MOD:
+      return fusedApply<ztsdb::modulus<double, double, double>>(l, sl, r, sr, out, n);
+    default:
+      return fusedApply<funcs::power<double>>(l, sl, r, sr, out, n);
+    }
+  }
+
+  void fusedUnop(int op, const double* l, size_t sl, double* out, size_t n) {
+    if (op == yy::parser::token::MINUS) {
+      unary_minus<double> f;
+      for (size_t i=0; i<(sl ? n : 1); ++i) out[i] = f(l[i*sl]);
+    }
+    else {
+      std::copy(l, l + (sl ? n : 1), out);
+    }
+  }
+
+  /// Compute the shapes of 'nodes'; false if the expression can't be fused.
+  bool fusedShapes(const std::vector<funcs::FusedNode>& nodes, std::vector<Shape>& shapes) {
+    for (const auto& nd : nodes) {
+      if (nd.op == 0) {
+        const auto& v = val::gval(nd.v);
+        switch (v.which()) {
+        case val::vt_double: {
+          const auto& a = *get<val::SpVAD>(v);
+          shapes.push_back(Shape{&a, {}, nullptr});
+          break;
+        }
+        case val::vt_zts: {
+          const auto& z = *get<val::SpZts>(v);
+          shapes.push_back(Shape{&z.getArray(), {}, &z.getIndex()});
+          break;
+        }
+        default:
+          return false;
+        }
+        for (const auto& n : shapes.back().a->names) {
+          shapes.back().names.push_back(n.get());
+        }
+      }
+      else if (nd.r < 0) {
+        const auto& l = shapes[nd.l];
+        if (l.idx || (nd.op != yy::parser::token::PLUS && nd.op != yy::parser::token::MINUS)) {
+          return false;
+        }
+        shapes.push_back(l);
+      }
+      else {
+        switch (nd.op) {
+        case yy::parser::token::PLUS: case yy::parser::token::MINUS:
+        case yy::parser::token::MUL:  case yy::parser::token::DIV:
+        case yy::parser::token::MOD:  case yy::parser::token::POWER:
+          break;
+        default:
+          return false;
+        }
+        const auto& l = shapes[nd.l];
+        const auto& r = shapes[nd.r];
+        if (l.idx && r.idx && l.idx->getcol(0) != r.idx->getcol(0)) {
+          return false;
+        }
+        Shape s = l.size() == 1 ? r : l;
+        if (l.size() != 1 && r.size() != 1) {
+          if (l.a->getdim() != r.a->getdim()) {
+            return false;
+          }
+          for (size_t j=0; j<s.names.size(); ++j) {
+            if (!l.names[j]->hasNames()) s.names[j] = r.names[j];
+          }
+        }
+        s.idx = l.idx ? l.idx : r.idx;
+        if (s.idx && s.a->getdim(0) != s.idx->getdim(0)) {
+          return false;
+        }
+        shapes.push_back(std::move(s));
+      }
+    }
+    return true;
+  }
+
+} // end anonymous namespace
+
+
+bool funcs::evalfused(const std::vector<FusedNode>& nodes, val::Value& res) {
+  std::vector<Shape> shapes;
+  if (!fusedShapes(nodes, shapes)) {
+    return false;
+  }
+
+  const auto& root = shapes.back();
+  arr::Array<double> ret(arr::rsv, root.a->getdim());
+  for (size_t j=0; j<root.names.size(); ++j) {
+    ret.names[j] = std::make_unique<arr::Dname>(*root.names[j]);
+  }
+
+  // each node reads its operands with a stride of 0 (a one element
+  // operand, recycled) or of 1:
+  std::vector<double> buf(nodes.size() * FUSED_BLOCK);
+  std::vector<const double*> p(nodes.size());
+  std::vector<size_t> stride(nodes.size());
+  for (size_t k=0; k<nodes.size(); ++k) {
+    stride[k] = shapes[k].size() == 1 ? 0 : 1;
+  }
+
+  for (arr::idx_type n=0; n<ret.ncols(); ++n) {
+    const auto nrows = ret.getdim(0);
+    for (size_t off=0; off<nrows; off+=FUSED_BLOCK) {
+      const auto len = std::min<size_t>(FUSED_BLOCK, nrows - off);
+      for (size_t k=0; k<nodes.size(); ++k) {
+        const auto& nd = nodes[k];
+        if (nd.op == 0) {
+          p[k] = stride[k] ? shapes[k].a->getcol(n).c_ptr() + off : shapes[k].a->getcol(0).c_ptr();
+        }
+        else {
+          auto out = &buf[k * FUSED_BLOCK];
+          if (nd.r < 0) {
+            fusedUnop(nd.op, p[nd.l], stride[nd.l], out, len);
+          }
+          else {
+            fusedBinop(nd.op, p[nd.l], stride[nd.l], p[nd.r], stride[nd.r], out, len);
+          }
+          p[k] = out;
+        }
+      }
+      ret.getcol(n).append(p.back(), stride.back() ? len : 1);
+    }
+  }
+
+  if (root.idx) {
+    res = arr::make_cow<arr::zts>(false, *root.idx, std::move(ret));
+  }
+  else {
+    res = arr::make_cow<val::VArrayD>(false, std::move(ret));
+  }
+  return true;
+}
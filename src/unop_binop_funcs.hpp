@@ -20,6 +20,7 @@
 #define UNOP_BINOP_FUNCS
 
 #include <string>
+#include <vector>
 #include "valuevar.hpp"
 
 
@@ -42,6 +43,47 @@ namespace funcs {
   val::Value evalunop(val::Value v, int op);
   val::Value evalbinop(val::Value v1, const val::Value& v2, int op, const val::Value& attrib);
 
+
+  /// An unboxed scalar: the element of a one element array without
+  /// names of type double, logical, time or duration. Arithmetic on
+  /// scalars does not allocate; they are boxed back into an 'Array'
+  /// only when they escape to where a 'val::Value' is needed.
+  struct Scalar {
+    val::ValType vt;            ///< 'vt_null' when nothing is unboxed
+    double d;
+    bool b;
+    Global::dtime t;
+    Global::duration dur;
+  };
+
+  /// Unbox 'v' into 's'; returns false if 'v' is not a scalar.
+  bool unbox(const val::Value& v, Scalar& s);
+  val::Value box(const Scalar& s);
+
+  /// Scalar specialisations of the above. They return false for the
+  /// operations they do not handle, which must then be evaluated
+  /// boxed (this is also where errors are reported).
+  bool evalunop(const Scalar& s, int op, Scalar& res);
+  bool evalbinop(const Scalar& s1, const Scalar& s2, int op, Scalar& res);
+
+
+  /// A node of an elementwise expression on double arrays and time
+  /// series: a leaf holding its operand, or a unary ('r' < 0) or
+  /// binary operator applied to earlier nodes.
+  struct FusedNode {
+    int op;                     ///< the operator; 0 for a leaf
+    int l, r;                   ///< indices of the operand nodes
+    val::Value v;               ///< the operand of a leaf
+  };
+
+  /// Evaluate the expression 'nodes', whose root is the last node, in
+  /// a single pass per column, without materialising the result of
+  /// each operator. Returns false if the expression can't be fused
+  /// (operand types, non-arithmetic operators, mismatched dimensions
+  /// or time indices); it must then be evaluated one operator at a
+  /// time, which also reports any error.
+  bool evalfused(const std::vector<FusedNode>& nodes, val::Value& res);
+
 }
 
 #endif
@@ -19,6 +19,7 @@
 #include <arpa/inet.h>
 #include "valuevar.hpp"
 #include "env.hpp"
+#include "anf.hpp"
 
 // #define DEBUG
 
@@ -26,6 +27,7 @@
 val::VClos::VClos(const Function* f_a) { 
   f = std::shared_ptr<Function>(f_a->clone()); // clone: need a full copy of the parse tree
   f->processFormlist(argMap, ellipsisPos);
+  anf::resolveSlots(f.get());
 }
 
 
@@ -412,3 +414,26 @@ bool val::isConst(const val::Value& v) {
                              val::vt_list>(v);
 }
 
+
+template<typename T>
+struct isReadOnly_helper {
+  static bool f(const val::Value& v) {
+    auto& a = get<T>(v);
+    return a.isReadOnly();
+  }
+};
+
+
+bool val::isReadOnly(const val::Value& v) { 
+  return apply_to_types_bool<isReadOnly_helper, 
+                             val::vt_double, 
+                             val::vt_bool, 
+                             val::vt_time, 
+                             val::vt_duration, 
+                             val::vt_interval, 
+                             val::vt_period, 
+                             val::vt_string, 
+                             val::vt_zts,
+                             val::vt_list>(v);
+}
+
@@ -513,6 +513,7 @@ namespace val {
   bool isRef(const Value& v);
   bool isTmp(const Value& v);
   bool isConst(const Value& v);
+  bool isReadOnly(const Value& v);
 
 } // end namespace val
 
@@ -99,6 +99,18 @@ namespace arr {
   }
 
   
+  /// Whether the 'n' elements at 'p' are ordered by 'O'. The loop
+  /// has no early exit so that it can be vectorized.
+  template<typename T, typename O>
+  inline bool isOrdered(const T* p, size_t n) {
+    bool res = true;
+    for (size_t i=1; i<n; ++i) {
+      res &= O()(p[i-1], p[i]);
+    }
+    return res;
+  }
+
+  
   template<typename T, typename O=std::less<T>>
   struct Vector {
     typedef T value_type;
@@ -121,7 +133,8 @@ namespace arr {
     // constructors --------------------------------------------
 
     /// move constructor.
-    Vector(Vector<T,O>&& v) : alloc(std::move(v.alloc)), c(v.c), capacity(v.capacity) {
+    Vector(Vector<T,O>&& v) : alloc(std::move(v.alloc)), c(v.c), capacity(v.capacity), dirty(v.dirty),
+                              readonly(v.readonly) {
       // std::cout << "Vector move constructor" << std::endl;
       // LLL use swap and then c can never be null, check that alloc will actually swap LLL
       v.c = nullptr;
@@ -130,12 +143,16 @@ namespace arr {
     // copy constructor.
     Vector(const Vector<T,O>& v, 
            std::unique_ptr<baseallocator>&& alloc_p=std::make_unique<memallocator>()) 
-      : alloc(std::move(alloc_p)), capacity(v.capacity) 
+      : alloc(std::move(alloc_p)), capacity(v.capacity),
+        dirty(alloc ? alloc->getDirtyRange() : nullptr)
     {
       // std::cout << "Vector copy constructor" << std::endl;
       if (!alloc) {
         throw std::invalid_argument("Vector<T>: null allocator");
       }
+      if (v.c->n < VECTOR_INITIAL_ALLOC/2 && alloc->allocatesToSize()) {
+        capacity = v.c->n;
+      }
       c = new (alloc->allocate(getTotalSize<T>(capacity))) RawVector<T>;
       memcpy((void*)c, v.c, sizeof(RawVector<T>));
       for (size_t j=0; j<v.c->n; ++j) {
@@ -147,12 +164,12 @@ namespace arr {
     Vector(size_t n=0,
            const T& value=getInitValue<T>(),
            std::unique_ptr<baseallocator>&& alloc_p=std::make_unique<memallocator>())
-      : alloc(std::move(alloc_p))
+      : alloc(std::move(alloc_p)), dirty(alloc ? alloc->getDirtyRange() : nullptr)
     {
       if (!alloc) {
         throw std::invalid_argument("Vector<T>: null allocator");
       }
-      capacity = growCapacity(n);
+      capacity = fitCapacity(n);
       c = new (alloc->allocate(getTotalSize<T>(capacity))) RawVector<T>;
       c->typenumber = TypeNumber<T>::n;
       c->n = n;
@@ -165,12 +182,12 @@ namespace arr {
     /// basic constructor leaving the vector allocated but uninitialized.
     Vector(rsv_t, size_t n, 
            std::unique_ptr<baseallocator>&& alloc_p=std::make_unique<memallocator>()) 
-      : alloc(std::move(alloc_p))
+      : alloc(std::move(alloc_p)), dirty(alloc ? alloc->getDirtyRange() : nullptr)
     {
       if (!alloc) {
         throw std::invalid_argument("Vector<T,O>: null allocator");
       }
-      capacity = growCapacity(n);
+      capacity = fitCapacity(n);
       c = new (alloc->allocate(getTotalSize<T>(capacity))) RawVector<T>;
       c->typenumber = TypeNumber<T>::n;
       c->n = 0;
@@ -181,12 +198,12 @@ namespace arr {
     /// length, but elements uninitialized.
     Vector(noinit_t, size_t n, 
            std::unique_ptr<baseallocator>&& alloc_p=std::make_unique<memallocator>()) 
-      : alloc(std::move(alloc_p))
+      : alloc(std::move(alloc_p)), dirty(alloc ? alloc->getDirtyRange() : nullptr)
     {
       if (!alloc) {
         throw std::invalid_argument("Vector<T,O>: null allocator");
       }
-      capacity = growCapacity(n);
+      capacity = fitCapacity(n);
       c = new (alloc->allocate(getTotalSize<T>(capacity))) RawVector<T>;
       c->typenumber = TypeNumber<T>::n;
       c->n = n;
@@ -198,13 +215,13 @@ namespace arr {
     Vector(const InputIterator& b, 
            const InputIterator& e, 
            std::unique_ptr<baseallocator>&& alloc_p=std::make_unique<memallocator>()) 
-      : alloc(std::move(alloc_p))
+      : alloc(std::move(alloc_p)), dirty(alloc ? alloc->getDirtyRange() : nullptr)
     { 
       if (!alloc) {
         throw std::invalid_argument("Vector<T,O>: null allocator");
       }
       size_t n = e - b;
-      capacity = growCapacity(n);
+      capacity = fitCapacity(n);
       c = new (alloc->allocate(getTotalSize<T>(capacity))) RawVector<T>;    
       c->typenumber = TypeNumber<T>::n;
       c->n = n;
@@ -224,13 +241,13 @@ namespace arr {
 
     Vector(std::initializer_list<T> l, 
            std::unique_ptr<baseallocator>&& alloc_p=std::make_unique<memallocator>()) 
-      : alloc(std::move(alloc_p))
+      : alloc(std::move(alloc_p)), dirty(alloc ? alloc->getDirtyRange() : nullptr)
     {
       if (!alloc) {
         throw std::invalid_argument("Vector<T,O>: null allocator");
       }
       size_t n = l.size();
-      capacity = growCapacity(n);
+      capacity = fitCapacity(n);
       c = new (alloc->allocate(getTotalSize<T>(capacity))) RawVector<T>; 
       c->typenumber = TypeNumber<T>::n;
       c->n = n;
@@ -247,18 +264,27 @@ namespace arr {
     }
 
     /// constructor from a mmapallocator.
-    Vector(std::unique_ptr<baseallocator>&& alloc_p) : alloc(std::move(alloc_p)) {
+    Vector(std::unique_ptr<baseallocator>&& alloc_p)
+      : alloc(std::move(alloc_p)), dirty(alloc ? alloc->getDirtyRange() : nullptr) {
       if (!alloc) {
         throw std::invalid_argument("Vector<T,O>: null allocator");
       }
       c = static_cast<RawVector<T>*>(alloc->initialize()); // will throw!
-      capacity = alloc->size();
+      // the allocator reports bytes, capacity is in elements:
+      capacity = alloc->size() > sizeof(RawVector<T>) ? 
+        (alloc->size() - sizeof(RawVector<T>)) / sizeof(T) : 0;
+      readonly = alloc->isReadOnly();
+      if (readonly) {
+        capacity = c ? c->n : 0; // growing goes through the allocator, which refuses
+      }
     }
 
     void swap(Vector<T,O>& o) {
       std::swap(alloc, o.alloc);
       std::swap(c, o.c);
       std::swap(capacity, o.capacity);
+      std::swap(dirty, o.dirty);
+      std::swap(readonly, o.readonly);
     }
 
     Vector& operator=(Vector<T,O> other) {
@@ -284,6 +310,9 @@ namespace arr {
       if (!c || i > size() - 1) {
         throw std::out_of_range("subscript out of bounds");
       }
+      if (!readonly) {
+        setDirty(i, i + 1);
+      }
       return c->v[i];
     }
 
@@ -304,6 +333,7 @@ namespace arr {
         c = static_cast<RawVector<T>*>(mem);
       }
       new (&c->v[c->n]) T(value);
+      setDirty(c->n, c->n + 1);
       c->ordered = c->n > 0 ? c->ordered & O()(c->v[c->n-1], c->v[c->n]) : true;
       ++c->n;
     }
@@ -320,14 +350,10 @@ namespace arr {
       if (diff <= 0) {
         return position;
       }
-      auto oldbegin = begin();
-      auto oldend = end();
       resize(size() + static_cast<size_t>(diff));
       // move down everything that is at and beyond position: 
-      if (oldbegin != oldend && oldend - 1 - position > 0) {
-        for (auto iter = end(); iter != position; --iter) {
-          *(iter) = *(iter - diff);
-        }
+      for (auto iter = end() - 1; iter - position >= diff; --iter) {
+        *(iter) = *(iter - diff);
       }
       // insert the elements
       *position = *first;
@@ -354,6 +380,7 @@ namespace arr {
     }
 
     vector_iterator<T,O> erase(const vector_iterator<T,O>& position) {
+      setDirty(static_cast<size_t>(position), size());
       for (auto iter = position; iter != end()-1; ++iter) {
         *iter = *(iter + 1);
       }
@@ -362,6 +389,7 @@ namespace arr {
     }
 
     vector_iterator<T,O> erase(const vector_iterator<T,O>& first, const vector_iterator<T,O>& last) {
+      setDirty(static_cast<size_t>(first), size());
       auto diff = last - first;
       for (auto iter = first; iter + diff != end(); ++iter) {
         *iter = *(iter + diff);
@@ -390,23 +418,25 @@ namespace arr {
 
     size_t size() const { if (c) return c->n; else return 0; }
     bool isOrdered() const { if (c) return c->ordered; else return false; }
-    void forceOrdered() { if (c) c->ordered = true; }
-    void forceUnOrdered() { if (c) c->ordered = false; }
-    void setOrdered(bool val) { if (c) c->ordered = val; }
+    // a read-only vector can't change, so neither can its order:
+    void forceOrdered() { if (c && !readonly) c->ordered = true; }
+    void forceUnOrdered() { if (c && !readonly) c->ordered = false; }
+    void setOrdered(bool val) { if (c && !readonly) c->ordered = val; }
 
     bool checkAndSetOrdered() {
       for (size_t j=1; j<size(); ++j) {
         if (!O()(c->v[j-1], c->v[j])) {
-          c->ordered = false;
+          setOrdered(false);
           return false;
         }
       }
-      c->ordered = true;
+      setOrdered(true);
       return true;
     }
 
     Vector<T,O>& init(size_t count, const T& value) {
       resize(count);
+      setDirty(0, count);
       for (size_t j=0; j<count; ++j) {
         c->v[j] = value;
       }
@@ -414,16 +444,33 @@ namespace arr {
       return *this;
     }
 
+    /// Make room for 'n' elements, so that growing the vector up to
+    /// 'n' doesn't reallocate.
+    Vector<T,O>& reserve(size_t n) {
+      if (n > capacity) {
+        if (!alloc) {
+          throw std::range_error("vector::reserve: cannot reallocate with null allocator");
+        }
+        capacity = growCapacity(n);
+        c = static_cast<RawVector<T>*>(alloc->reallocate(c, memsize(capacity)));
+      }
+      return *this;
+    }
+
     // the elements after current end will be uninitialized
     Vector<T,O>& resize(size_t n, size_t from=0) { 
       if (from > c->n) {
         throw std::out_of_range("resize from out of bounds");
       }
+      if (!from && n > c->n && n <= capacity) {
+        c->n = n;                       // growing within the capacity
+        return *this;
+      }
       if (from || n != c->n) {          // only resize if needed
         if (!alloc) {
           throw std::range_error("vector::resize: cannot reallocate with null allocator");
         }
-        capacity = growCapacity(n);
+        capacity = fitCapacity(n);
         RawVector<T> rv = *c;
         c = new (alloc->reallocate((char*)c + from*sizeof(T), memsize(capacity))) RawVector<T>;
         memcpy((void*)c, &rv, sizeof(RawVector<T>));
@@ -438,6 +485,7 @@ namespace arr {
       }
       size_t start_fill = c->n - from;
       resize(n, from);
+      setDirty(start_fill, n);
       for (size_t i = start_fill; i < n; ++i) {
         c->v[i] = v;
       }
@@ -468,6 +516,7 @@ namespace arr {
       auto old_n = c->n;
       resize(c->n + appendvec->n); // will also redimension
       memcpy(&c->v[old_n], appendvec->v, appendvec->n*sizeof(T));
+      setDirty(old_n, c->n);
               
       if (appendvec->n) {
         c->ordered &= appendvec->ordered;
@@ -478,10 +527,29 @@ namespace arr {
       return totalsz;
     }
 
+    /// Append the 'n' elements at 'p' with a single copy, growing the
+    /// vector at most once. Same caveat as above for 'T' that are not
+    /// "flat".
+    Vector<T,O>& append(const T* p, size_t n) {
+      if (n == 0) {
+        return *this;
+      }
+      auto old_n = c->n;
+      reserve(old_n + n);
+      resize(old_n + n);        // within the capacity
+      memcpy(&c->v[old_n], p, n*sizeof(T));
+      setDirty(old_n, c->n);
+      if (c->ordered) {
+        c->ordered = (old_n == 0 || O()(c->v[old_n-1], p[0])) && arr::isOrdered<T,O>(p, n);
+      }
+      return *this;
+    }
+
     template <typename AO=O>
     Vector& sort() {
       if (std::is_same<AO, O>::value && c->ordered) return *this;
 
+      setDirty(0, size());
       std::sort(begin(), end(), AO()); 
       
       // if the sort function is the same as the one defined for
@@ -506,6 +574,7 @@ namespace arr {
 
     template<typename F, typename ...U>
     Vector& apply(const U&... u) {
+      setDirty(0, size());
       c->ordered = true;        // we're doing the whole vector, so
                                 // forget about the current status and
                                 // calculate it with
@@ -518,6 +587,7 @@ namespace arr {
 
     template<typename F, typename U>
     Vector& apply_scalar_post(const U& u) {
+      setDirty(0, size());
       c->ordered = true;
       for (size_t i=0; i<size(); ++i) {
         setv_checkbefore(*this, i, F()((*this)[i], u));
@@ -545,25 +615,79 @@ namespace arr {
     const RawVector<T>* getRawVectorPtr() const { return c; }
 
     /// buffer constructor
-    Vector<T,O>(char* buf, size_t len) : alloc(nullptr)
+    Vector<T,O>(char* buf, size_t len) : alloc(nullptr), dirty(nullptr)
     {
       capacity = len;
       // checks LLL
       c = new (buf) RawVector<T>;
     }
 
-    T* c_ptr() { return c ? c->v : nullptr; }
+    T* c_ptr() { if (!readonly) setDirty(0, capacity); return c ? c->v : nullptr; }
     const T* c_ptr() const { return c ? c->v : nullptr; }
     const baseallocator* getAllocator() const { return alloc.get(); }
+
+    /// Get the file and offset of the elements if the vector is a
+    /// shared mapping of a file, see 'baseallocator::getFileRange'.
+    bool getFileRange(int& fd, off_t& off) const {
+      if (!c || !alloc || !alloc->getFileRange(fd, off)) {
+        return false;
+      }
+      off += reinterpret_cast<const char*>(c->v) - reinterpret_cast<const char*>(c);
+      return true;
+    }
+
+    /// See 'baseallocator::findTimeRows'.
+    void findTimeRows(int64_t tm, bool upper, size_t& from, size_t& to) const {
+      if (alloc) {
+        alloc->findTimeRows(tm, upper, from, to);
+      }
+    }
+
+    /// True if the elements are paged in on access, see 'baseallocator::isPaged'.
+    bool isPaged() const { return alloc && alloc->isPaged(); }
+
+    /// Add the memory usage of this vector to 'u'.
+    void addMemUsage(MemUsage& u) const {
+      ++u.nbVectors;
+      u.bytesUsed += c ? getBufferSize() : 0;
+      if (alloc) {
+        alloc->addMemUsage(u);
+      }
+    }
     
   private:
     std::unique_ptr<baseallocator> alloc;
     RawVector<T>* c;
     size_t capacity;
+    DirtyRange* dirty;          ///< null if the allocator doesn't track writes
+    /// The allocation is mapped read-only (see
+    /// 'baseallocator::isReadOnly'): modifiers throw instead of
+    /// writing, and the accessors that give a non-const reference
+    /// don't update the header, so that reads never write. A write
+    /// through such a reference faults.
+    bool readonly = false;
+
+    T& at(size_t i) { if (!readonly) setDirty(i, i + 1); return c->v[i]; }
 
-    T& at(size_t i) { return c->v[i]; }
+    /// Record that elements [from, to) are written; to be called
+    /// before writing them.
+    inline void setDirty(size_t from, size_t to) {
+      if (dirty) {
+        dirty->mark(sizeof(RawVector<T>) + from*sizeof(T), sizeof(RawVector<T>) + to*sizeof(T));
+      }
+      else if (readonly) {
+        throw std::range_error("cannot modify read-only vector");
+      }
+    }
 
     static inline size_t memsize(size_t n) { return n*sizeof(T) + sizeof(RawVector<T>); }
+
+    /// Capacity for 'n' elements outside of an append: small vectors
+    /// get exactly 'n' if the allocator allocates to size, so that a
+    /// scalar doesn't cost 'VECTOR_INITIAL_ALLOC' elements.
+    inline size_t fitCapacity(size_t n) const {
+      return n < VECTOR_INITIAL_ALLOC/2 && alloc->allocatesToSize() ? n : growCapacity(n);
+    }
   };
 
 
@@ -722,6 +846,7 @@ namespace arr {
   template <typename T, typename O>
   void setv(Vector<T,O>& v, size_t i, const T& t) {
     if (i >= v.size()) throw std::range_error("subscript out of bounds");
+    v.setDirty(i, i + 1);
     if (v.isOrdered()) {
       if (i > 0)           v.c->ordered = O()(v[i-1], t);
       if (i < v.size()-1)  v.c->ordered = v.c->ordered && O()(t, v[i+1]);
@@ -731,6 +856,7 @@ namespace arr {
   template <typename T, typename O>
   void setv_checkbefore(Vector<T,O>& v, size_t i, const T& t) {
     if (i >= v.size()) throw std::range_error("subscript out of bounds");
+    v.setDirty(i, i + 1);
     v.c->v[i] = t;    
     if (v.isOrdered()) {
       if (i > 0)           v.c->ordered = O()(v.c->v[i-1], t);
@@ -739,6 +865,7 @@ namespace arr {
 
   template <typename T, typename O>
   void setv_nocheck(Vector<T,O>& v, size_t i, const T& t) {
+    v.setDirty(i, i + 1);
     v.c->v[i] = t;    
   }
 
@@ -0,0 +1,342 @@
+// (C) 2016 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <map>
+#include "vm.hpp"
+#include "interp.hpp"
+#include "interp_ctx.hpp"
+#include "interp_error.hpp"
+#include "unop_binop_funcs.hpp"
+#include "conversion_funcs.hpp"
+
+
+namespace {
+
+  /// Thrown by the compiler when it meets an expression the VM does
+  /// not handle.
+  struct Decline { };
+
+
+  struct Compiler {
+    Compiler(vm::Code& c_p) : c(c_p) { }
+
+    unsigned value(const E* e);
+    void effect(const E* e);
+
+  private:
+    vm::Code& c;
+    std::map<std::string, unsigned> tmps; // ANF temporaries -> registers
+    std::map<std::string, unsigned> names;
+
+    unsigned reg() { return c.nregs++; }
+
+    unsigned emit(vm::Opcode opcode, const E* e,
+                  unsigned a=0, unsigned b=0, unsigned c_p=0, unsigned d=0, int op=0) {
+      c.instrs.push_back(vm::Instr{opcode, op, a, b, c_p, d, e});
+      return c.instrs.size() - 1;
+    }
+
+    unsigned here() const { return c.instrs.size(); }
+
+    unsigned constant(val::Value v) {
+      auto r = reg();
+      c.consts.emplace_back(r, std::move(v));
+      return r;
+    }
+
+    unsigned name(const std::string& s) {
+      auto res = names.emplace(s, c.names.size());
+      if (res.second) {
+        c.names.push_back(s);
+      }
+      return res.first->second;
+    }
+
+    unsigned symbol(const Symbol* s) {
+      if (s->data[0] == '?') {
+        // ANF always assigns a temporary before it reads it:
+        auto t = tmps.find(s->data);
+        if (t == tmps.end()) throw Decline();
+        return t->second;
+      }
+      auto n = name(s->data);
+      if (std::find(c.reads.begin(), c.reads.end(), n) == c.reads.end()) {
+        c.reads.push_back(n);
+      }
+      auto r = reg();
+      emit(vm::LOADVAR, s, r, n);
+      return r;
+    }
+
+    void assign(const E* lhs, unsigned v, const E* e) {
+      if (lhs->etype != etsymbol) throw Decline();
+      const auto& s = static_cast<const Symbol*>(lhs)->data;
+      if (s[0] == '?') {
+        auto t = tmps.emplace(s, 0);
+        if (t.second) t.first->second = reg();
+        emit(vm::MOVE, e, t.first->second, v);
+      }
+      else {
+        emit(vm::STORE, e, name(s), v);
+      }
+    }
+
+    void loop(const While* w) {
+      auto top  = here();
+      auto cond = value(w->e1);
+      auto jmpf = emit(vm::JMPF, w->e1, cond);
+      effect(w->e2);
+      emit(vm::LOOP, w, top);
+      c.instrs[jmpf].b = here();
+    }
+  };
+
+
+  unsigned Compiler::value(const E* e) {
+    switch (e->etype) {
+    case etnull:
+      return constant(val::VNull());
+    case etbool:
+      return constant(val::Value(static_cast<const Bool*>(e)->data));
+    case etdouble:
+      return constant(static_cast<const Double*>(e)->data);
+    case etdtime:
+      return constant(val::Value(static_cast<const Dtime*>(e)->data));
+    case etinterval:
+      return constant(val::Value(static_cast<const Interval*>(e)->data));
+    case etstring:
+      return constant(val::Value(static_cast<const String*>(e)->data));
+    case etsymbol:
+      return symbol(static_cast<const Symbol*>(e));
+    case etunop: {
+      auto u = static_cast<const Unop*>(e);
+      auto v = value(u->e);
+      auto r = reg();
+      emit(vm::UNOP, e, r, v, 0, 0, int(u->op));
+      return r;
+    }
+    case etbinop: {
+      auto b = static_cast<const Binop*>(e);
+      auto left   = value(b->left);
+      auto right  = value(b->right);
+      auto attrib = value(b->attrib);
+      auto r = reg();
+      emit(vm::BINOP, e, r, left, right, attrib, int(b->op));
+      return r;
+    }
+    case etexprlist: {
+      auto el = static_cast<const El*>(e);
+      if (el->n == 0) return constant(val::VNull());
+      auto eln = el->begin;
+      for (unsigned i=1; i<el->n; ++i, eln = eln->next) {
+        effect(eln->e);
+      }
+      return value(eln->e);
+    }
+    case etleftassign: {
+      // as in the stepper, the value of an assignment is the assigned
+      // symbol read back:
+      auto la = static_cast<const LeftAssign*>(e);
+      assign(la->e1, value(la->e2), e);
+      return symbol(static_cast<const Symbol*>(la->e1));
+    }
+    case etifelse: {
+      auto ie = static_cast<const IfElse*>(e);
+      auto r    = reg();
+      auto jmpf = emit(vm::JMPF, ie->e1, value(ie->e1));
+      emit(vm::MOVE, ie->e2, r, value(ie->e2));
+      auto jmp  = emit(vm::JMP, e);
+      c.instrs[jmpf].b = here();
+      emit(vm::MOVE, ie->e3, r, value(ie->e3));
+      c.instrs[jmp].a = here();
+      return r;
+    }
+    case etwhile:
+      loop(static_cast<const While*>(e));
+      return constant(val::VNull());
+    default:
+      throw Decline();
+    }
+  }
+
+
+  void Compiler::effect(const E* e) {
+    switch (e->etype) {
+    case etnull: case etbool: case etdouble:
+    case etdtime: case etinterval: case etstring:
+      return;
+    case etexprlist: {
+      auto el = static_cast<const El*>(e);
+      for (auto eln = el->begin; eln; eln = eln->next) {
+        effect(eln->e);
+      }
+      return;
+    }
+    case etleftassign: {
+      auto la = static_cast<const LeftAssign*>(e);
+      assign(la->e1, value(la->e2), e);
+      return;
+    }
+    case etifelse: {
+      auto ie = static_cast<const IfElse*>(e);
+      auto jmpf = emit(vm::JMPF, ie->e1, value(ie->e1));
+      effect(ie->e2);
+      auto jmp  = emit(vm::JMP, e);
+      c.instrs[jmpf].b = here();
+      effect(ie->e3);
+      c.instrs[jmp].a = here();
+      return;
+    }
+    case etwhile:
+      loop(static_cast<const While*>(e));
+      return;
+    default:
+      value(e);                 // evaluated for its errors
+    }
+  }
+
+
+  /// A VM register. Scalars are kept unboxed in 's' and only boxed
+  /// into 'v' when they escape: when they are stored in the frame or
+  /// used by an operation that has no scalar specialisation.
+  struct Reg {
+    Reg() : boxed(false) { s.vt = val::vt_null; }
+
+    val::Value v;
+    funcs::Scalar s;
+    bool boxed;                 ///< is 'v' valid?
+
+    void set(val::Value&& v_p) {
+      v = std::move(v_p);
+      boxed = true;
+      funcs::unbox(v, s);
+    }
+
+    const val::Value& box() {
+      if (!boxed) {
+        v = funcs::box(s);
+        boxed = true;
+      }
+      return v;
+    }
+
+    bool isScalar() const { return s.vt != val::vt_null; }
+  };
+
+} // end anonymous namespace
+
+
+std::unique_ptr<vm::Code> vm::compile(const While* w) {
+  auto code = std::unique_ptr<Code>(new Code{{}, {}, {}, {}, 0});
+  try {
+    Compiler(*code).effect(w);
+  }
+  catch (Decline&) {
+    return nullptr;
+  }
+  return code;
+}
+
+
+bool vm::run(const Code& code, const interp::shpfrm& r) {
+  // a future can only come from a request, which is never compiled,
+  // so checking on entry is enough to guarantee that the loop will
+  // not need to block half-way through:
+  for (auto n : code.reads) {
+    try {
+      if (r->findR(code.names[n]).which() == val::vt_future) {
+        return false;
+      }
+    }
+    catch (std::out_of_range&) {
+      // reported when (and if) the symbol is actually read
+    }
+  }
+
+  std::vector<Reg> regs(code.nregs);
+  for (const auto& k : code.consts) {
+    regs[k.first].set(val::Value(k.second));
+  }
+
+  const auto& in = code.instrs;
+  size_t pc = 0;
+  while (pc < in.size()) {
+    const auto& i = in[pc++];
+    switch (i.opcode) {
+    case LOADVAR:
+      try {
+        regs[i.a].set(val::VPtr(r->findR(code.names[i.b])));
+      }
+      catch (std::out_of_range& e) {
+        throw interp::EvalException(e.what(), i.e->loc);
+      }
+      break;
+    case MOVE:
+      if (i.a != i.b) {
+        auto& dst = regs[i.a];
+        dst = regs[i.b];
+        if (dst.boxed) {
+          dst.v = val::gval(dst.v);
+          resetRef(dst.v);
+        }
+      }
+      break;
+    case UNOP: {
+      auto& dst = regs[i.a];
+      if (regs[i.b].isScalar() && funcs::evalunop(regs[i.b].s, i.op, dst.s)) {
+        dst.boxed = false;
+      }
+      else {
+        dst.set(funcs::evalunop(regs[i.b].box(), i.op));
+      }
+      break;
+    }
+    case BINOP: {
+      auto& dst = regs[i.a];
+      if (regs[i.b].isScalar() && regs[i.c].isScalar() &&
+          funcs::evalbinop(regs[i.b].s, regs[i.c].s, i.op, dst.s)) {
+        dst.boxed = false;
+      }
+      else {
+        auto e1 = regs[i.b].box();
+        resetRef(e1);           // never pass by reference when using infix notation
+        dst.set(funcs::evalbinop(std::move(e1), regs[i.c].box(), i.op, regs[i.d].box()));
+      }
+      break;
+    }
+    case STORE:
+      interp::assign(*r, code.names[i.a], val::Value(regs[i.b].box()), false);
+      break;
+    case JMP:
+      pc = i.a;
+      break;
+    case JMPF: {
+      auto& c = regs[i.a];
+      if (!(c.s.vt == val::vt_bool ? c.s.b : funcs::isTrue(val::gval(c.box())))) pc = i.b;
+      break;
+    }
+    case LOOP:
+      if (zcore::InterpCtx::sigint) return true;
+      pc = i.a;
+      break;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,83 @@
+// (C) 2016 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/// \file
+/// A compiler from ANF code to a compact register bytecode, and the
+/// VM that runs it. Only 'while' loops whose condition and body are
+/// made of assignments, atoms, 'if'/'else' and nested 'while' loops
+/// are compiled; anything else (function calls, requests, escapes,
+/// special assignments) is left to the CPS stepper in 'interp.cpp',
+/// which is also used whenever the VM declines to run a loop.
+
+
+#ifndef VM_HPP
+#define VM_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "valuevar.hpp"
+#include "env.hpp"
+
+
+namespace vm {
+
+  enum Opcode : uint8_t {
+    LOADVAR,                    ///< r[a] = frame lookup of names[b]
+    MOVE,                       ///< r[a] = r[b]
+    UNOP,                       ///< r[a] = op r[b]
+    BINOP,                      ///< r[a] = r[b] op r[c], with attribute r[d]
+    STORE,                      ///< frame assignment names[a] = r[b]
+    JMP,                        ///< jump to a
+    JMPF,                       ///< jump to b if r[a] is not true
+    LOOP                        ///< jump back to a, checking for interrupts
+  };
+
+  struct Instr {
+    Opcode   opcode;
+    int      op;                ///< operator for UNOP and BINOP
+    unsigned a, b, c, d;
+    const E* e;                 ///< source expression, for error locations
+  };
+
+  /// A compiled loop. The constant registers are preloaded before the
+  /// first instruction runs; ANF temporaries ('?'-prefixed symbols)
+  /// live in registers and never reach the frame.
+  struct Code {
+    std::vector<Instr>       instrs;
+    std::vector<std::pair<unsigned, val::Value>> consts; ///< register, value
+    std::vector<std::string> names;  ///< frame symbols read or assigned
+    std::vector<unsigned>    reads;  ///< indices in 'names' of the symbols read
+    unsigned nregs;
+  };
+
+  /// Compile the 'while' loop 'w'. Returns 'nullptr' if the loop
+  /// contains anything the VM does not handle.
+  std::unique_ptr<Code> compile(const While* w);
+
+  /// Run 'code' in frame 'r'. Returns false, without having evaluated
+  /// anything, if one of the symbols read by the code is a future; the
+  /// loop must then be run by the CPS stepper so that it can block on
+  /// the remote response.
+  bool run(const Code& code, const interp::shpfrm& r);
+
+} // end namespace vm
+
+
+#endif
@@ -96,7 +96,9 @@ arr::zts::zts(const zts& z,
               std::unique_ptr<AllocFactory>&& allocf_a,
               std::unique_ptr<AllocFactory>&& allocf_idx) 
   : a(std::make_shared<arr::Array<double>>(*z.a, std::move(allocf_a))),
-    idx(std::make_shared<arr::Array<Global::dtime>>(*z.idx, std::move(allocf_idx)))
+    idx(std::make_shared<arr::Array<Global::dtime>>(*z.idx, std::move(allocf_idx))),
+    reorderWindow(z.reorderWindow),
+    latePolicy(z.latePolicy)
 {
   // std::cout << "making a zts copy!" << std::endl;
   drop(*idx);
@@ -104,7 +106,7 @@ arr::zts::zts(const zts& z,
 }
 
 
-arr::zts::zts(zts&& z) {
+arr::zts::zts(zts&& z) : reorderWindow(z.reorderWindow), latePolicy(z.latePolicy) {
   swap(a, z.a);
   swap(idx, z.idx);
 }
@@ -114,10 +116,12 @@ arr::zts& arr::zts::append(const char* buf, size_t buflen, size_t& offset) {
   if (a->getdim().size() == 0) {
     throw std::out_of_range("append on null zts not implemented");        
   }
+  const auto n0 = a->getdim(0);
   idx->append(buf, buflen, offset);  // time array
-  if (!idx->isOrdered()) {
+  const bool ordered = idx->isOrdered();
+  if (!ordered && reorderWindow == Global::duration::zero()) {
     // stay in a coherent state:
-    idx->resize(0, a->getdim(0));    
+    idx->resize(0, n0);    
     idx->getcol(0).forceOrdered();   // use 'getcol', so 'forceOrdered()' 
                                      // doesn't also leak into array:
                                      // it's ugly enough like that
@@ -126,6 +130,42 @@ arr::zts& arr::zts::append(const char* buf, size_t buflen, size_t& offset) {
 
   try {
     a->append(buf+offset, buflen-offset, offset); // followed by a double array
+    if (!ordered) {
+      reorderTail(n0);
+    }
+  } 
+  catch (...) {
+    idx->resize(0, n0);    // stay in a coherent state!
+    idx->getcol(0).forceOrdered();
+    a->resize(0, n0);
+    throw;
+  }
+
+  return *this;
+}
+
+
+arr::zts& arr::zts::appendBatch(const std::vector<Global::bufptr_pair>& bufs, 
+                                std::vector<idx_type>& rows) {
+  if (a->getdim().size() == 0) {
+    throw std::out_of_range("append on null zts not implemented");        
+  }
+  std::vector<size_t> offsets;
+  idx->appendBatch(bufs, offsets, rows);  // time arrays
+  if (!idx->isOrdered()) {
+    // stay in a coherent state, see 'append':
+    idx->resize(0, a->getdim(0));    
+    idx->getcol(0).forceOrdered();
+    throw std::range_error("index not ascending");
+  }
+
+  std::vector<Global::bufptr_pair> data;    // each followed by a double array
+  for (size_t i=0; i<bufs.size(); ++i) {
+    data.emplace_back(bufs[i].first + offsets[i], bufs[i].second - offsets[i]);
+  }
+  std::vector<idx_type> arows;
+  try {
+    a->appendBatch(data, offsets, arows);
   } 
   catch (...) {
     idx->resize(0, a->getdim(0));    // stay in a coherent state!
@@ -142,40 +182,132 @@ arr::zts& arr::zts::appendVector(const char* buf, size_t buflen) {
     /// LLL, yes, we do!!!
     throw std::out_of_range("append vector on null zts not implemented");        
   }
-  auto i = Vector<Global::dtime>(const_cast<char*>(buf), buflen);
+  if (buflen < sizeof(RawVector<Global::dtime>)) {
+    throw std::out_of_range("invalid append buffer: too short");
+  }
+  const auto i = Vector<Global::dtime>(const_cast<char*>(buf), buflen);
   if (i.size() == 0) {
     throw std::out_of_range("arr::zts::appendVector: time vector has size 0");
   }  
-  for (auto& e : i) {
-    if (idx->size() && e <= (*idx)[idx->size()-1]) {
-      idx->resize(0, a->getdim(0));
-      throw std::out_of_range("append index not ascending");
-    }
-    idx->concat(e);
+  size_t idxsz = i.getBufferSize();
+  if (buflen < idxsz + sizeof(RawVector<double>)) {
+    throw std::out_of_range("missing data");
+  }
+
+  // check the whole incoming index in one pass before touching 'idx':
+  auto t = i.c_ptr();
+  const bool ordered = (idx->size() == 0 || t[0] > (*idx)[idx->size()-1]) &&
+    arr::isOrdered<Global::dtime, std::less<Global::dtime>>(t, i.size());
+  if (!ordered && reorderWindow == Global::duration::zero()) {
+    throw std::out_of_range("append index not ascending");
   }
   
-  size_t idxsz = sizeof(RawVector<Global::dtime>) + i.size()*sizeof(Global::dtime);
-  auto data = Vector<double>(const_cast<char*>(buf) + idxsz, buflen - idxsz);
+  const auto data = Vector<double>(const_cast<char*>(buf) + idxsz, buflen - idxsz);
   if (data.size() % i.size()) {
-    idx->resize(0, a->getdim(0));
     throw std::out_of_range("mismatch between index and data");        
   }
   arr::idx_type nrows = data.size() / a->ncols();
   if (nrows != i.size()) { 
-    idx->resize(0, a->getdim(0));
     throw std::out_of_range("size mismatch between idx and array");        
   }
+
+  const auto n0 = a->getdim(0);
+  idx->appendVector(buf, idxsz);  // a single block copy
   try {
     a->appendVector(const_cast<char*>(buf) + idxsz, buflen - idxsz);
+    if (!ordered) {
+      reorderTail(n0);
+    }
   }
   catch (...) {
-    idx->resize(0, a->getdim(0));
+    idx->resize(0, n0);
+    idx->getcol(0).forceOrdered();
+    a->resize(0, n0);
     throw;
   }
   return *this;
 }
 
 
+void arr::zts::setReorder(Global::duration window, LatePolicy late) {
+  if (window < Global::duration::zero()) {
+    throw std::out_of_range("reorder window cannot be negative");
+  }
+  reorderWindow = window;
+  latePolicy = late;
+}
+
+
+void arr::zts::reorderTail(idx_type n0) {
+  auto& tcol = idx->getcol(0);
+  const auto t = static_cast<const Vector<Global::dtime>&>(tcol).c_ptr();
+  const idx_type n = tcol.size();
+
+  // the new rows in time order:
+  std::vector<idx_type> in(n - n0);
+  std::iota(in.begin(), in.end(), n0);
+  std::stable_sort(in.begin(), in.end(), [t](idx_type i, idx_type j) { return t[i] < t[j]; });
+
+  // rows before 'start' are late; the others are merged with the
+  // existing rows from 's' on:
+  const auto start = n0 ? t[n0-1] - reorderWindow : Global::dtime::min();
+  auto first = std::find_if(in.begin(), in.end(), [t, start](idx_type j) { return t[j] >= start; });
+  const idx_type s = first == in.end() ? n0 : std::lower_bound(t, t + n0, t[*first]) - t;
+  std::vector<idx_type> order;  // source row of each row from 's' on
+  order.reserve(n - s);
+  size_t nlate = first - in.begin();
+  idx_type i = s;
+  for (auto j = first; j != in.end(); ++j) {
+    while (i < n0 && t[i] < t[*j]) {
+      order.push_back(i++);
+    }
+    if ((i < n0 && t[i] == t[*j]) || (order.size() && t[order.back()] == t[*j])) {
+      ++nlate;                  // a time can't be there twice
+      continue;
+    }
+    order.push_back(*j);
+  }
+  while (i < n0) {
+    order.push_back(i++);
+  }
+  if (nlate && latePolicy == LATE_REJECT) {
+    throw std::range_error("index not ascending beyond reorder window");
+  }
+
+  // permute the tail of each column, writing only what moves:
+  auto permute = [s, &order](auto& col) {
+    using T = typename std::remove_reference<decltype(col)>::type::value_type;
+    const auto p = static_cast<const std::remove_reference_t<decltype(col)>&>(col).c_ptr();
+    std::vector<T> tmp(order.size());
+    for (size_t k=0; k<order.size(); ++k) {
+      tmp[k] = p[order[k]];
+    }
+    for (size_t k=0; k<order.size(); ++k) {
+      if (order[k] != s + k) {
+        col[s + k] = tmp[k];
+      }
+    }
+  };
+  permute(tcol);
+  for (idx_type j=0; j<a->ncols(); ++j) {
+    auto& col = a->getcol(j);
+    permute(col);
+    if (col.isOrdered() && order.size()) { // the rows before 's' are still in order
+      const auto p = static_cast<const Vector<double>&>(col).c_ptr();
+      col.setOrdered((s == 0 || p[s-1] < p[s]) && 
+                     arr::isOrdered<double, std::less<double>>(p + s, order.size()));
+    }
+  }
+
+  const idx_type m = s + order.size();
+  if (m < n) {                  // late rows were dropped
+    idx->resize(0, m);
+    a->resize(0, m);
+  }
+  tcol.forceOrdered();
+}
+
+
 Global::buflen_pair arr::zts::to_buffer(size_t offset) const {
   // get the time index vector encoded length:
   size_t totalsz = offset + idx->getBufferSize() + a->getBufferSize();
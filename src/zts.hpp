@@ -81,10 +81,30 @@ namespace arr {
     inline const Vector<double>& getcol(idx_type i) const { return a->getcol(i); }
     inline fsys::path getAllocfDirname() const { return a->allocf->getDirname(); }
     inline void msync(bool async) const { a->msync(async); idx->msync(async); }
+    inline void addMemUsage(MemUsage& u) const { a->addMemUsage(u); idx->addMemUsage(u); }
     
     zts& append(const char* buf, size_t buflen, size_t& offset);
+    /// Append the time series encoded in 'bufs' with a single
+    /// ordering check, growing the columns once. Either all of them
+    /// are appended or none is. 'rows' receives the number of rows of
+    /// each. The reorder window doesn't apply here: a batch that isn't
+    /// ascending throws, and its appends can then be made one by one.
+    zts& appendBatch(const std::vector<Global::bufptr_pair>& bufs, std::vector<idx_type>& rows);
     zts& appendVector(const char* buf, size_t buflen);
 
+    /// What happens to the rows of an append that can't be put in
+    /// order, see 'setReorder'.
+    enum LatePolicy { LATE_REJECT, LATE_DROP };
+    /// Let appends be out of order by up to 'window' behind the last
+    /// row: their rows are merged in order into the tail. Rows further
+    /// behind, or whose time is already present, either make the whole
+    /// append fail (LATE_REJECT) or are discarded (LATE_DROP). A zero
+    /// window, the default, rejects any append that isn't ascending.
+    /// The setting is not persisted.
+    void setReorder(Global::duration window, LatePolicy late);
+    inline Global::duration getReorderWindow() const { return reorderWindow; }
+    inline LatePolicy getLatePolicy() const { return latePolicy; }
+
     Global::buflen_pair to_buffer(size_t offset=0) const;
       
     inline zts& addprefix(const string& prefix, idx_type d) { a->addprefix(prefix, d); return *this; }
@@ -143,6 +163,13 @@ namespace arr {
     // can we please get rid of the mutable here? LLL
     mutable std::shared_ptr<Array<double>> a;
     mutable std::shared_ptr<Array<Global::dtime>> idx;
+
+    Global::duration reorderWindow = Global::duration::zero();
+    LatePolicy latePolicy = LATE_REJECT;
+
+    /// Put back in order the rows from 'n0' on, which were just
+    /// appended and aren't ascending; see 'setReorder'.
+    void reorderTail(idx_type n0);
   };
     
   
@@ -48,6 +48,13 @@ zlog::Logger lg;
 cfg::CfgMap cfg::cfgmap;
 
 
+static void* executeMsyncFlusher(void* args_p) {
+  auto args = static_cast<std::pair<std::chrono::milliseconds, volatile bool&>*>(args_p);
+  arr::MsyncFlusher::instance().run(args->first, args->second);
+  return nullptr;
+}
+
+
 static void* executeNetHandler(void* args_p) {
   auto args = static_cast<std::pair<net::NetHandler&, volatile bool&>*>(args_p);
   auto& c = static_cast<net::NetHandler&>(args->first);
@@ -76,6 +83,7 @@ static void supersedeWithCmdLine(const gengetopt_args_info& args_info)
   // port to 0 since we won't serve incoming connections:
   if (args_info.eval_mode_counter) {
     cfg::cfgmap.set("port", 0L);
+    cfg::cfgmap.set("net.unix.path", ""s);
   }    
   else if (args_info.port_given) {
     cfg::cfgmap.set("port", static_cast<int64_t>(args_info.port_arg));
@@ -184,6 +192,12 @@ int main(int argc, char *argv[]) {
       lg.setLevel(zlog::from_string(get<std::string>(cfg::cfgmap.get("log.level"))));
       lg.log(zlog::SV_INFO, "ztsdb started");
 
+      arr::HugePages::instance().configure
+        (arr::HugePages::from_string(get<std::string>(cfg::cfgmap.get("hugepages"))),
+         static_cast<size_t>(get<int64_t>(cfg::cfgmap.get("hugepages.threshold"))));
+      arr::ColumnCache::instance().configure
+        (static_cast<size_t>(get<int64_t>(cfg::cfgmap.get("columns.mapped.max"))));
+
       auto lport = static_cast<int>(get<int64_t>(cfg::cfgmap.get("port")));
       auto address = get<std::string>(cfg::cfgmap.get("address"));
 
@@ -202,7 +216,9 @@ int main(int argc, char *argv[]) {
     
       net::NetHandler com(address, lport, data_com_ir, sig_com_ir,
                           static_cast<size_t>(get<int64_t>(cfg::cfgmap.get("data.q.size"))),
-                          static_cast<size_t>(get<int64_t>(cfg::cfgmap.get("sig.q.size"))));
+                          static_cast<size_t>(get<int64_t>(cfg::cfgmap.get("sig.q.size"))),
+                          static_cast<unsigned>(std::max(get<int64_t>(cfg::cfgmap.get("net.threads")),
+                                                         int64_t(1))));
 
       // load predefined functions in global env:
       core::loadBuiltinFunctions(base.get());
@@ -224,7 +240,7 @@ int main(int argc, char *argv[]) {
         throw std::system_error(std::error_code(errno, std::system_category()), "pthread_sigmask");
       }
 
-      // run the TCP comm thread:
+      // run the TCP comm threads:
       volatile bool stop = 0;
       auto args = std::pair<net::NetHandler&, volatile bool&>{com, stop};
       pthread_t t1;
@@ -234,6 +250,15 @@ int main(int argc, char *argv[]) {
       if (!args_info.eval_mode_counter) {
         cmdline_parser_print_version();
 
+        // run the background msync thread:
+        auto flusherms = get<int64_t>(cfg::cfgmap.get("msync.flusher.ms"));
+        auto flusherargs = std::pair<std::chrono::milliseconds, volatile bool&>{
+          std::chrono::milliseconds(flusherms), stop};
+        pthread_t t2;
+        if (flusherms > 0) {
+          pthread_create(&t2, NULL, executeMsyncFlusher, &flusherargs);
+        }
+
         zcore::MsgHandler ir(com, global, data_com_ir, sig_com_ir, STDIN_FILENO, false, initcode);
         try {
           ir.run();           // run the interpreter
@@ -241,6 +266,9 @@ int main(int argc, char *argv[]) {
         catch (const Global::QuitException& e) {
           stop = true;
           pthread_join(t1, nullptr);
+          if (flusherms > 0) {
+            pthread_join(t2, nullptr);
+          }
           lg.log(zlog::SV_INFO, "ztsdb quit");
           cmdline_parser_free(&args_info);
           return e.status;
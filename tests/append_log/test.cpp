@@ -0,0 +1,149 @@
+// -*- compile-command: "make -j -k test" -*-
+
+// Copyright (C) 2017 Leonardo Silvestri
+//
+// This file is part of ztsdb.
+//
+// ztsdb is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ztsdb is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ztsdb.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <crpcut.hpp>
+#include <stdio.h>
+#include <sys/stat.h>
+#include "append_log.hpp"
+
+
+using namespace std;
+
+
+static const char* LOGNAME = "./append_log_test.wal";
+
+struct Record {
+  Global::MsgType mt;
+  string payload;
+  uint64_t prelen;
+};
+
+static vector<Record> readAll(zcore::AppendLog& log) {
+  vector<Record> res;
+  log.replay([&res](Global::MsgType mt, const char* buf, size_t len, uint64_t prelen) {
+      res.push_back(Record{mt, string(buf, len), prelen});
+    });
+  return res;
+}
+
+static size_t fileSize(const char* name) {
+  struct stat st;
+  return stat(name, &st) == 0 ? st.st_size : 0;
+}
+
+
+TEST(append_log_replay) {
+  remove(LOGNAME);
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    log.append(Global::MsgType::APPEND, "abc", 3, 10);
+    log.append(Global::MsgType::APPEND_VECTOR, "defghijkl", 9, 11);
+    // written right away, synced at the group commit:
+    ASSERT_TRUE(fileSize(LOGNAME) == log.size());
+  } // the destructor syncs the unsynced records
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    auto r = readAll(log);
+    ASSERT_TRUE(r.size() == 2);
+    ASSERT_TRUE(r[0].mt == Global::MsgType::APPEND);
+    ASSERT_TRUE(r[0].payload == "abc");
+    ASSERT_TRUE(r[0].prelen == 10);
+    ASSERT_TRUE(r[1].mt == Global::MsgType::APPEND_VECTOR);
+    ASSERT_TRUE(r[1].payload == "defghijkl");
+    ASSERT_TRUE(r[1].prelen == 11);
+    log.truncate();
+    ASSERT_TRUE(log.size() == 0);
+  }
+  ASSERT_TRUE(fileSize(LOGNAME) == 0);
+  ASSERT_TRUE(remove(LOGNAME) == 0);
+}
+
+TEST(append_log_group_commit_on_size) {
+  remove(LOGNAME);
+  zcore::AppendLog log(LOGNAME, 64, std::chrono::milliseconds(10000));
+  log.append(Global::MsgType::APPEND, "abc", 3, 0);
+  ASSERT_TRUE(fileSize(LOGNAME) == log.size());
+  log.append(Global::MsgType::APPEND, "abcdefghijklmnopqrstuvwxyz", 26, 1);
+  ASSERT_TRUE(fileSize(LOGNAME) == log.size());
+  ASSERT_TRUE(!log.syncDue());
+  ASSERT_TRUE(remove(LOGNAME) == 0);
+}
+
+TEST(append_log_torn_tail) {
+  remove(LOGNAME);
+  size_t goodsz;
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    log.append(Global::MsgType::APPEND, "abc", 3, 0);
+    log.flush(true);
+    goodsz = log.size();
+    log.append(Global::MsgType::APPEND, "defghijkl", 9, 1);
+  }
+  // simulate a crash in the middle of the second record:
+  ASSERT_TRUE(truncate(LOGNAME, fileSize(LOGNAME) - 4) == 0);
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    auto r = readAll(log);
+    ASSERT_TRUE(r.size() == 1);
+    ASSERT_TRUE(r[0].payload == "abc");
+    ASSERT_TRUE(log.size() == goodsz);
+    // new records follow the last valid one:
+    log.append(Global::MsgType::APPEND, "xyz", 3, 1);
+  }
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    auto r = readAll(log);
+    ASSERT_TRUE(r.size() == 2);
+    ASSERT_TRUE(r[1].payload == "xyz");
+  }
+  ASSERT_TRUE(remove(LOGNAME) == 0);
+}
+
+TEST(append_log_corrupt_length) {
+  remove(LOGNAME);
+  size_t goodsz;
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    log.append(Global::MsgType::APPEND, "abc", 3, 0);
+    goodsz = log.size();
+    log.append(Global::MsgType::APPEND, "defghijkl", 9, 1);
+  }
+  // a length whose padding wraps around to a small value:
+  const uint64_t len = ~static_cast<uint64_t>(0) - 3;
+  int fd = open(LOGNAME, O_WRONLY);
+  ASSERT_TRUE(fd != -1);
+  ASSERT_TRUE(pwrite(fd, &len, sizeof(len),
+                     goodsz + offsetof(zcore::AppendLog::RecordHeader, len)) == sizeof(len));
+  close(fd);
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    auto r = readAll(log);
+    ASSERT_TRUE(r.size() == 1);
+    ASSERT_TRUE(r[0].payload == "abc");
+    ASSERT_TRUE(log.size() == goodsz);
+  }
+  ASSERT_TRUE(remove(LOGNAME) == 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+  return crpcut::run(argc, argv);
+}
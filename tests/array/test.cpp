@@ -1543,6 +1543,48 @@ TEST(array_append_multiple_rows) {
   auto res = a2.append(buffer, sz, offset);
   ASSERT_TRUE(expected == res);
 }
+TEST(array_append_batch) {
+  auto v = arr::Vector<double>(27);
+  std::iota(v.begin(), v.end(), 0);
+  auto a1 = arr::Array<double>({3,3,3}, v, {{"1","2","3"}, {"i","ii","iii"}, {"I","II","III"}});
+  auto a2 = a1;
+  auto b1 = arr::Array<double>({1,3,3}, arr::Vector<double>{100,101,102,103,104,105,106,107,108});
+  auto b2 = arr::Array<double>({3,3,3}, v);
+  char buffer1[1024], buffer2[1024];
+  auto sz1 = b1.to_buffer(buffer1);
+  auto sz2 = b2.to_buffer(buffer2);
+  auto expected = a1.rbind(b1).rbind(b2);
+  std::vector<size_t> offsets;
+  std::vector<arr::idx_type> rows;
+  auto res = a2.appendBatch({{buffer1, sz1}, {buffer2, sz2}}, offsets, rows);
+  ASSERT_TRUE(expected == res);
+  ASSERT_TRUE(offsets == std::vector<size_t>({sz1, sz2}));
+  ASSERT_TRUE(rows == std::vector<arr::idx_type>({1, 3}));
+}
+TEST(array_append_batch_all_or_nothing) {
+  auto v = arr::Vector<double>(27);
+  std::iota(v.begin(), v.end(), 0);
+  auto a1 = arr::Array<double>({3,3,3}, v);
+  auto a2 = a1;
+  auto b1 = arr::Array<double>({1,3,3}, arr::Vector<double>{100,101,102,103,104,105,106,107,108});
+  auto b2 = arr::Array<double>({1,2,3}, arr::Vector<double>{100,101,102,103,104,105});
+  char buffer1[1024], buffer2[1024];
+  auto sz1 = b1.to_buffer(buffer1);
+  auto sz2 = b2.to_buffer(buffer2);
+  std::vector<size_t> offsets;
+  std::vector<arr::idx_type> rows;
+  ASSERT_THROW(a2.appendBatch({{buffer1, sz1}, {buffer2, sz2}}, offsets, rows), std::out_of_range);
+  ASSERT_TRUE(a1 == a2);
+}
+TEST(array_append_vector) {
+  auto a1 = arr::Array<double>({2,2}, arr::Vector<double>{1,2,3,4});
+  const arr::Vector<double> d{5,6,7,8,9,10};
+  char buffer[1024];
+  auto sz = d.to_buffer(buffer);
+  a1.appendVector(buffer, sz);
+  auto expected = arr::Array<double>({5,2}, arr::Vector<double>{1,2,5,6,7,3,4,8,9,10});
+  ASSERT_TRUE(expected == a1);
+}
 DISABLED_TEST(array_append_to_null_array) {
   auto a1 = arr::Array<double>({}, arr::Vector<double>{});
   auto v = arr::Vector<double>(27);
@@ -1726,6 +1768,71 @@ TEST(array_mmap_mod) {
   ASSERT_TRUE(remove("./array_mmap_mod/names1")==0); 
   ASSERT_TRUE(rmdir("./array_mmap_mod/") == 0);  
 }
+TEST(array_mmap_lazy_columns) {
+  cleandir("./array_mmap_lazy/");
+  {
+    arr::Array<double> a(
+      {2,3},
+      {1,2,3,4,5,6},
+      {{"un","deux"}, {"one", "two", "three"}},
+      std::make_unique<arr::MmapAllocFactory>("./array_mmap_lazy", false));
+  } // a is being deleted here
+  auto& cache = arr::ColumnCache::instance();
+  const auto budget = cache.getBudget();
+  {
+    cache.configure(1);
+    auto a = arr::Array<double>(std::make_unique<arr::MmapAllocFactory>("./array_mmap_lazy", true));
+    ASSERT_TRUE(a.v.isLazy());
+    ASSERT_TRUE(!a.v.isMapped(0) && !a.v.isMapped(1) && !a.v.isMapped(2));
+    ASSERT_TRUE((a[{1,2}] == 6));
+    ASSERT_TRUE(!a.v.isMapped(0) && !a.v.isMapped(1) && a.v.isMapped(2));
+    cache.trim();
+    ASSERT_TRUE((a[{0,0}] == 1));
+    ASSERT_TRUE(a.v.isMapped(0) && a.v.isMapped(2));
+    cache.trim();               // column 2 is the least recently used
+    ASSERT_TRUE(a.v.isMapped(0) && !a.v.isMapped(2));
+    auto b = arr::Array<double>(
+      {2,3},
+      {1,2,3,4,5,6},
+      {{"un","deux"}, {"one", "two", "three"}});
+    ASSERT_TRUE(a == b);        // remaps what is needed
+    cache.configure(budget);
+  }
+  ASSERT_TRUE(remove("./array_mmap_lazy/0")==0);
+  ASSERT_TRUE(remove("./array_mmap_lazy/1")==0);
+  ASSERT_TRUE(remove("./array_mmap_lazy/2")==0);
+  ASSERT_TRUE(remove("./array_mmap_lazy/dim")==0);
+  ASSERT_TRUE(remove("./array_mmap_lazy/names0")==0);
+  ASSERT_TRUE(remove("./array_mmap_lazy/names1")==0);
+  ASSERT_TRUE(rmdir("./array_mmap_lazy/") == 0);
+}
+TEST(array_mmap_lazy_columns_abind) {
+  cleandir("./array_mmap_lazy_abind/");
+  {
+    arr::Array<double> a(
+      {2,2,2},
+      arr::Vector<double>{1,2,3,4,5,6,7,8},
+      vector<arr::Vector<arr::zstring>>{{}, {}, {}},
+      std::make_unique<arr::MmapAllocFactory>("./array_mmap_lazy_abind", false));
+  }
+  auto& cache = arr::ColumnCache::instance();
+  const auto budget = cache.getBudget();
+  {
+    cache.configure(1);
+    auto a = arr::Array<double>(std::make_unique<arr::MmapAllocFactory>("./array_mmap_lazy_abind", true));
+    ASSERT_TRUE((a[{0,0,1}] == 5));
+    // binding along the second dimension moves the columns around:
+    auto u = arr::Array<double>({2,1,2}, arr::Vector<double>{9,10,11,12});
+    a.abind(u, 1);
+    auto b = arr::Array<double>({2,3,2}, arr::Vector<double>{1,2,3,4,9,10,5,6,7,8,11,12});
+    cache.trim();
+    ASSERT_TRUE(a == b);
+    cache.trim();               // remapped columns come from the right files
+    ASSERT_TRUE(a == b);
+    cache.configure(budget);
+  }
+  ASSERT_TRUE(cleandir("./array_mmap_lazy_abind/") == 0);
+}
 // test mmap array append:
 // LLL
 // member apply:
@@ -25,6 +25,7 @@
 #include <thread>
 #include <pthread.h>
 #include <sys/eventfd.h>
+#include <boost/filesystem.hpp>
 #undef INFO
 #include "../../src/net_handler.hpp"
 #include "encode.hpp"
@@ -204,6 +205,26 @@ TEST(comm_long_vector_double) {
   auto v = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{len}, data);
   ASSERT_TRUE(getValue("1:" + std::to_string(len)) == v);
 }
+TEST(comm_long_matrix_double) {
+  // columns sent straight from their storage over several chunks:
+  const unsigned nrow = 200*1000, ncol = 3;
+  auto data = arr::Vector<double>(nrow*ncol);
+  std::iota(data.begin(), data.end(), 1);
+  auto v = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{nrow, ncol}, data);
+  ASSERT_TRUE(getValue("matrix(1:" + std::to_string(nrow*ncol) + ", nrow=" + std::to_string(nrow) +
+                       ", ncol=" + std::to_string(ncol) + ")") == v);
+}
+TEST(comm_long_matrix_double_file) {
+  // columns of a persistent array sent from its files with sendfile:
+  const unsigned nrow = 200*1000, ncol = 3;
+  auto data = arr::Vector<double>(nrow*ncol);
+  std::iota(data.begin(), data.end(), 1);
+  auto v = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{nrow, ncol}, data);
+  boost::filesystem::remove_all("./comm_matrix_file");
+  ASSERT_TRUE(getValue("matrix(1:" + std::to_string(nrow*ncol) + ", nrow=" + std::to_string(nrow) +
+                       ", ncol=" + std::to_string(ncol) + ", file=\"./comm_matrix_file\")") == v);
+  boost::filesystem::remove_all("./comm_matrix_file");
+}
 
 
 int main(int argc, char *argv[])
@@ -45,6 +45,7 @@
 #include "zcpp.hpp"
 #include "zcpp_stdlib.hpp"
 #include "zts.hpp"
+#include "append_log.hpp"
 #include "../utils.hpp"
 
 
@@ -711,6 +712,200 @@ TEST(comm_zts_appendVector_empty_message) {
                "arr::zts::appendVector: time vector has size 0");
 }
 
+// log the append message 'msg' as if it had been received when its
+// target had length 'prelen':
+static void logAppendMsg(zcore::AppendLog& log, const Global::buflen_pair& msg, uint64_t prelen) {
+  const auto off = net::INIT_OFFSET + sizeof(uint64_t); // skip the message type
+  Global::MsgType mt;
+  memcpy(&mt, msg.first.get() + net::INIT_OFFSET, sizeof(mt));
+  mt = static_cast<Global::MsgType>(ntoh64(static_cast<uint64_t>(mt)));
+  log.append(mt, msg.first.get() + off, msg.second - off, prelen);
+}
+
+TEST(comm_append_log_replay) {
+  static const char* LOGNAME = "./comm_append_test.wal";
+  remove(LOGNAME);
+  auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
+  auto dt2 = tz::dtime_from_string("2015-03-09 06:38:02 America/New_York", tzones);
+  auto dt3 = tz::dtime_from_string("2015-03-09 06:38:03 America/New_York", tzones);
+  auto dt4 = tz::dtime_from_string("2015-03-09 06:38:04 America/New_York", tzones);
+  auto dt5 = tz::dtime_from_string("2015-03-09 06:38:05 America/New_York", tzones);
+  {
+    zcore::AppendLog log(LOGNAME, 1 << 20, std::chrono::milliseconds(10000));
+    logAppendMsg(log, arr::make_append_msg({"a"s}, arr::Array<double>({2,1}, Vector<double>{4,5})), 3);
+    logAppendMsg(log, arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{6})), 5);
+    // appends before this one are missing:
+    logAppendMsg(log, arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{7})), 10);
+    const arr::zts az(arr::Array<Global::dtime>({dt4,dt5}), arr::Array<double>({2,1}, Vector<double>{4,5}));
+    logAppendMsg(log, arr::make_append_msg({"z"s}, az), 3);
+  }
+
+  // the targets hold the first row of the first append of each,
+  // which must be undone before the append is applied again:
+  cfg::cfgmap.set("wal.path", std::string(LOGNAME));
+  core::loadBuiltinFunctions(global.get());
+  int data_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  int sig_fd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  ASSERT_TRUE(data_fd != -1 && sig_fd != -1);
+  auto com = new net::NetHandler("", PORT + 1, data_fd, sig_fd);
+  auto ir = new zcore::MsgHandler(*com, global, data_fd, sig_fd, -1, false,
+                                  "a <<- matrix(c(1,2,3,99), 4, 1); "
+                                  "z <<- zts(c(|.2015-03-09 06:38:01 America/New_York.|, "
+                                  "            |.2015-03-09 06:38:02 America/New_York.|, "
+                                  "            |.2015-03-09 06:38:03 America/New_York.|, "
+                                  "            |.2015-03-09 06:38:04 America/New_York.|), "
+                                  "          matrix(c(1,2,3,99), 4, 1))\n");
+  auto a = ir->getLocalCtx().r->find("a");
+  auto z = ir->getLocalCtx().r->find("z");
+  delete ir;
+  delete com;
+  cfg::cfgmap.set("wal.path", ""s);
+  ASSERT_TRUE(remove(LOGNAME) == 0);
+
+  const auto ea = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{6,1}, Vector<double>{1,2,3,4,5,6});
+  ASSERT_TRUE(a == ea);
+  const auto ez = make_cow<arr::zts>(false,
+                                     Vector<Global::dtime>{dt1,dt2,dt3,dt4,dt5},
+                                     arr::Array<double>({5,1}, Vector<double>{1,2,3,4,5}));
+  ASSERT_TRUE(z == ez);
+}
+
+/// A database whose message handler only starts running on 'start', so
+/// that the append messages sent to it before are all taken in the same
+/// wake up, where consecutive appends to the same target are applied
+/// together.
+struct BatchedPeer {
+  BatchedPeer(const std::string& code) {
+    core::loadBuiltinFunctions(global.get());
+    data_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    sig_fd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (data_fd == -1 || sig_fd == -1) {
+      throw std::system_error(std::error_code(errno, std::system_category()), "eventfd");
+    }
+    com = new net::NetHandler("", PORT + 2, data_fd, sig_fd);
+    ir  = new zcore::MsgHandler(*com, global, data_fd, sig_fd, -1, false, code);
+    args = std::make_unique<tpl_t>(*com, stop);
+    pthread_create(&tnet, NULL, executeNet, args.get());
+
+    sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(PORT + 2);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+      throw std::system_error(std::error_code(errno, std::system_category()), "socket");
+    }
+    for (unsigned i=0; connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1; ++i) {
+      if (i == 10) {
+        throw std::system_error(std::error_code(errno, std::system_category()), "connect");
+      }
+      pause();
+    }
+  }
+
+  void send(const Global::buflen_pair& msg) {
+    if (write(fd, msg.first.get(), msg.second) < 0) {
+      throw std::system_error(std::error_code(errno, std::system_category()), "write");
+    }
+  }
+
+  // let the network queue what was sent, then run the handler on it:
+  void start() {
+    pause();
+    pthread_create(&tir, NULL, executeMsgHandler, ir);
+    pause();
+  }
+
+  val::Value get(const std::string& varname) const { return ir->getLocalCtx().r->find(varname); }
+
+  ~BatchedPeer() {
+    stop = true;
+    pthread_cancel(tnet);
+    pthread_cancel(tir);
+    delete ir;
+    delete com;
+    close(fd);                  // after the cancel, see 'cancelAndReturnResult'
+  }
+
+  static void pause() {
+    const timespec pausetime{0, 100000000L};
+    nanosleep(&pausetime, NULL);
+  }
+
+  int data_fd, sig_fd, fd;
+  net::NetHandler* com;
+  zcore::MsgHandler* ir;
+  volatile bool stop = false;
+  std::unique_ptr<tpl_t> args;
+  pthread_t tnet, tir;
+};
+
+TEST(comm_append_batch_same_target) {
+  BatchedPeer p("a <<- matrix(c(1,2,3), 3, 1)\n");
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{4})));
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({2,1}, Vector<double>{5,6})));
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{7})));
+  p.start();
+
+  const auto ea = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{7,1},
+                                         Vector<double>{1,2,3,4,5,6,7});
+  ASSERT_TRUE(p.get("a") == ea);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppend == 3);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppendBatch == 1);
+}
+TEST(comm_append_batch_split_on_target) {
+  BatchedPeer p("a <<- matrix(c(1,2), 2, 1); b <<- matrix(c(10,20), 2, 1)\n");
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{3})));
+  p.send(arr::make_append_msg({"b"s}, arr::Array<double>({1,1}, Vector<double>{30})));
+  p.send(arr::make_append_msg({"b"s}, arr::Array<double>({1,1}, Vector<double>{40})));
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{4})));
+  p.start();
+
+  const auto ea = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{4,1},
+                                         Vector<double>{1,2,3,4});
+  const auto eb = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{4,1},
+                                         Vector<double>{10,20,30,40});
+  ASSERT_TRUE(p.get("a") == ea);
+  ASSERT_TRUE(p.get("b") == eb);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppend == 4);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppendBatch == 3);
+}
+TEST(comm_append_batch_split_on_type) {
+  BatchedPeer p("a <<- matrix(c(1,2), 2, 1)\n");
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{3})));
+  p.send(arr::make_append_msg({"a"s}, Vector<double>{4}));
+  p.send(arr::make_append_msg({"a"s}, Vector<double>{5}));
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{6})));
+  p.start();
+
+  const auto ea = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{6,1},
+                                         Vector<double>{1,2,3,4,5,6});
+  ASSERT_TRUE(p.get("a") == ea);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppend == 2);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppendVector == 2);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppendBatch == 3);
+}
+TEST(comm_append_batch_flushed_at_end) {
+  BatchedPeer p("a <<- matrix(c(1,2), 2, 1)\n");
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{3})));
+  p.start();
+
+  // applied although no message followed it in its wake up:
+  const auto ea3 = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{3,1},
+                                          Vector<double>{1,2,3});
+  ASSERT_TRUE(p.get("a") == ea3);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppendBatch == 1);
+
+  // and not held back to join the appends of the next wake up:
+  p.send(arr::make_append_msg({"a"s}, arr::Array<double>({1,1}, Vector<double>{4})));
+  BatchedPeer::pause();
+  const auto ea4 = make_cow<val::VArrayD>(false, Vector<arr::idx_type>{4,1},
+                                          Vector<double>{1,2,3,4});
+  ASSERT_TRUE(p.get("a") == ea4);
+  ASSERT_TRUE(p.ir->getMsgStats().nbAppendBatch == 2);
+}
+
 int main(int argc, char *argv[])
 {
   return crpcut::run(argc, argv);
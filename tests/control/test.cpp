@@ -59,6 +59,27 @@ TEST(control_while_nested) {
                     "}\n");
   ASSERT_TRUE(eval(eout) == val::Value(val::VNull()));  
 }
+TEST(control_while_ifelse_in_body) {
+  auto eout = parse("s <- 0; i <- 0\n"
+                    "while (i < 10) { if (i > 4) s <- s + i else s <- s - 1; i <- i + 1 }\n"
+                    "s\n");
+  ASSERT_TRUE(eval(eout) == val::make_array(30.0));
+}
+TEST(control_while_ifelse_value) {
+  auto eout = parse("n <- 0; i <- 0\n"
+                    "while (i < 3) { i <- i + 1; n <- n + if (i == 2) 10 else 1 }\n"
+                    "n\n");
+  ASSERT_TRUE(eval(eout) == val::make_array(12.0));
+}
+TEST(control_while_scalar_becomes_vector) {
+  auto eout = parse("x <- 0; i <- 0; while (i < 3) { x <- x + c(1.0, 1.0); i <- i + 1 }; x\n");
+  auto a = arr::Array<double>({2}, arr::Vector<double>{3,3});
+  ASSERT_TRUE(eval(eout) == make_cow<val::VArrayD>(false, a));
+}
+TEST(control_while_unknown_symbol) {
+  auto eout = parse("a <- 1.0; while (a < 4) a <- zz \n");
+  ASSERT_THROW(eval(eout), std::out_of_range, "object 'zz' not found");
+}
 TEST(control_if_cond_bool_true) {
   auto eout = parse("if (TRUE) 1.0 \n");
   ASSERT_TRUE(eval(eout) == val::make_array(1.0));  
@@ -120,6 +120,16 @@ TEST(cow_ptr_star_const) {
   ASSERT_THROW((*a).a = 2, std::range_error, "cannot modify const object");
   ASSERT_THROW(a->a = 2, std::range_error, "cannot modify const object");
 }
+TEST(cow_ptr_star_readonly) {
+  int check_ab = 0;
+  auto a = arr::make_cow<A>(arr::READONLY, 3, check_ab);
+  auto b = a;
+  ASSERT_TRUE(b.isReadOnly());
+  ASSERT_TRUE(a->a == 3);       // reading is fine
+  // neither the single reference nor a copy can be modified:
+  ASSERT_THROW((*a).a = 2, std::range_error, "cannot modify read-only object");
+  ASSERT_THROW(b->a = 2, std::range_error, "cannot modify read-only object");
+}
 TEST(cow_ptr_last) {
   // verify last does not increase use_count
   int check_ab = 0;
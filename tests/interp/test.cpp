@@ -69,6 +69,19 @@ TEST(interp_Binop_div_double) {
   auto eout = parse("3.0 / 2.0\n");
   ASSERT_TRUE(eval(eout) == val::make_array(1.5));
 }
+TEST(interp_Binop_scalar_tree) {
+  auto eout = parse("a <- 2; b <- 3; (a + b) * a - b / 3\n");
+  ASSERT_TRUE(eval(eout) == val::make_array(9.0));
+}
+TEST(interp_Binop_scalar_tree_vector) {
+  auto eout = parse("a <- c(1.0, 2.0); (a + 1) * 2\n");
+  auto a = arr::Array<double>({2}, arr::Vector<double>{4,6});
+  ASSERT_TRUE(eval(eout) == make_cow<val::VArrayD>(false, a));
+}
+TEST(interp_Binop_scalar_tree_dtime) {
+  auto eout = parse("t <- |.2015-03-09 06:38:01 America/New_York.|; t + (t - t) == t\n");
+  ASSERT_TRUE(eval(eout) == val::make_array(true));
+}
 
 // scalar bool ----------
 TEST(interp_bool_true) {
@@ -474,6 +487,47 @@ TEST(interp_zts_2_2_2) {
   auto z = arr::zts({2,2,2}, {dt1, dt2}, {1,2,3,4,5,6,7,8}, {{}, {"one", "two"}, {"1","2"}});
   ASSERT_TRUE(eval(eout) == make_cow<arr::zts>(false, z));
 }
+TEST(interp_zts_container_requires_file) {
+  auto eout = parse("idx <- c(|.2015-03-09 06:38:01 America/New_York.|);"
+        "zts(idx, matrix(1.0, 1, 1), container=TRUE) \n");
+  ASSERT_THROW(eval(eout), interp::EvalException, "container requires a file");
+}
+TEST(interp_stats_mem_period) {
+  auto eout = parse("p <- as.period(\"1m\"); dim(stats.mem(x=p)) \n");
+  auto a = arr::Array<double>({2}, arr::Vector<double>{9,1});
+  ASSERT_TRUE(eval(eout) == make_cow<val::VArrayD>(false, a));
+}
+TEST(interp_zts_fused_arith) {
+  auto eout = parse("idx <- c(|.2015-03-09 06:38:01 America/New_York.|, "
+        "|.2015-03-09 06:38:02 America/New_York.|, "
+        "|.2015-03-09 06:38:03 America/New_York.|);"
+        "z <- zts(idx, matrix(1.0:6, 3, 2, dimnames=list(NULL, c(\"one\", \"two\"))));"
+        "(z - 1) / z * 100 \n");
+  auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
+  auto dt2 = tz::dtime_from_string("2015-03-09 06:38:02 America/New_York", tzones);
+  auto dt3 = tz::dtime_from_string("2015-03-09 06:38:03 America/New_York", tzones);
+  arr::Vector<double> v;
+  for (double x=1; x<=6; ++x) v.push_back((x - 1) / x * 100);
+  auto z = arr::zts({3,2}, {dt1, dt2, dt3}, v, {{}, {"one", "two"}});
+  ASSERT_TRUE(eval(eout) == make_cow<arr::zts>(false, z));
+}
+TEST(interp_zts_fused_index_mismatch) {
+  auto eout = parse("z1 <- zts(c(|.2015-03-09 06:38:01 America/New_York.|), 1.0);"
+        "z2 <- zts(c(|.2015-03-09 06:38:02 America/New_York.|), 2.0);"
+        "(z1 + 1) * z2 \n");
+  ASSERT_THROW(eval(eout), std::range_error, "time indices of times series are not identical");
+}
+TEST(interp_array_fused_same_as_stepwise) {
+  auto fused = parse("m <- matrix(1.0:4, 2, 2, dimnames=list(c(\"a\", \"b\"), NULL));"
+                     "b <- 2; -(m - b) / (b %% 3 ^ m) \n");
+  auto stepwise = parse("m <- matrix(1.0:4, 2, 2, dimnames=list(c(\"a\", \"b\"), NULL));"
+                        "b <- 2; x <- m - b; x <- -x; y <- 3 ^ m; y <- b %% y; x / y \n");
+  ASSERT_TRUE(eval(fused) == eval(stepwise));
+}
+TEST(interp_array_fused_incompatible_sizes) {
+  auto eout = parse("a <- c(1.0, 2.0); b <- c(1.0, 2.0, 3.0); (a + b) * 2 \n");
+  ASSERT_THROW(eval(eout), std::range_error, "incompatible array sizes");
+}
 
 
 // operator :
@@ -546,6 +600,26 @@ TEST(interp_funcall_repeated_ellipsis) {
   auto eout = parse("f <- function(..., ...) { } \n");
   ASSERT_THROW(eval(eout), std::range_error, "repeated formal argument '...'");
 }
+TEST(interp_funcall_local_read_before_assign) {
+  auto eout = parse("a <- 3; f <- function() { x <- a; a <- 1; x + a }; f() \n");
+  ASSERT_TRUE(eval(eout) == val::make_array(4.0));
+}
+TEST(interp_funcall_local_assign_by_name) {
+  auto eout = parse("f <- function() { a <- 1; assign(\"a\", 2); a }; f() \n");
+  ASSERT_TRUE(eval(eout) == val::make_array(2.0));
+}
+TEST(interp_funcall_local_rm) {
+  auto eout = parse("a <- 3; f <- function() { a <- 1; rm(a); a }; f() \n");
+  ASSERT_TRUE(eval(eout) == val::make_array(3.0));
+}
+TEST(interp_funcall_local_seen_by_callee) {
+  auto eout = parse("f <- function(a) { g <- function() a; a <- a + 1; g() }; f(1) \n");
+  ASSERT_TRUE(eval(eout) == val::make_array(2.0));
+}
+TEST(interp_funcall_recursive_frames_reused) {
+  auto eout = parse("f <- function(n) if (n == 0) 0 else n + f(n - 1); f(100) + f(100) \n");
+  ASSERT_TRUE(eval(eout) == val::make_array(10100.0));
+}
 
 // subsetting -----------
 TEST(interp_vector_subset_noargs) {
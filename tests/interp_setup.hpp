@@ -64,8 +64,8 @@ val::Value eval(const unique_ptr<E>& ein) {
   zcore::MsgHandlerBase ir;
   zcore::InterpCtxRemote ic(ir, global);
   vector<shpfrm> fstack;
-  auto halt = make_shared<Kont>(Kont{nullptr, nullptr, evalEnv, nullptr, Kont::NORMAL});
-  auto k = make_shared<Kont>(Kont{nullptr, ein.get(), evalEnv, halt, Kont::NORMAL});
+  auto halt = make_pooled<Kont>(Kont{nullptr, nullptr, evalEnv, nullptr, Kont::NORMAL});
+  auto k = make_pooled<Kont>(Kont{nullptr, ein.get(), evalEnv, halt, Kont::NORMAL});
   auto is = zcore::InterpState{0, 0, 0,
                                std::unique_ptr<E>(ein->clone()),
                                k,
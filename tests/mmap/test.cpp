@@ -97,6 +97,27 @@ TEST(mmap_array_dtime) {
   cleandir("./array_dtime1");
   cleandir("./array_dtime2");
 }
+TEST(mmap_array_double_readonly) {
+  cleandir("./array_readonly");
+  {
+    auto eout = parse("a <- matrix(1:9, 3, 3, file=\"./array_readonly\");"
+                      "a <- 2;"
+                      "b <- load(file=\"./array_readonly\", readonly=TRUE, advice=\"sequential\");"
+                      "b + 0 \n");
+    auto a = arr::Array<double>({3,3}, {1,2,3,4,5,6,7,8,9});
+    ASSERT_TRUE(eval(eout) == val::Value(make_cow<val::VArrayD>(false, a)));
+  }
+  {
+    auto eout = parse("b[1] <- 0 \n");
+    ASSERT_THROW(eval(eout), std::range_error);
+  }
+  {
+    auto eout = parse("load(file=\"./array_readonly\", advice=\"backwards\") \n");
+    ASSERT_THROW(eval(eout), interp::EvalException);
+  }
+  cleandir("./array_readonly");
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -513,6 +513,58 @@ TEST(vector_insert_end_unordered_lt) {
   ASSERT_TRUE(!v1.isOrdered());
 }
 
+// -- flexallocator tests
+TEST(vector_flex_resize_from_front) {
+  const size_t sz = 10000;
+  Vector<double> v(sz, 0.0, std::make_unique<flexallocator>());
+  for (size_t i=0; i<sz; ++i) v[i] = i;
+  v.resize(sz - 3, 3);
+  v.resize(sz - 8, 5);          // from an address already at an offset
+  v.resize(sz - 1000, 992);     // and across a page boundary
+  ASSERT_TRUE(v.size() == sz - 1000);
+  for (size_t i=0; i<v.size(); ++i) {
+    ASSERT_TRUE(v[i] == i + 1000);
+  }
+}
+TEST(vector_flex_hugepages_madvise) {
+  auto& hp = HugePages::instance();
+  hp.configure(HugePages::MADVISE, 4 << 20);
+  const size_t advised = hp.bytesAdvised;
+  {
+    auto alloc = std::make_unique<flexallocator>();
+    auto a = alloc.get();
+    Vector<double> v(10, 0.0, std::move(alloc));
+    ASSERT_TRUE(!a->isAdvised());
+    for (size_t i=0; i<(1 << 20); ++i) v.push_back(i); // crosses the threshold
+    ASSERT_TRUE(a->isAdvised() || hp.bytesAdvised == advised); // THP may be disabled
+    ASSERT_TRUE(v[10 + 12345] == 12345);
+  }
+  ASSERT_TRUE(hp.bytesAdvised == advised);
+}
+TEST(vector_flex_hugepages_hugetlb) {
+  auto& hp = HugePages::instance();
+  hp.configure(HugePages::HUGETLB, 4 << 20);
+  const size_t sz = 1 << 20;
+  {
+    auto alloc = std::make_unique<flexallocator>();
+    auto a = alloc.get();
+    Vector<double> v(10, 0.0, std::move(alloc));
+    for (size_t i=0; i<sz; ++i) v.push_back(i);
+    // depending on the reserved huge pages we either got them or fell back:
+    ASSERT_TRUE(a->isHugetlb() || hp.nbFallback > 0);
+    v.resize(sz - 1000, 1010);
+    for (size_t i=0; i<v.size(); ++i) {
+      ASSERT_TRUE(v[i] == i + 1000);
+    }
+  }
+  ASSERT_TRUE(hp.bytesHugetlb == 0);
+}
+TEST(vector_hugepages_mode_from_string) {
+  ASSERT_TRUE(HugePages::from_string("off") == HugePages::OFF);
+  ASSERT_TRUE(HugePages::from_string("hugetlb") == HugePages::HUGETLB);
+  ASSERT_THROW(HugePages::from_string("on"), std::range_error);
+}
+
 // -- memory mapping tests
 TEST(vector_mmap_constructor_basic) {
   std::string filename = "temp1";
@@ -579,6 +631,70 @@ TEST(vector_mmap_initialize) {
   int res = remove(filename.c_str());
   ASSERT_TRUE(res==0);
 }
+TEST(vector_alloc_stats) {
+  auto& g = AllocCounters::instance();
+  const auto bytes0 = g.bytes.load();
+  std::string filename = "temp_stats";
+  {
+    Vector<double> v(1, 1.0);   // a small block
+    MemUsage u;
+    v.addMemUsage(u);
+    ASSERT_TRUE(u.nbVectors == 1);
+    ASSERT_TRUE(u.bytesUsed == sizeof(RawVector<double>) + sizeof(double));
+    ASSERT_TRUE(u.bytesReserved == SmallBlocks::classSize(0));
+    ASSERT_TRUE(g.bytes == bytes0 + static_cast<int64_t>(u.bytesReserved));
+    const auto nbRealloc = g.nbRealloc.load();
+    v.push_back(2.0);           // out of the small block
+    MemUsage u2;
+    v.addMemUsage(u2);
+    ASSERT_TRUE(u2.nbRealloc == 1 && u2.nbRemap == 1);
+    ASSERT_TRUE(u2.bytesReserved == getTotalSize<double>(arr::VECTOR_INITIAL_ALLOC));
+    ASSERT_TRUE(g.nbRealloc == nbRealloc + 1);
+
+    Vector<double> m(arr::VECTOR_INITIAL_ALLOC, 0.0, std::make_unique<mmapallocator>(filename));
+    m.resize(4 * arr::VECTOR_INITIAL_ALLOC); // past the file's capacity
+    m.getAllocator()->msync(false);
+    MemUsage um;
+    m.addMemUsage(um);
+    ASSERT_TRUE(um.nbRemap == 1 && um.nbMsync == 1);
+    ASSERT_TRUE(um.bytesReserved >= um.bytesUsed);
+    ASSERT_TRUE(um.bytesResident > 0 && um.bytesResident <= um.bytesReserved + 4096);
+  }
+  ASSERT_TRUE(g.bytes == bytes0);
+  ASSERT_TRUE(remove(filename.c_str()) == 0);
+}
+TEST(vector_mmap_dirty_range) {
+  std::string filename = "temp1";
+  const size_t sz = 1000;
+  {
+    auto alloc = std::make_unique<mmapallocator>(filename);
+    auto dirty = alloc->getDirtyRange();
+    Vector<double> v(sz, 0, std::move(alloc));
+    v.getAllocator()->msync(false);
+    size_t from, to;
+    ASSERT_TRUE(!dirty->take(from, to)); // all flushed
+    v.push_back(1.0);
+    ASSERT_TRUE(dirty->take(from, to));
+    ASSERT_TRUE(from == sizeof(RawVector<double>) + sz*sizeof(double));
+    ASSERT_TRUE(to == from + sizeof(double));
+    setv(v, 3, 2.0);
+    v[5] = 4.0;
+    ASSERT_TRUE(dirty->take(from, to));
+    ASSERT_TRUE(from == sizeof(RawVector<double>) + 3*sizeof(double));
+    ASSERT_TRUE(to == sizeof(RawVector<double>) + 6*sizeof(double));
+    // reading through a const reference doesn't dirty anything:
+    const auto& cv = v;
+    ASSERT_TRUE(cv[7] == 0);
+    ASSERT_TRUE(!dirty->take(from, to));
+  }
+  {
+    Vector<double> v(std::make_unique<mmapallocator>(filename));
+    ASSERT_TRUE(v.size() == sz + 1);
+    ASSERT_TRUE(v[3] == 2.0 && v[5] == 4.0 && v[sz] == 1.0);
+  }
+  int res = remove(filename.c_str());
+  ASSERT_TRUE(res==0);
+}
 TEST(vector_mmap_initialize_zstring) {
   std::string filename = "temp1";
   const size_t sz = 10;
@@ -1019,6 +1135,31 @@ TEST(vector_resize_0_smaller_at_offset_flexalloc) {
   ASSERT_TRUE(v1 == v2);
 }
 
+TEST(vector_small_blocks_reused) {
+  const void* p;
+  {
+    Vector<double> v1(1, 1.0);
+    p = v1.getRawVectorPtr();
+  }
+  Vector<double> v2(1, 2.0);    // same size class, same thread
+  ASSERT_TRUE(v2.getRawVectorPtr() == p);
+  ASSERT_TRUE(v2[0] == 2.0);
+}
+TEST(vector_small_grow_past_small_blocks) {
+  Vector<double> v1(1, 0.0);
+  for (size_t i=1; i<3 * arr::VECTOR_INITIAL_ALLOC; ++i) {
+    v1.push_back(i);
+  }
+  Vector<double> v2(v1);
+  ASSERT_TRUE(v2.size() == 3 * arr::VECTOR_INITIAL_ALLOC);
+  for (size_t i=0; i<v2.size(); ++i) {
+    ASSERT_TRUE(v2[i] == i);
+  }
+  v2.resize(3);                 // back into a small block
+  v2.push_back(3);
+  ASSERT_TRUE(v2 == Vector<double>({0, 1, 2, 3}));
+}
+
 int main(int argc, char *argv[])
 {
   return crpcut::run(argc, argv);
@@ -21,6 +21,7 @@
 #include <crpcut.hpp>
 //#include "cutest/cutest.h"
 #include <system_error>
+#include <fstream>
 #include <stdio.h>
 #include "zts.hpp"
 #include "display.hpp"
@@ -62,6 +63,100 @@ TEST(zts_to_string) {
   // cout << val::to_string(make_shared<arr::zts>(z)) << endl;
   // no ASSERT, just checking the function runs correctly
 }
+TEST(zts_append_batch) {
+  auto t = [](int64_t s) { return Global::dtime(std::chrono::seconds(s)); };
+  arr::zts z({2,2}, {t(1), t(2)}, {1,2,3,4});
+  const arr::zts z1({1,2}, {t(3)}, {5,6});
+  const arr::zts z2({2,2}, {t(4), t(5)}, {7,8,9,10});
+  auto b1 = z1.to_buffer();
+  auto b2 = z2.to_buffer();
+  std::vector<arr::idx_type> rows;
+  z.appendBatch({{b1.first.get(), b1.second}, {b2.first.get(), b2.second}}, rows);
+  const arr::zts expected({5,2}, {t(1), t(2), t(3), t(4), t(5)}, {1,2,5,7,8,3,4,6,9,10});
+  ASSERT_TRUE(z == expected);
+  ASSERT_TRUE(rows == std::vector<arr::idx_type>({1, 2}));
+}
+TEST(zts_append_batch_not_ascending) {
+  auto t = [](int64_t s) { return Global::dtime(std::chrono::seconds(s)); };
+  arr::zts z({2,2}, {t(1), t(2)}, {1,2,3,4});
+  const arr::zts z1({1,2}, {t(4)}, {5,6});
+  const arr::zts z2({1,2}, {t(3)}, {7,8});
+  auto b1 = z1.to_buffer();
+  auto b2 = z2.to_buffer();
+  std::vector<arr::idx_type> rows;
+  ASSERT_THROW(z.appendBatch({{b1.first.get(), b1.second}, {b2.first.get(), b2.second}}, rows), 
+               std::range_error);
+  const arr::zts expected({2,2}, {t(1), t(2)}, {1,2,3,4});
+  ASSERT_TRUE(z == expected);
+}
+TEST(zts_append_vector) {
+  auto t = [](int64_t s) { return Global::dtime(std::chrono::seconds(s)); };
+  arr::zts z({2,2}, {t(1), t(2)}, {1,2,3,4});
+  const arr::Vector<Global::dtime> i{t(3), t(4)};
+  const arr::Vector<double> d{5,6,7,8};
+  char buf[1024];
+  auto sz = i.to_buffer(buf);
+  sz += d.to_buffer(buf + sz);
+  z.appendVector(buf, sz);
+  const arr::zts expected({4,2}, {t(1), t(2), t(3), t(4)}, {1,2,5,6,3,4,7,8});
+  ASSERT_TRUE(z == expected);
+}
+TEST(zts_append_vector_not_ascending) {
+  auto t = [](int64_t s) { return Global::dtime(std::chrono::seconds(s)); };
+  arr::zts z({2,2}, {t(1), t(2)}, {1,2,3,4});
+  const arr::Vector<Global::dtime> i{t(4), t(3)};
+  const arr::Vector<double> d{5,6,7,8};
+  char buf[1024];
+  auto sz = i.to_buffer(buf);
+  sz += d.to_buffer(buf + sz);
+  ASSERT_THROW(z.appendVector(buf, sz), std::out_of_range, "append index not ascending");
+  const arr::zts expected({2,2}, {t(1), t(2)}, {1,2,3,4});
+  ASSERT_TRUE(z == expected);
+}
+TEST(zts_append_reorder) {
+  auto t = [](int64_t s) { return Global::dtime(std::chrono::seconds(s)); };
+  arr::zts z({3,1}, {t(1), t(3), t(5)}, {1,3,5});
+  z.setReorder(std::chrono::seconds(3), arr::zts::LATE_REJECT);
+  // a zts can't have an unordered index, so encode its parts:
+  const arr::Array<Global::dtime> i({3}, arr::Vector<Global::dtime>{t(4), t(6), t(2)});
+  const arr::Array<double> d({3,1}, arr::Vector<double>{4,6,2});
+  char buf[1024];
+  auto sz = i.to_buffer(buf);
+  sz += d.to_buffer(buf + sz);
+  size_t offset = 0;
+  z.append(buf, sz, offset);
+  const arr::zts expected({6,1}, {t(1), t(2), t(3), t(4), t(5), t(6)}, {1,2,3,4,5,6});
+  ASSERT_TRUE(z == expected);
+  ASSERT_TRUE(z.getIndex().isOrdered());
+}
+TEST(zts_append_reorder_reject) {
+  auto t = [](int64_t s) { return Global::dtime(std::chrono::seconds(s)); };
+  arr::zts z({3,1}, {t(1), t(3), t(5)}, {1,3,5});
+  z.setReorder(std::chrono::seconds(1), arr::zts::LATE_REJECT);
+  const arr::Array<Global::dtime> i({2}, arr::Vector<Global::dtime>{t(6), t(2)});
+  const arr::Array<double> d({2,1}, arr::Vector<double>{6,2});
+  char buf[1024];
+  auto sz = i.to_buffer(buf);
+  sz += d.to_buffer(buf + sz);
+  size_t offset = 0;
+  ASSERT_THROW(z.append(buf, sz, offset), std::range_error);
+  const arr::zts expected({3,1}, {t(1), t(3), t(5)}, {1,3,5});
+  ASSERT_TRUE(z == expected);
+}
+TEST(zts_append_vector_reorder_drop) {
+  auto t = [](int64_t s) { return Global::dtime(std::chrono::seconds(s)); };
+  arr::zts z({3,1}, {t(1), t(3), t(5)}, {1,3,5});
+  z.setReorder(std::chrono::seconds(1), arr::zts::LATE_DROP);
+  // t(2) is beyond the window and t(5) is already there:
+  const arr::Vector<Global::dtime> i{t(6), t(2), t(4), t(5)};
+  const arr::Vector<double> d{6,2,4,50};
+  char buf[1024];
+  auto sz = i.to_buffer(buf);
+  sz += d.to_buffer(buf + sz);
+  z.appendVector(buf, sz);
+  const arr::zts expected({5,1}, {t(1), t(3), t(4), t(5), t(6)}, {1,3,4,5,6});
+  ASSERT_TRUE(z == expected);
+}
 TEST(zts_constructor_from_file) {
   auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
   auto dt2 = tz::dtime_from_string("2015-03-10 06:38:01 America/New_York", tzones);
@@ -114,6 +209,328 @@ TEST(zts_constructor_from_file) {
   ASSERT_TRUE(rmdir("./zts_mmap_constructor/") == 0);        
 }
 
+TEST(zts_constructor_from_compressed_file) {
+  using namespace std::chrono;
+  // large enough to have several full blocks and a partial one:
+  const arr::idx_type n = 3 * arr::codec::BLOCKSZ + 17;
+  auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
+  arr::Vector<Global::dtime> idx;
+  arr::Vector<double> data;
+  for (arr::idx_type i=0; i<n; ++i) {
+    idx.push_back(dt1 + (i * 100 + (i % 1000 == 0 ? 3 : 0)) * 1ms);
+  }
+  for (arr::idx_type i=0; i<2*n; ++i) {
+    data.push_back(100.25 + (i % 13) * 0.25);
+  }
+  fsys::remove_all("./zts_compressed");
+  {
+    std::unique_ptr<arr::AllocFactory> zcore_dir =
+                    std::make_unique<arr::ZMmapAllocFactory>("./zts_compressed/"s, false);
+    std::unique_ptr<arr::AllocFactory> zidx_dir  =
+                    std::make_unique<arr::ZMmapAllocFactory>("./zts_compressed/idx"s, false);
+    const arr::zts a({n,2}, idx, data, {{}, {"bid", "ask"}},
+                     std::move(zcore_dir), std::move(zidx_dir));
+  }
+  ASSERT_TRUE(arr::isCompressedColumn("./zts_compressed/0"));
+  ASSERT_TRUE(arr::isCompressedColumn("./zts_compressed/idx/0"));
+  ASSERT_TRUE(fsys::file_size("./zts_compressed/idx/0") < n * sizeof(Global::dtime) / 4);
+  ASSERT_TRUE(fsys::file_size("./zts_compressed/0") < n * sizeof(double) / 4);
+  {
+    arr::zts a(std::make_unique<arr::ZMmapAllocFactory>("./zts_compressed/"s, true),
+               std::make_unique<arr::ZMmapAllocFactory>("./zts_compressed/idx"s, true));
+    const arr::zts b({n,2}, idx, data, {{}, {"bid", "ask"}});
+    ASSERT_TRUE(a == b);
+    // append one more row, which only rewrites the last block:
+    const arr::zts c({1,2}, {idx[n-1] + 1s}, {1.5, 2.5}, {{}, {"bid", "ask"}});
+    a.abind(c, 0);
+    a.msync(false);
+  }
+  {
+    const arr::zts a(std::make_unique<arr::ZMmapAllocFactory>("./zts_compressed/"s, true),
+                     std::make_unique<arr::ZMmapAllocFactory>("./zts_compressed/idx"s, true));
+    ASSERT_TRUE(a.getdim(0) == n + 1);
+    ASSERT_TRUE(a.getIndex()[n] == idx[n-1] + 1s);
+    ASSERT_TRUE((a.getArray()[{n-1,0}] == data[n-1]));
+    ASSERT_TRUE((a.getArray()[{n,1}] == 2.5));
+  }
+  ASSERT_TRUE(fsys::remove_all("./zts_compressed") > 0);
+}
+
+TEST(zts_compressed_column_decoded_on_access) {
+  // a column that is much larger than what it may keep in memory:
+  const size_t n = 64 * arr::codec::BLOCKSZ;
+  const size_t pagesz = sysconf(_SC_PAGESIZE);
+  const size_t maxResident = 16 * pagesz;
+  const fsys::path file("./zts_compressed_paged/0");
+  fsys::remove_all("./zts_compressed_paged");
+  fsys::create_directory("./zts_compressed_paged");
+  {
+    arr::Vector<double> v(n, 0.0, std::make_unique<arr::zallocator>(file));
+    for (size_t i=0; i<n; ++i) {
+      v[i] = i;
+    }
+  }
+  {
+    const arr::Vector<double> v(std::make_unique<arr::zallocator>(file, true, maxResident));
+    // only the header page is in memory:
+    ASSERT_TRUE(v.getAllocator()->resident() <= pagesz);
+    ASSERT_TRUE(v[n/2 + 1] == n/2 + 1);
+    ASSERT_TRUE(v.getAllocator()->resident() <= 2 * pagesz);
+    double sum = 0;
+    for (size_t i=0; i<n; ++i) {
+      sum += v[i];
+    }
+    ASSERT_TRUE(sum == (n - 1.0) * n / 2);
+    ASSERT_TRUE(v.getAllocator()->resident() <= maxResident);
+  }
+  {
+    arr::Vector<double> v(std::make_unique<arr::zallocator>(file, false, maxResident));
+    const auto before = fsys::file_size(file);
+    v[10] = -1;
+    v.push_back(n);
+    v.getAllocator()->msync(false);
+    // the first block, the new tail block and the index are appended:
+    ASSERT_TRUE(fsys::file_size(file) - before < 3 * arr::codec::BLOCKSZ * sizeof(double));
+  }
+  {
+    // a flush that died before rewriting the header leaves bytes
+    // after the last index, which are ignored:
+    std::ofstream f(file.string(), std::ios::app | std::ios::binary);
+    f << std::string(1000, 'x');
+  }
+  {
+    const arr::Vector<double> v(std::make_unique<arr::zallocator>(file, true, maxResident));
+    ASSERT_TRUE(v.size() == n + 1);
+    ASSERT_TRUE(v[10] == -1);
+    ASSERT_TRUE(v[11] == 11);
+    ASSERT_TRUE(v[n-1] == n - 1);
+    ASSERT_TRUE(v[n] == n);
+  }
+  ASSERT_TRUE(fsys::remove_all("./zts_compressed_paged") > 0);
+}
+
+TEST(zts_constructor_from_segmented_file) {
+  using namespace std::chrono;
+  // a one-page segment size gives several segments for a few thousand rows:
+  const size_t segsz = sysconf(_SC_PAGESIZE);
+  const arr::idx_type n = 3 * segsz / sizeof(double) + 5;
+  auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
+  arr::Vector<Global::dtime> idx;
+  arr::Vector<double> data;
+  for (arr::idx_type i=0; i<n; ++i) {
+    idx.push_back(dt1 + i * 1s);
+    data.push_back(i);
+  }
+  fsys::remove_all("./zts_segmented");
+  {
+    std::unique_ptr<arr::AllocFactory> score_dir =
+                    std::make_unique<arr::SegAllocFactory>("./zts_segmented/"s, false, segsz);
+    std::unique_ptr<arr::AllocFactory> sidx_dir  =
+                    std::make_unique<arr::SegAllocFactory>("./zts_segmented/idx"s, false, segsz);
+    const arr::zts a({n,1}, idx, data, {{}, {"bid"}},
+                     std::move(score_dir), std::move(sidx_dir));
+  }
+  ASSERT_TRUE(arr::isSegmentedColumn("./zts_segmented/0"));
+  ASSERT_TRUE(arr::isSegmentedColumn("./zts_segmented/idx/0"));
+  ASSERT_TRUE(fsys::exists("./zts_segmented/idx/0/000003"));
+  {
+    arr::zts a(std::make_unique<arr::SegAllocFactory>("./zts_segmented/"s, true, 0),
+               std::make_unique<arr::SegAllocFactory>("./zts_segmented/idx"s, true, 0));
+    const arr::zts b({n,1}, idx, data, {{}, {"bid"}});
+    ASSERT_TRUE(a == b);
+    // appending past the last segment maps a new one:
+    arr::Vector<Global::dtime> idx2;
+    arr::Vector<double> data2;
+    for (size_t i=0; i<segsz / sizeof(double); ++i) {
+      idx2.push_back(idx[n-1] + (i + 1) * 1s);
+      data2.push_back(n + i);
+    }
+    const arr::zts c({idx2.size(),1}, idx2, data2, {{}, {"bid"}});
+    a.abind(c, 0);
+    a.msync(false);
+  }
+  ASSERT_TRUE(fsys::exists("./zts_segmented/idx/0/000004"));
+  {
+    const arr::zts a(std::make_unique<arr::SegAllocFactory>("./zts_segmented/"s, true, 0),
+                     std::make_unique<arr::SegAllocFactory>("./zts_segmented/idx"s, true, 0));
+    const arr::idx_type m = n + segsz / sizeof(double);
+    ASSERT_TRUE(a.getdim(0) == m);
+    for (arr::idx_type i=0; i<m; ++i) {
+      ASSERT_TRUE(a.getIndex()[i] == dt1 + i * 1s);
+      ASSERT_TRUE((a.getArray()[{i,0}] == i));
+    }
+  }
+  ASSERT_TRUE(fsys::remove_all("./zts_segmented") > 0);
+}
+
+TEST(zts_segmented_time_search_maps_one_segment) {
+  using namespace std::chrono;
+  const size_t pagesz = sysconf(_SC_PAGESIZE);
+  const size_t perseg = pagesz / sizeof(Global::dtime);
+  const size_t n = 10 * perseg;
+  auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
+  const fsys::path dir("./zts_segmented_search");
+  fsys::remove_all(dir);
+  fsys::create_directory(dir);
+  {
+    arr::Vector<Global::dtime> v(arr::rsv, n, std::make_unique<arr::segallocator>(dir / "0", pagesz));
+    for (size_t i=0; i<n; ++i) {
+      v.push_back(dt1 + i * 1s);
+    }
+  }
+  const auto t = dt1 + (6 * perseg + 3) * 1s;
+  {
+    const arr::Vector<Global::dtime> v(std::make_unique<arr::segallocator>(dir / "0", 0, true));
+    ASSERT_TRUE(v.getAllocator()->resident() <= pagesz);
+    ASSERT_TRUE(arr::timeBound(v, t, false) == 6 * perseg + 3);
+    ASSERT_TRUE(arr::timeBound(v, t, true) == 6 * perseg + 4);
+    // only the header and the segment holding 't' were mapped:
+    ASSERT_TRUE(v.getAllocator()->resident() <= 2 * pagesz);
+    ASSERT_TRUE(arr::timeBound(v, dt1 + (6 * perseg - 1) * 1s, true) == 6 * perseg);
+    ASSERT_TRUE(arr::timeBound(v, dt1 - 1s, false) == 0);
+    ASSERT_TRUE(arr::timeBound(v, dt1 + n * 1s, false) == n);
+  }
+  {
+    // writing to a sealed segment opens it again:
+    arr::Vector<Global::dtime> v(std::make_unique<arr::segallocator>(dir / "0", 0));
+    v[2] = dt1 + 1500ms;
+    ASSERT_TRUE(arr::timeBound(v, dt1 + 1500ms, false) == 2);
+    ASSERT_TRUE(arr::timeBound(v, t, false) == 6 * perseg + 3);
+  }
+  {
+    const arr::Vector<Global::dtime> v(std::make_unique<arr::segallocator>(dir / "0", 0, true));
+    ASSERT_TRUE(v[2] == dt1 + 1500ms);
+    ASSERT_TRUE(arr::timeBound(v, t, false) == 6 * perseg + 3);
+    ASSERT_TRUE(v.getAllocator()->resident() <= 3 * pagesz);
+  }
+  ASSERT_TRUE(fsys::remove_all(dir) > 0);
+}
+
+TEST(zts_constructor_from_readonly_file) {
+  using namespace std::chrono;
+  const size_t segsz = sysconf(_SC_PAGESIZE);
+  const arr::idx_type n = 2 * segsz / sizeof(double) + 5;
+  auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
+  arr::Vector<Global::dtime> idx;
+  arr::Vector<double> data;
+  for (arr::idx_type i=0; i<n; ++i) {
+    idx.push_back(dt1 + i * 1s);
+    data.push_back(i);
+  }
+  fsys::remove_all("./zts_readonly");
+  fsys::remove_all("./zts_readonly_seg");
+  {
+    std::unique_ptr<arr::AllocFactory> core_dir =
+                    std::make_unique<arr::MmapAllocFactory>("./zts_readonly/"s, false);
+    std::unique_ptr<arr::AllocFactory> idx_dir  =
+                    std::make_unique<arr::MmapAllocFactory>("./zts_readonly/idx"s, false);
+    const arr::zts a({n,1}, idx, data, {{}, {"bid"}}, std::move(core_dir), std::move(idx_dir));
+    std::unique_ptr<arr::AllocFactory> score_dir =
+                    std::make_unique<arr::SegAllocFactory>("./zts_readonly_seg/"s, false, segsz);
+    std::unique_ptr<arr::AllocFactory> sidx_dir  =
+                    std::make_unique<arr::SegAllocFactory>("./zts_readonly_seg/idx"s, false, segsz);
+    const arr::zts s({n,1}, idx, data, {{}, {"bid"}}, std::move(score_dir), std::move(sidx_dir));
+  }
+  const auto size0 = fsys::file_size("./zts_readonly/0");
+  // files with no write permission can still be loaded read-only:
+  fsys::permissions("./zts_readonly/0", fsys::owner_read);
+  {
+    const arr::zts b({n,1}, idx, data, {{}, {"bid"}});
+    const arr::zts c({1,1}, {idx[n-1] + 1s}, {1.5}, {{}, {"bid"}});
+    arr::zts a(std::make_unique<arr::MmapAllocFactory>("./zts_readonly/"s, true, true, MADV_SEQUENTIAL),
+               std::make_unique<arr::MmapAllocFactory>("./zts_readonly/idx"s, true, true, MADV_RANDOM));
+    ASSERT_TRUE(a == b);
+    // the mapping can't be written to, so an append is refused:
+    ASSERT_THROW(a.abind(c, 0), std::range_error);
+    a.msync(false);
+    arr::zts s(std::make_unique<arr::SegAllocFactory>("./zts_readonly_seg/"s, true, 0, true, MADV_WILLNEED),
+               std::make_unique<arr::SegAllocFactory>("./zts_readonly_seg/idx"s, true, 0, true));
+    ASSERT_TRUE(s == b);
+    ASSERT_THROW(s.abind(c, 0), std::range_error);
+  }
+  ASSERT_TRUE(fsys::file_size("./zts_readonly/0") == size0);
+  {
+    const arr::zts b({n,1}, idx, data, {{}, {"bid"}});
+    fsys::permissions("./zts_readonly/0", fsys::owner_read|fsys::owner_write);
+    const arr::zts a(std::make_unique<arr::MmapAllocFactory>("./zts_readonly/"s, true),
+                     std::make_unique<arr::MmapAllocFactory>("./zts_readonly/idx"s, true));
+    ASSERT_TRUE(a == b);
+    const arr::zts s(std::make_unique<arr::SegAllocFactory>("./zts_readonly_seg/"s, true, 0),
+                     std::make_unique<arr::SegAllocFactory>("./zts_readonly_seg/idx"s, true, 0));
+    ASSERT_TRUE(s == b);
+  }
+  ASSERT_TRUE(fsys::remove_all("./zts_readonly") > 0);
+  ASSERT_TRUE(fsys::remove_all("./zts_readonly_seg") > 0);
+}
+
+TEST(zts_constructor_from_container) {
+  using namespace std::chrono;
+  const arr::idx_type n = 3 * sysconf(_SC_PAGESIZE) / sizeof(double) + 5;
+  auto dt1 = tz::dtime_from_string("2015-03-09 06:38:01 America/New_York", tzones);
+  arr::Vector<Global::dtime> idx;
+  arr::Vector<double> data;
+  for (arr::idx_type i=0; i<n; ++i) {
+    idx.push_back(dt1 + i * 1s);
+    data.push_back(i);
+  }
+  fsys::remove("./zts_container");
+  {
+    auto callocf = std::make_unique<arr::ContainerAllocFactory>("./zts_container"s, false);
+    std::unique_ptr<arr::AllocFactory> cidx = std::make_unique<arr::ContainerAllocFactory>(*callocf, "idx");
+    const arr::zts a({n,1}, idx, data, {{}, {"bid"}}, std::move(callocf), std::move(cidx));
+  }
+  ASSERT_TRUE(arr::isContainer("./zts_container"));
+  {
+    auto callocf = std::make_unique<arr::ContainerAllocFactory>("./zts_container"s, true);
+    ASSERT_TRUE(callocf->has("0") && callocf->has("idx/0") && callocf->has("names1"));
+    std::unique_ptr<arr::AllocFactory> cidx = std::make_unique<arr::ContainerAllocFactory>(*callocf, "idx");
+    arr::zts a(std::move(callocf), std::move(cidx));
+    const arr::zts b({n,1}, idx, data, {{}, {"bid"}});
+    ASSERT_TRUE(a == b);
+    // only the last extent of the file can grow in place, so this
+    // moves the others:
+    arr::Vector<Global::dtime> idx2;
+    arr::Vector<double> data2;
+    for (arr::idx_type i=0; i<n; ++i) {
+      idx2.push_back(idx[n-1] + (i + 1) * 1s);
+      data2.push_back(n + i);
+    }
+    const arr::zts c({n,1}, idx2, data2, {{}, {"bid"}});
+    a.abind(c, 0);
+  }
+  {
+    auto callocf = std::make_unique<arr::ContainerAllocFactory>("./zts_container"s, true, true);
+    std::unique_ptr<arr::AllocFactory> cidx = std::make_unique<arr::ContainerAllocFactory>(*callocf, "idx");
+    const arr::zts a(std::move(callocf), std::move(cidx));
+    ASSERT_TRUE(a.getdim(0) == 2 * n);
+    for (arr::idx_type i=0; i<2*n; ++i) {
+      ASSERT_TRUE(a.getIndex()[i] == dt1 + i * 1s);
+      ASSERT_TRUE((a.getArray()[{i,0}] == i));
+    }
+  }
+  ASSERT_TRUE(fsys::remove("./zts_container"));
+}
+
+TEST(array_constructor_from_container_many_columns) {
+  // more extents than the initial extent table can hold:
+  const arr::idx_type ncols = 200;
+  arr::Vector<double> data;
+  for (arr::idx_type i=0; i<2*ncols; ++i) {
+    data.push_back(i);
+  }
+  fsys::remove("./array_container");
+  {
+    arr::Array<double> a({2, ncols}, data, {},
+                         std::make_unique<arr::ContainerAllocFactory>("./array_container"s, false));
+  }
+  {
+    const arr::Array<double> a(std::make_unique<arr::ContainerAllocFactory>("./array_container"s, true));
+    const arr::Array<double> b({2, ncols}, data);
+    ASSERT_TRUE(a == b);
+  }
+  ASSERT_TRUE(fsys::remove("./array_container"));
+}
+
 // slicing LLL
 // equality, etc.
 